@@ -0,0 +1,879 @@
+/* fontgen - writes deterministic synthetic TrueType or CFF fonts for the
+ * benchmarks in ttfbench.c
+ *
+ *    fontgen out.ttf [options]
+ *
+ *    --glyphs N          number of glyphs, including .notdef        (256)
+ *    --contours N        contours per simple glyph                  (2)
+ *    --points N          points per contour, half of them off-curve (16)
+ *    --compound-depth N  nest compound glyphs N deep (TrueType only) (0)
+ *    --kern N            number of 'kern' pairs                     (0)
+ *    --gpos N            number of GPOS PairPos format 1 pairs      (0)
+ *    --gpos-classes N    add a PairPos format 2 subtable, N classes (0)
+ *    --cmap 4|12         cmap subtable format                       (4)
+ *    --cmap-run N        consecutive codepoints per cmap range      (96)
+ *    --cff               write CFF outlines instead of 'glyf'
+ *    --subrs N           share contour pieces through N local subrs (0)
+ *    --cid N             CID-keyed CFF with N font dicts            (0)
+ *    --var N             variable font with a 'wght' axis and N gvar
+ *                        tuples per glyph (TrueType only)           (0)
+ *    --seed N            random seed                                (1)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct
+{
+   unsigned char *data;
+   int size, cap;
+} buf_t;
+
+static void put8(buf_t *b, int v)
+{
+   if (b->size == b->cap) {
+      b->cap = b->cap ? b->cap * 2 : 4096;
+      b->data = (unsigned char *) realloc(b->data, b->cap);
+      if (!b->data) { fprintf(stderr, "fontgen: out of memory\n"); exit(1); }
+   }
+   b->data[b->size++] = (unsigned char) v;
+}
+
+static void put16(buf_t *b, int v) { put8(b, v >> 8); put8(b, v); }
+static void put32(buf_t *b, unsigned int v) { put16(b, (int) (v >> 16)); put16(b, (int) (v & 0xffff)); }
+static void putbuf(buf_t *b, const buf_t *src) { int i; for (i=0; i < src->size; ++i) put8(b, src->data[i]); }
+static void set16(buf_t *b, int at, int v) { b->data[at] = (unsigned char) (v >> 8); b->data[at+1] = (unsigned char) v; }
+static void set32(buf_t *b, int at, unsigned int v) { set16(b, at, (int) (v >> 16)); set16(b, at+2, (int) (v & 0xffff)); }
+
+static unsigned int rng_state;
+static int rnd(int n) { rng_state = rng_state * 1103515245u + 12345u; return (int) ((rng_state >> 8) % (unsigned int) n); }
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// parameters and outlines
+//
+
+static int num_glyphs = 256, num_contours = 2, num_points = 16, compound_depth = 0;
+static int num_kern = 0, num_gpos = 0, gpos_classes = 0, cmap_format = 4, cmap_run = 96;
+static int cff = 0, num_subrs = 0, num_fds = 0, num_var = 0;
+
+typedef struct { int x, y, on; } point;
+
+// simple glyph g: contours of alternating on/off-curve points around an ellipse
+static int make_outline(int g, point *pts, int *ends)
+{
+   int c, i, n = 0;
+   for (c=0; c < num_contours; ++c) {
+      double r = 380.0 - c * (300.0 / num_contours);
+      double cx = 500 + rnd(41) - 20, cy = 350 + rnd(41) - 20;
+      for (i=0; i < num_points; ++i) {
+         double a = (2*3.14159265358979 * i) / num_points;
+         double rr = r * ((i & 1) ? 1.12 : 1.0) * (0.9 + rnd(200) / 1000.0);
+         if (c & 1) a = -a; // alternate winding so inner contours are holes
+         pts[n].x = (int) (cx + rr * cos(a));
+         pts[n].y = (int) (cy + rr * sin(a) * 0.9);
+         pts[n].on = !(i & 1);
+         ++n;
+      }
+      ends[c] = n-1;
+   }
+   (void) g;
+   return n;
+}
+
+// compound glyphs nest compound_depth deep: glyph g has depth g % (depth+1)
+static int glyph_depth(int g)
+{
+   if (compound_depth == 0 || cff || g == 0)
+      return 0;
+   return g % (compound_depth + 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// TrueType outlines
+//
+
+static void write_glyf(buf_t *glyf, buf_t *loca, int *xmin, int *advances)
+{
+   point *pts = (point *) malloc(sizeof(point) * num_contours * num_points);
+   int *ends = (int *) malloc(sizeof(int) * num_contours);
+   int g, i;
+
+   for (g=0; g < num_glyphs; ++g) {
+      put32(loca, glyf->size);
+      advances[g] = 500 + rnd(500);
+      if (glyph_depth(g) == 0) {
+         int n = make_outline(g, pts, ends), x0 = 32767, y0 = 32767, x1 = -32768, y1 = -32768, x, y;
+         for (i=0; i < n; ++i) {
+            if (pts[i].x < x0) x0 = pts[i].x;
+            if (pts[i].y < y0) y0 = pts[i].y;
+            if (pts[i].x > x1) x1 = pts[i].x;
+            if (pts[i].y > y1) y1 = pts[i].y;
+         }
+         put16(glyf, num_contours);
+         put16(glyf, x0); put16(glyf, y0); put16(glyf, x1); put16(glyf, y1);
+         for (i=0; i < num_contours; ++i)
+            put16(glyf, ends[i]);
+         put16(glyf, 0); // no instructions
+         for (i=0; i < n; ++i)
+            put8(glyf, pts[i].on ? 1 : 0); // 16-bit deltas for x and y
+         for (x=0, i=0; i < n; x = pts[i].x, ++i)
+            put16(glyf, pts[i].x - x);
+         for (y=0, i=0; i < n; y = pts[i].y, ++i)
+            put16(glyf, pts[i].y - y);
+         xmin[g] = x0;
+      } else {
+         // the glyph below it in the chain, shifted, plus the chain's base glyph at half size
+         int base = g - glyph_depth(g);
+         put16(glyf, -1);
+         put16(glyf, 0); put16(glyf, -100); put16(glyf, 1100); put16(glyf, 900);
+         put16(glyf, 1 | 2 | 32); put16(glyf, g-1); put16(glyf, 20); put16(glyf, -10);
+         put16(glyf, 1 | 2 | 8);  put16(glyf, base); put16(glyf, 100); put16(glyf, 50); put16(glyf, 0x2000);
+         xmin[g] = 0;
+      }
+      while (glyf->size & 3)
+         put8(glyf, 0);
+   }
+   put32(loca, glyf->size);
+   free(pts);
+   free(ends);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFF outlines
+//
+
+static void cff_int(buf_t *b, int v)
+{
+   if (v >= -107 && v <= 107)
+      put8(b, v + 139);
+   else if (v >= 108 && v <= 1131)
+      v -= 108, put8(b, (v >> 8) + 247), put8(b, v & 255);
+   else if (v >= -1131 && v <= -108)
+      v = -v - 108, put8(b, (v >> 8) + 251), put8(b, v & 255);
+   else
+      put8(b, 28), put16(b, v);
+}
+
+// fixed size, so dict sizes don't depend on the offsets in them
+static void cff_int32(buf_t *b, int v) { put8(b, 29); put32(b, (unsigned int) v); }
+
+static void cff_index(buf_t *b, buf_t *items, int count)
+{
+   int i, off = 1;
+   put16(b, count);
+   if (count == 0)
+      return;
+   put8(b, 4);
+   for (i=0; i <= count; ++i) {
+      put32(b, off);
+      if (i < count) off += items[i].size;
+   }
+   for (i=0; i < count; ++i)
+      putbuf(b, &items[i]);
+}
+
+static int subr_bias(int count)
+{
+   return count < 1240 ? 107 : count < 33900 ? 1131 : 32768;
+}
+
+// the curve from on-curve point p0 through off-curve p1 to on-curve p2, as a cubic
+static void cff_curve(buf_t *cs, point p0, point p1, point p2)
+{
+   int c1x = p0.x + (2 * (p1.x - p0.x)) / 3, c1y = p0.y + (2 * (p1.y - p0.y)) / 3;
+   int c2x = p2.x + (2 * (p1.x - p2.x)) / 3, c2y = p2.y + (2 * (p1.y - p2.y)) / 3;
+   cff_int(cs, c1x - p0.x); cff_int(cs, c1y - p0.y);
+   cff_int(cs, c2x - c1x);  cff_int(cs, c2y - c1y);
+   cff_int(cs, p2.x - c2x); cff_int(cs, p2.y - c2y);
+   put8(cs, 8); // rrcurveto
+}
+
+static int *subr_dx, *subr_dy;
+
+// each subr is four random curves; remember where it leaves the current point
+static void make_subrs(buf_t *subrs, int *dx, int *dy)
+{
+   int i, k;
+   for (i=0; i < num_subrs; ++i) {
+      point p0 = { 0, 0, 1 };
+      for (k=0; k < 4; ++k) {
+         point p1, p2;
+         p1.x = p0.x + rnd(120) - 60; p1.y = p0.y + rnd(120) - 60; p1.on = 0;
+         p2.x = p1.x + rnd(120) - 60; p2.y = p1.y + rnd(120) - 60; p2.on = 1;
+         cff_curve(&subrs[i], p0, p1, p2);
+         p0 = p2;
+      }
+      put8(&subrs[i], 11); // return
+      dx[i] = p0.x;
+      dy[i] = p0.y;
+   }
+}
+
+static void make_charstring(buf_t *cs, int g)
+{
+   point *pts = (point *) malloc(sizeof(point) * num_contours * num_points);
+   int *ends = (int *) malloc(sizeof(int) * num_contours);
+   int c, i, start = 0;
+   point cur = { 0, 0, 1 };
+
+   make_outline(g, pts, ends);
+   for (c=0; c < num_contours; ++c) {
+      int end = ends[c];
+      cff_int(cs, pts[start].x - cur.x);
+      cff_int(cs, pts[start].y - cur.y);
+      put8(cs, 21); // rmoveto
+      for (i=start; i < end; i += 2) {
+         point next = i+2 <= end ? pts[i+2] : pts[start];
+         cff_curve(cs, pts[i], pts[i+1], next);
+         if (num_subrs && (i & 7) == 0) {
+            // a detour through a subr, then a line back onto the outline
+            int s = rnd(num_subrs);
+            cff_int(cs, s - subr_bias(num_subrs));
+            put8(cs, 10); // callsubr
+            cff_int(cs, -subr_dx[s]);
+            cff_int(cs, -subr_dy[s]);
+            put8(cs, 5); // rlineto
+         }
+      }
+      cur = pts[start];
+      start = end + 1;
+   }
+   put8(cs, 14); // endchar
+   free(pts);
+   free(ends);
+}
+
+// CFF layout: header, name INDEX, top dict INDEX, string INDEX, global subrs
+// INDEX, charstrings INDEX, then for CID fonts FDSelect and the FDArray
+// INDEX, then each private dict followed by its local subrs INDEX
+#define TOP_DICT_SIZE   (num_fds ? 5 + 6 + 6 + 7 + 7 : 6 + 6 + 11)
+#define PRIVATE_SIZE    (num_subrs ? 6 : 2)
+#define FONT_DICT_SIZE  11
+
+static void write_cff(buf_t *out, int *advances)
+{
+   buf_t name = { 0 }, top = { 0 }, charstrings = { 0 }, strings = { 0 }, fdselect = { 0 }, fdarray = { 0 };
+   buf_t *cs, *subrs, *fds, *names;
+   int nfd = num_fds ? num_fds : 1, g, f, i;
+   int cs_off, charset_off = 0, fdselect_off = 0, fdarray_off = 0, off;
+   int *priv_off = (int *) malloc(sizeof(int) * nfd);
+
+   cs = (buf_t *) calloc(num_glyphs, sizeof(buf_t));
+   subrs = (buf_t *) calloc(nfd * num_subrs + 1, sizeof(buf_t));
+   fds = (buf_t *) calloc(nfd, sizeof(buf_t));
+   subr_dx = (int *) malloc(sizeof(int) * (nfd * num_subrs + 1));
+   subr_dy = (int *) malloc(sizeof(int) * (nfd * num_subrs + 1));
+
+   // every font dict gets its own copy of the same subrs, so a charstring
+   // draws the same whichever font dict it's in
+   make_subrs(subrs, subr_dx, subr_dy);
+   for (f=1; f < nfd; ++f)
+      for (i=0; i < num_subrs; ++i)
+         putbuf(&subrs[f*num_subrs + i], &subrs[i]);
+   for (g=0; g < num_glyphs; ++g) {
+      advances[g] = 500 + rnd(500);
+      make_charstring(&cs[g], g);
+   }
+   cff_index(&charstrings, cs, num_glyphs);
+   for (i=0; i < 5; ++i)
+      put8(&name, "Synth"[i]);
+
+   // name-keyed fonts need glyph names past the standard strings
+   names = (buf_t *) calloc(num_glyphs, sizeof(buf_t));
+   if (!num_fds) {
+      for (g=1; g < num_glyphs; ++g) {
+         char str[16];
+         sprintf(str, "g%d", g);
+         for (i=0; str[i]; ++i)
+            put8(&names[g-1], str[i]);
+      }
+   }
+   cff_index(&strings, names, num_fds ? 0 : num_glyphs - 1);
+
+   off = 4 + (2+1+8 + name.size) + (2+1+8 + TOP_DICT_SIZE) + strings.size + 2;
+   cs_off = off;
+   off += charstrings.size;
+   charset_off = off;
+   off += 1 + 4;
+   if (num_fds) {
+      fdselect_off = off;
+      off += 1 + 2 + 3*nfd + 2;
+      fdarray_off = off;
+      off += 2+1+4*(nfd+1) + FONT_DICT_SIZE*nfd;
+   }
+   for (f=0; f < nfd; ++f) {
+      buf_t idx = { 0 };
+      priv_off[f] = off;
+      cff_index(&idx, subrs + f*num_subrs, num_subrs);
+      off += PRIVATE_SIZE + (num_subrs ? idx.size : 0);
+      free(idx.data);
+   }
+
+   // top dict
+   if (num_fds) {
+      cff_int(&top, 0); cff_int(&top, 0); cff_int(&top, 0); put8(&top, 12); put8(&top, 30); // ROS
+      cff_int32(&top, charset_off);  put8(&top, 15);                 // charset
+      cff_int32(&top, cs_off);       put8(&top, 17);                 // CharStrings
+      cff_int32(&top, fdarray_off);  put8(&top, 12); put8(&top, 36); // FDArray
+      cff_int32(&top, fdselect_off); put8(&top, 12); put8(&top, 37); // FDSelect
+   } else {
+      cff_int32(&top, charset_off); put8(&top, 15);
+      cff_int32(&top, cs_off); put8(&top, 17);
+      cff_int32(&top, PRIVATE_SIZE); cff_int32(&top, priv_off[0]); put8(&top, 18); // Private
+   }
+
+   put8(out, 1); put8(out, 0); put8(out, 4); put8(out, 4); // header
+   cff_index(out, &name, 1);
+   cff_index(out, &top, 1);
+   putbuf(out, &strings);
+   cff_index(out, NULL, 0); // global subrs
+   putbuf(out, &charstrings);
+
+   // charset format 2, a single range of CIDs equal to the glyph ids or of
+   // the SIDs of the names above
+   put8(out, 2);
+   put16(out, num_fds ? 1 : 391);
+   put16(out, num_glyphs - 2);
+
+   if (num_fds) {
+      // FDSelect format 3, one range of glyphs per font dict
+      put8(&fdselect, 3);
+      put16(&fdselect, nfd);
+      for (f=0; f < nfd; ++f) {
+         put16(&fdselect, (num_glyphs * f) / nfd);
+         put8(&fdselect, f);
+      }
+      put16(&fdselect, num_glyphs);
+      putbuf(out, &fdselect);
+      for (f=0; f < nfd; ++f) {
+         cff_int32(&fds[f], PRIVATE_SIZE); cff_int32(&fds[f], priv_off[f]); put8(&fds[f], 18);
+      }
+      cff_index(&fdarray, fds, nfd);
+      putbuf(out, &fdarray);
+   }
+
+   for (f=0; f < nfd; ++f) {
+      if (out->size != priv_off[f]) { fprintf(stderr, "fontgen: CFF layout mismatch\n"); exit(1); }
+      if (num_subrs) {
+         cff_int32(out, PRIVATE_SIZE); put8(out, 19); // Subrs, right after this dict
+         cff_index(out, subrs + f*num_subrs, num_subrs);
+      } else {
+         cff_int(out, 0); put8(out, 20); // defaultWidthX
+      }
+   }
+
+   for (g=0; g < num_glyphs; ++g) free(cs[g].data);
+   for (i=0; i < nfd * num_subrs; ++i) free(subrs[i].data);
+   for (f=0; f < nfd; ++f) free(fds[f].data);
+   for (g=0; g < num_glyphs; ++g) free(names[g].data);
+   free(names); free(strings.data);
+   free(cs); free(subrs); free(fds); free(priv_off); free(subr_dx); free(subr_dy);
+   free(name.data); free(top.data); free(charstrings.data); free(fdselect.data); free(fdarray.data);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// character map and kerning
+//
+
+// glyph g > 0 maps to codepoint first_codepoint(g); runs of cmap_run glyphs
+// have consecutive codepoints, with a gap of a few codepoints between runs
+static unsigned int glyph_codepoint(int g)
+{
+   unsigned int run = (g-1) / cmap_run, cp;
+   cp = 0x20 + (g-1) + run * 3;
+   if (cmap_format == 4)
+      return cp;
+   return cp >= 0xd800 ? cp + 0x800 : cp; // skip the surrogates
+}
+
+static void write_cmap(buf_t *b)
+{
+   int nruns = (num_glyphs - 1 + cmap_run - 1) / cmap_run, r;
+   put16(b, 0);  // version
+   put16(b, 1);  // one encoding record
+   put16(b, 3); put16(b, cmap_format == 4 ? 1 : 10); put32(b, 12);
+   if (cmap_format == 4) {
+      int segcount = nruns + 1, sel = 0, range;
+      while ((2 << sel) <= segcount) ++sel;
+      range = 2 << sel;
+      put16(b, 4);
+      put16(b, 16 + segcount * 8);
+      put16(b, 0);
+      put16(b, segcount * 2);
+      put16(b, range);
+      put16(b, sel);
+      put16(b, segcount * 2 - range);
+      for (r=0; r < nruns; ++r) {  // end codes
+         int last = (r+1) * cmap_run;
+         if (last > num_glyphs - 1) last = num_glyphs - 1;
+         put16(b, (int) glyph_codepoint(last));
+      }
+      put16(b, 0xffff);
+      put16(b, 0);  // reserved
+      for (r=0; r < nruns; ++r)    // start codes
+         put16(b, (int) glyph_codepoint(r * cmap_run + 1));
+      put16(b, 0xffff);
+      for (r=0; r < nruns; ++r)    // deltas
+         put16(b, (r * cmap_run + 1 - (int) glyph_codepoint(r * cmap_run + 1)) & 0xffff);
+      put16(b, 1);
+      for (r=0; r <= nruns; ++r)   // range offsets
+         put16(b, 0);
+   } else {
+      put16(b, 12);
+      put16(b, 0);
+      put32(b, 16 + nruns * 12);
+      put32(b, 0);
+      put32(b, nruns);
+      for (r=0; r < nruns; ++r) {
+         int first = r * cmap_run + 1, last = (r+1) * cmap_run;
+         if (last > num_glyphs - 1) last = num_glyphs - 1;
+         // a run that straddles the surrogates is split by glyph_codepoint, so
+         // check and emit it as two groups if needed
+         if (glyph_codepoint(last) - glyph_codepoint(first) != (unsigned int) (last - first)) {
+            fprintf(stderr, "fontgen: cmap run crosses the surrogates; change --cmap-run\n");
+            exit(1);
+         }
+         put32(b, glyph_codepoint(first));
+         put32(b, glyph_codepoint(last));
+         put32(b, first);
+      }
+   }
+}
+
+typedef struct { int left, right, value; } kernpair;
+
+static int cmp_pair(const void *p, const void *q)
+{
+   const kernpair *a = (const kernpair *) p, *b = (const kernpair *) q;
+   if (a->left != b->left) return a->left - b->left;
+   return a->right - b->right;
+}
+
+// n distinct random pairs, sorted
+static int make_pairs(kernpair *pairs, int n)
+{
+   int i, j, max = (num_glyphs - 1) * (num_glyphs - 1);
+   if (n > max) n = max;
+   for (;;) {
+      for (i=0; i < n; ++i) {
+         pairs[i].left = 1 + rnd(num_glyphs - 1);
+         pairs[i].right = 1 + rnd(num_glyphs - 1);
+         pairs[i].value = rnd(101) - 50;
+      }
+      qsort(pairs, n, sizeof(pairs[0]), cmp_pair);
+      for (i=j=0; i < n; ++i)
+         if (j == 0 || cmp_pair(&pairs[i], &pairs[j-1]) != 0)
+            pairs[j++] = pairs[i];
+      if (j == n || n > max / 2)
+         return j;
+   }
+}
+
+static void write_kern(buf_t *b)
+{
+   kernpair *pairs = (kernpair *) malloc(sizeof(kernpair) * num_kern);
+   int n = make_pairs(pairs, num_kern), sel = 0, i;
+   while ((2 << sel) <= n) ++sel;
+   put16(b, 0);  // version
+   put16(b, 1);  // one subtable
+   put16(b, 0);  // format 0
+   put16(b, 14 + 6*n);
+   put16(b, 1);  // horizontal
+   put16(b, n);
+   put16(b, 6 << sel);
+   put16(b, sel);
+   put16(b, 6*n - (6 << sel));
+   for (i=0; i < n; ++i) {
+      put16(b, pairs[i].left);
+      put16(b, pairs[i].right);
+      put16(b, pairs[i].value);
+   }
+   free(pairs);
+}
+
+// one lookup of type 2: a PairPos format 1 subtable with individual pairs,
+// then optionally a format 2 subtable with a class matrix
+static void write_gpos(buf_t *b)
+{
+   kernpair *pairs = (kernpair *) malloc(sizeof(kernpair) * (num_gpos + 1));
+   int n = make_pairs(pairs, num_gpos), nsub = (n > 0) + (gpos_classes > 0);
+   int lookup, sub_offsets, i, j, k, nleft, sub;
+
+   put16(b, 1); put16(b, 0);        // version 1.0
+   put16(b, 10); put16(b, 12);      // script list, feature list
+   put16(b, 14);                    // lookup list
+   put16(b, 0); put16(b, 0);        // no scripts or features
+   put16(b, 1); put16(b, 4);        // one lookup, at 4 from the lookup list
+   lookup = b->size;
+   put16(b, 2); put16(b, 0); put16(b, nsub);
+   sub_offsets = b->size;
+   for (i=0; i < nsub; ++i)
+      put16(b, 0);
+   sub = 0;
+
+   if (n > 0) {
+      int table = b->size, cov, sets;
+      for (nleft=0, i=0; i < n; ++i)
+         if (i == 0 || pairs[i].left != pairs[i-1].left)
+            ++nleft;
+      set16(b, sub_offsets + 2*sub++, table - lookup);
+      put16(b, 1); put16(b, 0); put16(b, 4); put16(b, 0); put16(b, nleft);
+      sets = b->size;
+      for (i=0; i < nleft; ++i)
+         put16(b, 0);
+      cov = b->size;
+      set16(b, table + 2, cov - table);
+      put16(b, 1); put16(b, nleft);
+      for (i=0; i < n; ++i)
+         if (i == 0 || pairs[i].left != pairs[i-1].left)
+            put16(b, pairs[i].left);
+      for (k=0, i=0; i < n; i = j, ++k) {
+         for (j=i; j < n && pairs[j].left == pairs[i].left; ++j)
+            ;
+         set16(b, sets + 2*k, b->size - table);
+         put16(b, j - i);
+         for (; i < j; ++i) {
+            put16(b, pairs[i].right);
+            put16(b, pairs[i].value);
+         }
+      }
+   }
+
+   if (gpos_classes > 0) {
+      int table = b->size, c1, c2, per = (num_glyphs - 1 + gpos_classes - 1) / gpos_classes;
+      set16(b, sub_offsets + 2*sub++, table - lookup);
+      put16(b, 2); put16(b, 0); put16(b, 4); put16(b, 0);
+      put16(b, 0); put16(b, 0);              // class defs, filled in below
+      put16(b, gpos_classes + 1); put16(b, gpos_classes + 1);
+      for (c1=0; c1 <= gpos_classes; ++c1)
+         for (c2=0; c2 <= gpos_classes; ++c2)
+            put16(b, (c1 && c2) ? rnd(101) - 50 : 0);
+      set16(b, table + 2, b->size - table);  // coverage: every glyph
+      put16(b, 2); put16(b, 1); put16(b, 1); put16(b, num_glyphs - 1); put16(b, 0);
+      set16(b, table + 8, b->size - table);  // first glyph: ranges of 'per' glyphs
+      put16(b, 2); put16(b, gpos_classes);
+      for (c1=0; c1 < gpos_classes; ++c1) {
+         int first = 1 + c1 * per, last = first + per - 1;
+         if (last > num_glyphs - 1) last = num_glyphs - 1;
+         if (first > last) first = last;
+         put16(b, first); put16(b, last); put16(b, c1 + 1);
+      }
+      set16(b, table + 10, b->size - table); // second glyph: glyph modulo classes
+      put16(b, 1); put16(b, 1); put16(b, num_glyphs - 1);
+      for (i=1; i < num_glyphs; ++i)
+         put16(b, 1 + i % gpos_classes);
+   }
+   if (b->size > 0xffff) {
+      fprintf(stderr, "fontgen: GPOS too big for 16-bit offsets; use fewer pairs or classes\n");
+      exit(1);
+   }
+   free(pairs);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// variations
+//
+
+// the peak of tuple k on the 'wght' axis in F2Dot14: tuples alternate
+// between the heavy and the light side, each pair closer to the default
+static int var_peak(int k)
+{
+   int p = 16384 - (k/2) * 16384 / (num_var/2 + 1);
+   return (k & 1) ? -p : p;
+}
+
+// the advance delta of glyph g in tuple k; only the even tuples, which
+// cover all points, move the phantom points
+static int var_advance_delta(int g, int k)
+{
+   return (k & 1) || g == 0 ? 0 : (g * 13 + k * 29) % 50 - 10;
+}
+
+// the serialized data of tuple k for a glyph with n points: even tuples
+// have deltas for all points, odd ones for every other point, leaving the
+// rest to be inferred
+static void var_tuple(buf_t *b, int g, int k, int n)
+{
+   int all = !(k & 1), count = all ? n + 4 : n / 2, i, axis;
+   if (all)
+      put8(b, 0);
+   else {
+      put8(b, 0x80 | (count >> 8)); put8(b, count & 255);
+      for (i=0; i < count; ++i) {
+         if (i % 128 == 0) put8(b, 0x80 | ((count - i < 128 ? count - i : 128) - 1));
+         put16(b, i ? 2 : 0);
+      }
+   }
+   for (axis=0; axis < 2; ++axis)
+      for (i=0; i < count; ++i) {
+         int pt = all ? i : 2*i, d;
+         if (i % 64 == 0) put8(b, 0x40 | ((count - i < 64 ? count - i : 64) - 1));
+         if (pt < n)
+            d = (g * 31 + pt * 17 + k * 7 + axis * 3) % 41 - 20;
+         else
+            d = axis == 0 && pt == n+1 ? var_advance_delta(g, k) : 0;
+         put16(b, d);
+      }
+}
+
+static void write_fvar(buf_t *b)
+{
+   put16(b, 1); put16(b, 0); put16(b, 16); put16(b, 2); // version, axes offset
+   put16(b, 1); put16(b, 20); put16(b, 0); put16(b, 8);  // one axis, no named instances
+   put8(b, 'w'); put8(b, 'g'); put8(b, 'h'); put8(b, 't');
+   put32(b, 100 << 16); put32(b, 400 << 16); put32(b, 900 << 16);
+   put16(b, 0); put16(b, 256);
+}
+
+static void write_gvar(buf_t *b)
+{
+   buf_t data = { 0 }, ser = { 0 };
+   int *sizes = (int *) malloc(sizeof(int) * num_var);
+   int g, k;
+
+   put16(b, 1); put16(b, 0); put16(b, 1); put16(b, 0); // version, 1 axis, no shared tuples
+   put32(b, 20 + 4 * (num_glyphs + 1));
+   put16(b, num_glyphs); put16(b, 1);                  // long offsets
+   put32(b, 20 + 4 * (num_glyphs + 1));
+   for (g=0; g < num_glyphs; ++g) {
+      int n = glyph_depth(g) ? 2 : num_contours * num_points;
+      put32(b, data.size);
+      if (g == 0)
+         continue; // .notdef doesn't vary
+      ser.size = 0;
+      for (k=0; k < num_var; ++k) {
+         int before = ser.size;
+         var_tuple(&ser, g, k, n);
+         sizes[k] = ser.size - before;
+      }
+      put16(&data, num_var);
+      put16(&data, 4 + 6 * num_var);
+      for (k=0; k < num_var; ++k) {
+         put16(&data, sizes[k]);
+         put16(&data, 0x8000 | 0x2000); // embedded peak, private point numbers
+         put16(&data, var_peak(k));
+      }
+      putbuf(&data, &ser);
+   }
+   put32(b, data.size);
+   putbuf(b, &data);
+   free(data.data);
+   free(ser.data);
+   free(sizes);
+}
+
+// advance deltas matching the phantom points of the even gvar tuples, one
+// region per tuple, with glyph ids indexing the deltas directly
+static void write_hvar(buf_t *b)
+{
+   int regions = (num_var + 1) / 2, g, k;
+   put16(b, 1); put16(b, 0); put32(b, 20);
+   put32(b, 0); put32(b, 0); put32(b, 0);
+   put16(b, 1); put32(b, 12); put16(b, 1); put32(b, 12 + 4 + 6 * regions);
+   put16(b, 1); put16(b, regions);
+   for (k=0; k < regions; ++k) {
+      int peak = var_peak(2*k);
+      put16(b, peak < 0 ? peak : 0); put16(b, peak); put16(b, peak > 0 ? peak : 0);
+   }
+   put16(b, num_glyphs); put16(b, regions); put16(b, regions);
+   for (k=0; k < regions; ++k)
+      put16(b, k);
+   for (g=0; g < num_glyphs; ++g)
+      for (k=0; k < regions; ++k)
+         put16(b, var_advance_delta(g, 2*k));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// the font file
+//
+
+typedef struct { const char *tag; buf_t data; } table;
+
+static unsigned int checksum(const buf_t *b)
+{
+   unsigned int sum = 0;
+   int i;
+   for (i=0; i < b->size; ++i)
+      sum += (unsigned int) b->data[i] << (24 - 8 * (i & 3));
+   return sum;
+}
+
+static int cmp_table(const void *p, const void *q)
+{
+   return strcmp(((const table *) p)->tag, ((const table *) q)->tag);
+}
+
+static void write_font(FILE *f)
+{
+   table t[16];
+   buf_t out = { 0 };
+   int *xmin = (int *) malloc(sizeof(int) * num_glyphs);
+   int *adv = (int *) malloc(sizeof(int) * num_glyphs);
+   int n = 0, i, g, off, sel = 0, maxadv = 0, head_at = 0;
+   unsigned int total;
+
+   memset(t, 0, sizeof(t));
+   if (cff) {
+      t[n].tag = "CFF ";
+      write_cff(&t[n++].data, adv);
+      for (g=0; g < num_glyphs; ++g) xmin[g] = 0;
+   } else {
+      t[n].tag = "glyf";
+      t[n+1].tag = "loca";
+      write_glyf(&t[n].data, &t[n+1].data, xmin, adv);
+      n += 2;
+   }
+   for (g=0; g < num_glyphs; ++g)
+      if (adv[g] > maxadv) maxadv = adv[g];
+
+   t[n].tag = "head";
+   put32(&t[n].data, 0x00010000); put32(&t[n].data, 0x00010000);
+   put32(&t[n].data, 0); put32(&t[n].data, 0x5F0F3CF5);   // checksum adjustment, magic
+   put16(&t[n].data, 0); put16(&t[n].data, 1000);          // flags, unitsPerEm
+   for (i=0; i < 4; ++i) put32(&t[n].data, 0);             // created, modified
+   put16(&t[n].data, -100); put16(&t[n].data, -300); put16(&t[n].data, 1100); put16(&t[n].data, 1000);
+   put16(&t[n].data, 0); put16(&t[n].data, 8); put16(&t[n].data, 2);
+   put16(&t[n].data, 1); put16(&t[n].data, 0);             // long loca, glyph data format
+   ++n;
+
+   t[n].tag = "hhea";
+   put32(&t[n].data, 0x00010000);
+   put16(&t[n].data, 800); put16(&t[n].data, -200); put16(&t[n].data, 90);
+   put16(&t[n].data, maxadv); put16(&t[n].data, -100); put16(&t[n].data, -100); put16(&t[n].data, 1100);
+   put16(&t[n].data, 1); put16(&t[n].data, 0); put16(&t[n].data, 0);
+   for (i=0; i < 5; ++i) put16(&t[n].data, 0);
+   put16(&t[n].data, num_glyphs);
+   ++n;
+
+   t[n].tag = "hmtx";
+   for (g=0; g < num_glyphs; ++g) {
+      put16(&t[n].data, adv[g]);
+      put16(&t[n].data, xmin[g]);
+   }
+   ++n;
+
+   t[n].tag = "maxp";
+   if (cff) {
+      put32(&t[n].data, 0x00005000);
+      put16(&t[n].data, num_glyphs);
+   } else {
+      put32(&t[n].data, 0x00010000);
+      put16(&t[n].data, num_glyphs);
+      put16(&t[n].data, num_contours * num_points); put16(&t[n].data, num_contours);
+      put16(&t[n].data, num_contours * num_points * 2); put16(&t[n].data, num_contours * 2);
+      put16(&t[n].data, 2);
+      for (i=0; i < 6; ++i) put16(&t[n].data, 0);
+      put16(&t[n].data, 2); put16(&t[n].data, compound_depth);
+   }
+   ++n;
+
+   t[n].tag = "cmap";
+   write_cmap(&t[n++].data);
+   if (num_kern) {
+      t[n].tag = "kern";
+      write_kern(&t[n++].data);
+   }
+   if (num_gpos || gpos_classes) {
+      t[n].tag = "GPOS";
+      write_gpos(&t[n++].data);
+   }
+   if (num_var) {
+      t[n].tag = "fvar";
+      write_fvar(&t[n++].data);
+      t[n].tag = "gvar";
+      write_gvar(&t[n++].data);
+      t[n].tag = "HVAR";
+      write_hvar(&t[n++].data);
+   }
+
+   qsort(t, n, sizeof(t[0]), cmp_table);
+   while ((2 << sel) <= n) ++sel;
+   put32(&out, cff ? 0x4F54544F : 0x00010000);
+   put16(&out, n); put16(&out, 16 << sel); put16(&out, sel); put16(&out, 16*n - (16 << sel));
+   off = 12 + 16*n;
+   for (i=0; i < n; ++i) {
+      int length = t[i].data.size;
+      while (t[i].data.size & 3)
+         put8(&t[i].data, 0);
+      put8(&out, t[i].tag[0]); put8(&out, t[i].tag[1]); put8(&out, t[i].tag[2]); put8(&out, t[i].tag[3]);
+      put32(&out, checksum(&t[i].data));
+      put32(&out, off);
+      put32(&out, length);
+      if (strcmp(t[i].tag, "head") == 0)
+         head_at = off;
+      off += t[i].data.size;
+   }
+   for (i=0; i < n; ++i)
+      putbuf(&out, &t[i].data);
+   total = checksum(&out);
+   set32(&out, head_at + 8, 0xB1B0AFBA - total);
+
+   fwrite(out.data, 1, out.size, f);
+   for (i=0; i < n; ++i)
+      free(t[i].data.data);
+   free(out.data);
+   free(xmin);
+   free(adv);
+}
+
+int main(int argc, char **argv)
+{
+   FILE *f;
+   int i;
+   unsigned int seed = 1;
+
+   if (argc < 2) {
+      fprintf(stderr, "usage: fontgen out.ttf [options], see fontgen.c\n");
+      return 1;
+   }
+   for (i=2; i < argc; ++i) {
+      const char *opt = argv[i];
+      int v = i+1 < argc ? atoi(argv[i+1]) : 0;
+      if      (!strcmp(opt, "--cff"))            { cff = 1; continue; }
+      else if (!strcmp(opt, "--glyphs"))         num_glyphs = v;
+      else if (!strcmp(opt, "--contours"))       num_contours = v;
+      else if (!strcmp(opt, "--points"))         num_points = v;
+      else if (!strcmp(opt, "--compound-depth")) compound_depth = v;
+      else if (!strcmp(opt, "--kern"))           num_kern = v;
+      else if (!strcmp(opt, "--gpos"))           num_gpos = v;
+      else if (!strcmp(opt, "--gpos-classes"))   gpos_classes = v;
+      else if (!strcmp(opt, "--cmap"))           cmap_format = v;
+      else if (!strcmp(opt, "--cmap-run"))       cmap_run = v;
+      else if (!strcmp(opt, "--subrs"))          num_subrs = v;
+      else if (!strcmp(opt, "--cid"))            { num_fds = v; cff = 1; }
+      else if (!strcmp(opt, "--var"))            num_var = v;
+      else if (!strcmp(opt, "--seed"))           seed = (unsigned int) v;
+      else {
+         fprintf(stderr, "fontgen: unknown option %s\n", opt);
+         return 1;
+      }
+      ++i;
+   }
+   if (num_glyphs < 2 || num_glyphs > 65535 || num_contours < 1 || num_points < 4 || (num_points & 1)
+       || (cmap_format != 4 && cmap_format != 12) || cmap_run < 1 || num_fds > 255 || compound_depth < 0
+       || num_var < 0 || num_var > 64 || (num_var && cff)) {
+      fprintf(stderr, "fontgen: bad parameters\n");
+      return 1;
+   }
+   if (cmap_format == 4 && glyph_codepoint(num_glyphs - 1) > 0xfffe) {
+      fprintf(stderr, "fontgen: too many glyphs for a format 4 cmap\n");
+      return 1;
+   }
+   rng_state = seed;
+
+   f = fopen(argv[1], "wb");
+   if (!f) {
+      fprintf(stderr, "fontgen: can't write %s\n", argv[1]);
+      return 1;
+   }
+   write_font(f);
+   fclose(f);
+   return 0;
+}
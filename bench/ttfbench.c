@@ -0,0 +1,707 @@
+/* ttfbench - times the main entry points of stb_truetype.h on a set of fonts
+ *
+ *    ttfbench [--iters N] [--reps N] [--quick] [--json out.json] font...
+ *    ttfbench --check font...
+ *
+ * Every benchmark runs a batch of operations (all glyphs, a fixed glyph
+ * subset, ...) and reports the minimum and median time per operation over
+ * several repetitions. Each repetition runs the batch --iters times; without
+ * --iters the count is calibrated so a repetition takes about 20ms (2ms with
+ * --quick, which also uses fewer repetitions and smaller glyph subsets).
+ *
+ * --check doesn't time anything; it compares the results of the optional
+ * tables the benchmarks use against the plain lookups they replace, and a
+ * variable font's instances with and without the caches, and exits with 1
+ * if any differ.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+
+#ifdef _WIN32
+#include <windows.h>
+static double now_ns(void)
+{
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER t;
+   if (!freq.QuadPart)
+      QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&t);
+   return (double) t.QuadPart * 1e9 / (double) freq.QuadPart;
+}
+#else
+#include <time.h>
+static double now_ns(void)
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (double) t.tv_sec * 1e9 + (double) t.tv_nsec;
+}
+#endif
+
+typedef struct
+{
+   const char *path;
+   unsigned char *data;
+   long size;
+   stbtt_fontinfo info;
+   stbtt_fontinfo tables;  // the same font with the optional tables built
+   stbtt_fontinfo classes; // ... with only the expanded 'GPOS' class tables
+   stbtt_sized_font sized; // info at 32 pixels
+   int *codepoints;     // one mapped codepoint per glyph, in glyph order
+   int num_codepoints;
+   int *glyphs;         // the glyph subset used by the expensive benchmarks
+   int num_glyphs;
+   int *run;            // every glyph in order, then room for its kerning
+   float scale;         // set by the sized benchmarks
+   unsigned char *bitmap;
+} bench_font;
+
+// keeps the compiler from discarding results
+static volatile int sink;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// benchmarks; each runs one batch and returns the number of operations
+//
+
+static int bench_init(bench_font *f)
+{
+   stbtt_fontinfo info;
+   sink += stbtt_InitFont(&info, f->data, f->size, 0);
+   return 1;
+}
+
+static int bench_find_glyph(bench_font *f)
+{
+   int i, sum = 0;
+   for (i=0; i < f->num_codepoints; ++i)
+      sum += stbtt_FindGlyphIndex(&f->info, f->codepoints[i]);
+   sink += sum;
+   return f->num_codepoints;
+}
+
+static int bench_glyph_shape(bench_font *f)
+{
+   int g, sum = 0;
+   for (g=0; g < f->info.numGlyphs; ++g) {
+      stbtt_vertex *v;
+      sum += stbtt_GetGlyphShape(&f->info, g, &v);
+      stbtt_FreeShape(&f->info, v);
+   }
+   sink += sum;
+   return f->info.numGlyphs;
+}
+
+// for CFF fonts this is the charstring interpreter on its own, with no
+// vertices stored
+static int bench_shape_bound(bench_font *f)
+{
+   int g, sum = 0;
+   for (g=0; g < f->info.numGlyphs; ++g)
+      sum += stbtt_GetGlyphShapeBound(&f->info, g);
+   sink += sum;
+   return f->info.numGlyphs;
+}
+
+static int bench_hmetrics(bench_font *f)
+{
+   int g, sum = 0;
+   for (g=0; g < f->info.numGlyphs; ++g) {
+      int advance, lsb;
+      stbtt_GetGlyphHMetrics(&f->info, g, &advance, &lsb);
+      sum += advance + lsb;
+   }
+   sink += sum;
+   return f->info.numGlyphs;
+}
+
+static int bench_hmetrics_table(bench_font *f)
+{
+   int g, sum = 0;
+   for (g=0; g < f->tables.numGlyphs; ++g) {
+      int advance, lsb;
+      stbtt_GetGlyphHMetrics(&f->tables, g, &advance, &lsb);
+      sum += advance + lsb;
+   }
+   sink += sum;
+   return f->tables.numGlyphs;
+}
+
+// scaled advances and kerning from a sized font, whose tables are filled by
+// the first repetition; the kerning pairs are those of the glyph subset, a
+// working set that fits the sized font's cache, as UI text does
+static int bench_advance_sized(bench_font *f)
+{
+   int g;
+   float sum = 0;
+   for (g=0; g < f->info.numGlyphs; ++g)
+      sum += stbtt_GetSizedGlyphAdvance(&f->sized, g);
+   sink += (int) sum;
+   return f->info.numGlyphs;
+}
+
+static int bench_kern_sized(bench_font *f)
+{
+   int i;
+   float sum = 0;
+   for (i=1; i < f->num_glyphs; ++i)
+      sum += stbtt_GetSizedGlyphKernAdvance(&f->sized, f->glyphs[i-1], f->glyphs[i]);
+   sink += (int) sum;
+   return f->num_glyphs - 1;
+}
+
+// outlines and advances of a non-default instance of a variable font; the
+// other fonts skip these
+static int bench_shape_var(bench_font *f)
+{
+   float coord = 0.6f;
+   int g, sum = 0;
+   if (!stbtt_SetVariationCoords(&f->info, &coord, 1))
+      return 0;
+   for (g=0; g < f->info.numGlyphs; ++g) {
+      stbtt_vertex *v;
+      sum += stbtt_GetGlyphShape(&f->info, g, &v);
+      stbtt_FreeShape(&f->info, v);
+   }
+   stbtt_SetVariationCoords(&f->info, NULL, 0);
+   sink += sum;
+   return f->info.numGlyphs;
+}
+
+static int bench_hmetrics_var(bench_font *f)
+{
+   float coord = 0.6f;
+   int g, sum = 0;
+   if (!stbtt_SetVariationCoords(&f->info, &coord, 1))
+      return 0;
+   for (g=0; g < f->info.numGlyphs; ++g) {
+      int advance, lsb;
+      stbtt_GetGlyphHMetrics(&f->info, g, &advance, &lsb);
+      sum += advance;
+   }
+   stbtt_SetVariationCoords(&f->info, NULL, 0);
+   sink += sum;
+   return f->info.numGlyphs;
+}
+
+static int bench_kern(bench_font *f)
+{
+   int i, sum = 0;
+   for (i=1; i < f->info.numGlyphs; ++i)
+      sum += stbtt_GetGlyphKernAdvance(&f->info, i-1, i);
+   sink += sum;
+   return f->info.numGlyphs - 1;
+}
+
+static int bench_kern_classes(bench_font *f)
+{
+   int i, sum = 0;
+   for (i=1; i < f->classes.numGlyphs; ++i)
+      sum += stbtt_GetGlyphKernAdvance(&f->classes, i-1, i);
+   sink += sum;
+   return f->classes.numGlyphs - 1;
+}
+
+static int bench_kern_table(bench_font *f)
+{
+   int i, sum = 0;
+   for (i=1; i < f->tables.numGlyphs; ++i)
+      sum += stbtt_GetGlyphKernAdvance(&f->tables, i-1, i);
+   sink += sum;
+   return f->tables.numGlyphs - 1;
+}
+
+static int bench_kern_run(bench_font *f)
+{
+   int *kerning = f->run + f->info.numGlyphs;
+   stbtt_GetGlyphRunKernAdvances(&f->info, f->run, f->info.numGlyphs, kerning);
+   sink += kerning[0];
+   return f->info.numGlyphs - 1;
+}
+
+// outline fetch plus rasterization, as stbtt_MakeGlyphBitmap does it
+static int bench_rasterize(bench_font *f)
+{
+   int i;
+   for (i=0; i < f->num_glyphs; ++i) {
+      int x0, y0, x1, y1;
+      stbtt_GetGlyphBitmapBox(&f->info, f->glyphs[i], f->scale, f->scale, &x0, &y0, &x1, &y1);
+      stbtt_MakeGlyphBitmap(&f->info, f->bitmap, x1-x0, y1-y0, x1-x0, f->scale, f->scale, f->glyphs[i]);
+      sink += f->bitmap[0];
+   }
+   return f->num_glyphs;
+}
+
+static int bench_sdf(bench_font *f)
+{
+   int i;
+   for (i=0; i < f->num_glyphs; ++i) {
+      int w, h, xoff, yoff;
+      unsigned char *sdf = stbtt_GetGlyphSDF(&f->info, f->scale, f->glyphs[i], 4, 128, 32.0f, &w, &h, &xoff, &yoff);
+      sink += w;
+      stbtt_FreeSDF(sdf, NULL);
+   }
+   return f->num_glyphs;
+}
+
+// packs the first num_glyphs codepoints into a 1024x1024 atlas
+static int bench_pack(bench_font *f)
+{
+   stbtt_pack_context pc;
+   stbtt_pack_range range;
+   stbtt_packedchar *chars = (stbtt_packedchar *) malloc(sizeof(stbtt_packedchar) * f->num_glyphs);
+
+   range.font_size = 32;
+   range.first_unicode_codepoint_in_range = 0;
+   range.array_of_unicode_codepoints = f->codepoints;
+   range.num_chars = f->num_glyphs;
+   range.chardata_for_range = chars;
+   stbtt_PackBegin(&pc, f->bitmap, 1024, 1024, 0, 1, NULL);
+   sink += stbtt_PackFontRanges(&pc, f->data, f->size, 0, &range, 1);
+   stbtt_PackEnd(&pc);
+   free(chars);
+   return f->num_glyphs;
+}
+
+typedef struct
+{
+   const char *name;
+   int (*run)(bench_font *f);
+   float pixels; // font size for the sized benchmarks, 0 if unused
+} benchmark;
+
+static const benchmark benchmarks[] =
+{
+   { "init",          bench_init,          0 },
+   { "find_glyph",    bench_find_glyph,    0 },
+   { "glyph_shape",   bench_glyph_shape,   0 },
+   { "shape_bound",   bench_shape_bound,   0 },
+   { "hmetrics",      bench_hmetrics,      0 },
+   { "hmetrics_table", bench_hmetrics_table, 0 },
+   { "advance_sized", bench_advance_sized, 0 },
+   { "shape_var",     bench_shape_var,     0 },
+   { "hmetrics_var",  bench_hmetrics_var,  0 },
+   { "kern",          bench_kern,          0 },
+   { "kern_classes",  bench_kern_classes,  0 },
+   { "kern_table",    bench_kern_table,    0 },
+   { "kern_run",      bench_kern_run,      0 },
+   { "kern_sized",    bench_kern_sized,    0 },
+   { "rasterize_8",   bench_rasterize,     8 },
+   { "rasterize_16",  bench_rasterize,    16 },
+   { "rasterize_32",  bench_rasterize,    32 },
+   { "rasterize_64",  bench_rasterize,    64 },
+   { "rasterize_128", bench_rasterize,   128 },
+   { "rasterize_256", bench_rasterize,   256 },
+   { "rasterize_512", bench_rasterize,   512 },
+   { "sdf_32",        bench_sdf,          32 },
+   { "pack_32",       bench_pack,          0 },
+};
+
+#define NUM_BENCHMARKS  ((int) (sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// checks; each returns the number of mismatches it found
+//
+
+// compares the fields each vertex type uses; the others aren't always set
+static int same_outline(const stbtt_vertex *a, const stbtt_vertex *b, int n)
+{
+   int i;
+   for (i=0; i < n; ++i) {
+      if (a[i].type != b[i].type || a[i].x != b[i].x || a[i].y != b[i].y)
+         return 0;
+      if (a[i].type >= STBTT_vcurve && (a[i].cx != b[i].cx || a[i].cy != b[i].cy))
+         return 0;
+      if (a[i].type == STBTT_vcubic && (a[i].cx1 != b[i].cx1 || a[i].cy1 != b[i].cy1))
+         return 0;
+   }
+   return 1;
+}
+
+static int check_positioning(const char *path, const char *what, stbtt_fontinfo *info, stbtt_fontinfo *plain, int g1, int g2)
+{
+   stbtt_glyphpos a1, a2, b1, b2;
+   int ra = stbtt_GetGlyphPairPositioning(plain, g1, g2, &a1, &a2);
+   int rb = stbtt_GetGlyphPairPositioning(info, g1, g2, &b1, &b2);
+   if (ra == rb && !memcmp(&a1, &b1, sizeof(a1)) && !memcmp(&a2, &b2, sizeof(a2)))
+      return 0;
+   printf("%s: %s positioning of %d,%d differs\n", path, what, g1, g2);
+   return 1;
+}
+
+// kerning from the tables, the class tables and whole runs, and pair
+// positioning, for pairs with each left glyph of a sample of up to 1024;
+// both stop after 10 mismatches
+static int check_kerning(bench_font *f)
+{
+   int n = f->info.numGlyphs, step = n > 1024 ? (n + 1023) / 1024 : 1;
+   int *run = (int *) malloc(sizeof(int) * 2 * n);
+   int *expect = (int *) malloc(sizeof(int) * 2 * n);
+   int *kerning = (int *) malloc(sizeof(int) * 2 * n);
+   stbtt_fontinfo *modes[3];
+   const char *names[3] = { "plain", "kerning table", "class table" };
+   int g1, g2, m, i, errors = 0;
+
+   modes[0] = &f->info;
+   modes[1] = &f->tables;
+   modes[2] = &f->classes;
+   for (g1=0; g1 < n && errors < 10; g1 += step) {
+      // g1 on either side of every glyph
+      for (g2=0; g2 < n; ++g2) {
+         run[2*g2] = g1;
+         run[2*g2+1] = g2;
+      }
+      for (i=0; i+1 < 2*n; ++i)
+         expect[i] = stbtt_GetGlyphKernAdvance(&f->info, run[i], run[i+1]);
+      for (m=0; m < 3; ++m) {
+         stbtt_GetGlyphRunKernAdvances(modes[m], run, 2*n, kerning);
+         for (i=0; i+1 < 2*n && errors < 10; ++i) {
+            if (m && stbtt_GetGlyphKernAdvance(modes[m], run[i], run[i+1]) != expect[i]) {
+               printf("%s: %s kerning of %d,%d differs\n", f->path, names[m], run[i], run[i+1]);
+               ++errors;
+            }
+            if (kerning[i] != expect[i]) {
+               printf("%s: %s run kerning of %d,%d differs\n", f->path, names[m], run[i], run[i+1]);
+               ++errors;
+            }
+         }
+      }
+      for (g2=0; g2 < n && errors < 10; ++g2) {
+         stbtt_glyphpos first;
+         stbtt_GetGlyphPairPositioning(&f->info, g1, g2, &first, NULL);
+         if (first.x_advance != expect[2*g2]) {
+            printf("%s: positioning of %d,%d differs from its kerning\n", f->path, g1, g2);
+            ++errors;
+         }
+         errors += check_positioning(f->path, names[1], &f->tables, &f->info, g1, g2);
+         errors += check_positioning(f->path, names[2], &f->classes, &f->info, g1, g2);
+      }
+   }
+   free(run);
+   free(expect);
+   free(kerning);
+   return errors;
+}
+
+// advance and left side bearing of every glyph from the metrics table;
+// stops after 10 mismatches
+static int check_metrics(bench_font *f)
+{
+   int g, errors = 0;
+   for (g=0; g < f->info.numGlyphs && errors < 10; ++g) {
+      int adva, lsba, advb, lsbb;
+      stbtt_GetGlyphHMetrics(&f->info, g, &adva, &lsba);
+      stbtt_GetGlyphHMetrics(&f->tables, g, &advb, &lsbb);
+      if (adva != advb || lsba != lsbb) {
+         printf("%s: metrics table of glyph %d differs\n", f->path, g);
+         ++errors;
+      }
+   }
+   return errors;
+}
+
+// outlines, boxes and horizontal metrics of every glyph are the same in
+// two fontinfos; stops after 10 mismatches, which are only reported if
+// 'what' isn't NULL
+static int check_glyphs(const char *path, const char *what, stbtt_fontinfo *a, stbtt_fontinfo *b)
+{
+   int g, errors = 0;
+   for (g=0; g < a->numGlyphs && errors < 10; ++g) {
+      stbtt_vertex *va, *vb;
+      int na = stbtt_GetGlyphShape(a, g, &va);
+      int nb = stbtt_GetGlyphShape(b, g, &vb);
+      int a0, a1, a2, a3, b0, b1, b2, b3, adva, lsba, advb, lsbb;
+      int ba = stbtt_GetGlyphBox(a, g, &a0, &a1, &a2, &a3);
+      int bb = stbtt_GetGlyphBox(b, g, &b0, &b1, &b2, &b3);
+      if (na != nb || !same_outline(va, vb, na)) {
+         if (what) printf("%s: %s outline of glyph %d differs\n", path, what, g);
+         ++errors;
+      }
+      if (ba != bb || (ba && (a0 != b0 || a1 != b1 || a2 != b2 || a3 != b3))) {
+         if (what) printf("%s: %s box of glyph %d differs\n", path, what, g);
+         ++errors;
+      }
+      stbtt_GetGlyphHMetrics(a, g, &adva, &lsba);
+      stbtt_GetGlyphHMetrics(b, g, &advb, &lsbb);
+      if (adva != advb || lsba != lsbb) {
+         if (what) printf("%s: %s metrics of glyph %d differ\n", path, what, g);
+         ++errors;
+      }
+      stbtt_FreeShape(a, va);
+      stbtt_FreeShape(b, vb);
+   }
+   return errors;
+}
+
+// a non-default instance of a variable font, with and without the outline
+// cache, glyph box table and metrics table; then the default instance again
+static int check_variations(bench_font *f)
+{
+   stbtt_fontinfo plain, cached, fresh;
+   float coords[16];
+   int n = stbtt_GetNumVariationAxes(&f->info), i, errors = 0;
+
+   if (n <= 0)
+      return 0;
+   if (n > 16)
+      n = 16;
+   for (i=0; i < n; ++i)
+      coords[i] = i & 1 ? -0.4f : 0.6f;
+   if (!stbtt_InitFont(&plain, f->data, f->size, 0) || !stbtt_InitFont(&fresh, f->data, f->size, 0)
+       || !stbtt_InitFontEx(&cached, f->data, f->size, 0, STBTT_INIT_OUTLINE_CACHE | STBTT_INIT_GLYPH_BOXES | STBTT_INIT_HMETRICS)
+       || !stbtt_SetVariationCoords(&plain, coords, n) || !stbtt_SetVariationCoords(&cached, coords, n)) {
+      printf("%s: can't select an instance\n", f->path);
+      return 1;
+   }
+   // twice, so the second pass reads what the caches kept
+   errors += check_glyphs(f->path, "cached instance", &plain, &cached);
+   errors += check_glyphs(f->path, "cached instance", &plain, &cached);
+   if (!check_glyphs(f->path, NULL, &plain, &fresh)) {
+      printf("%s: the instance is the same as the default one\n", f->path);
+      ++errors;
+   }
+
+   stbtt_SetVariationCoords(&plain, NULL, 0);
+   stbtt_SetVariationCoords(&cached, NULL, 0);
+   errors += check_glyphs(f->path, "default instance", &fresh, &plain);
+   errors += check_glyphs(f->path, "cached default instance", &fresh, &cached);
+
+   stbtt_FreeFontCaches(&plain);
+   stbtt_FreeFontCaches(&cached);
+   return errors;
+}
+
+// outlines and boxes of compiled charstrings, for CFF fonts
+static int check_compiled(bench_font *f)
+{
+   stbtt_fontinfo compiled;
+   int n = f->info.numGlyphs, g, errors = 0;
+
+   if (!f->info.cff.size)
+      return 0;
+   if (!stbtt_InitFont(&compiled, f->data, f->size, 0) || !stbtt_CompileGlyphCharstrings(&compiled, f->run, n)) {
+      printf("%s: can't compile charstrings\n", f->path);
+      return 1;
+   }
+   for (g=0; g < n && errors < 10; ++g) {
+      stbtt_vertex *a, *b;
+      int na = stbtt_GetGlyphShape(&f->info, g, &a);
+      int nb = stbtt_GetGlyphShape(&compiled, g, &b);
+      int a0, a1, a2, a3, b0, b1, b2, b3;
+      int ba = stbtt_GetGlyphBox(&f->info, g, &a0, &a1, &a2, &a3);
+      int bb = stbtt_GetGlyphBox(&compiled, g, &b0, &b1, &b2, &b3);
+      if (na != nb || !same_outline(a, b, na)) {
+         printf("%s: compiled outline of glyph %d differs\n", f->path, g);
+         ++errors;
+      }
+      if (ba != bb || (ba && (a0 != b0 || a1 != b1 || a2 != b2 || a3 != b3))) {
+         printf("%s: compiled box of glyph %d differs\n", f->path, g);
+         ++errors;
+      }
+      if (stbtt_GetGlyphShapeBound(&f->info, g) != stbtt_GetGlyphShapeBound(&compiled, g)) {
+         printf("%s: compiled shape bound of glyph %d differs\n", f->path, g);
+         ++errors;
+      }
+      stbtt_FreeShape(&f->info, a);
+      stbtt_FreeShape(&compiled, b);
+   }
+   stbtt_FreeFontCaches(&compiled);
+   return errors;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// driver
+//
+
+static int load_font(bench_font *f, const char *path, int subset)
+{
+   FILE *fp = fopen(path, "rb");
+   int g, cp, step;
+
+   memset(f, 0, sizeof(*f));
+   f->path = path;
+   if (!fp)
+      return 0;
+   fseek(fp, 0, SEEK_END);
+   f->size = ftell(fp);
+   fseek(fp, 0, SEEK_SET);
+   f->data = (unsigned char *) malloc(f->size);
+   if (fread(f->data, 1, f->size, fp) != (size_t) f->size) {
+      fclose(fp);
+      return 0;
+   }
+   fclose(fp);
+   if (!stbtt_InitFont(&f->info, f->data, f->size, 0))
+      return 0;
+   if (!stbtt_InitFontEx(&f->tables, f->data, f->size, 0, STBTT_INIT_HMETRICS | STBTT_INIT_KERNING))
+      return 0;
+   if (!stbtt_InitFontEx(&f->classes, f->data, f->size, 0, STBTT_INIT_GPOS_CLASSES))
+      return 0;
+   if (!stbtt_InitSizedFont(&f->sized, &f->info, 32))
+      return 0;
+
+   // the first codepoint that maps to each glyph
+   f->codepoints = (int *) malloc(sizeof(int) * f->info.numGlyphs);
+   for (cp=0; cp <= 0x10ffff && f->num_codepoints < f->info.numGlyphs - 1; ++cp)
+      if (stbtt_FindGlyphIndex(&f->info, cp))
+         f->codepoints[f->num_codepoints++] = cp;
+   if (f->num_codepoints == 0)
+      return 0;
+
+   // an evenly spread glyph subset
+   if (subset > f->info.numGlyphs - 1)
+      subset = f->info.numGlyphs - 1;
+   step = (f->info.numGlyphs - 1) / subset;
+   f->glyphs = (int *) malloc(sizeof(int) * subset);
+   for (g=0; g < subset; ++g)
+      f->glyphs[g] = 1 + g * step;
+   f->num_glyphs = subset;
+   if (f->num_glyphs > f->num_codepoints)
+      f->num_glyphs = f->num_codepoints;
+
+   f->run = (int *) malloc(sizeof(int) * 2 * f->info.numGlyphs);
+   for (g=0; g < f->info.numGlyphs; ++g)
+      f->run[g] = g;
+
+   f->bitmap = (unsigned char *) malloc(1024 * 1024);
+   return 1;
+}
+
+static void free_font(bench_font *f)
+{
+   free(f->data);
+   free(f->codepoints);
+   free(f->glyphs);
+   free(f->run);
+   free(f->bitmap);
+   stbtt_FreeSizedFont(&f->sized);
+   stbtt_FreeFontCaches(&f->info);
+   stbtt_FreeFontCaches(&f->tables);
+   stbtt_FreeFontCaches(&f->classes);
+}
+
+static int cmp_double(const void *p, const void *q)
+{
+   double a = *(const double *) p, b = *(const double *) q;
+   return a < b ? -1 : a > b;
+}
+
+int main(int argc, char **argv)
+{
+   double target_ns = 20e6, *times;
+   int iters = 0, reps = 7, subset = 64, quick = 0, check = 0, errors = 0, first_font = 0, nfonts = 0;
+   const char *json_path = NULL;
+   FILE *json = NULL;
+   int a, b, r;
+
+   for (a=1; a < argc; ++a) {
+      if (!strcmp(argv[a], "--iters") && a+1 < argc)
+         iters = atoi(argv[++a]);
+      else if (!strcmp(argv[a], "--reps") && a+1 < argc)
+         reps = atoi(argv[++a]);
+      else if (!strcmp(argv[a], "--json") && a+1 < argc)
+         json_path = argv[++a];
+      else if (!strcmp(argv[a], "--quick"))
+         quick = 1;
+      else if (!strcmp(argv[a], "--check"))
+         check = 1;
+      else if (argv[a][0] == '-') {
+         fprintf(stderr, "usage: ttfbench [--iters N] [--reps N] [--quick] [--json out.json] font...\n"
+                         "       ttfbench --check font...\n");
+         return 1;
+      } else {
+         if (!first_font) first_font = a;
+         ++nfonts;
+      }
+   }
+   if (!nfonts) {
+      fprintf(stderr, "ttfbench: no fonts given\n");
+      return 1;
+   }
+   if (quick) {
+      target_ns = 2e6;
+      reps = 3;
+      subset = 8;
+   }
+   if (reps < 1) reps = 1;
+   times = (double *) malloc(sizeof(double) * reps);
+
+   if (json_path) {
+      json = fopen(json_path, "w");
+      if (!json) {
+         fprintf(stderr, "ttfbench: can't write %s\n", json_path);
+         return 1;
+      }
+      fprintf(json, "{\n  \"reps\": %d,\n  \"fonts\": [", reps);
+   }
+
+   for (a=first_font; a < argc; ++a) {
+      bench_font f;
+      if (argv[a][0] == '-') {
+         if (strcmp(argv[a], "--quick") && strcmp(argv[a], "--check")) ++a; // skip the option's value
+         continue;
+      }
+      if (!load_font(&f, argv[a], subset)) {
+         fprintf(stderr, "ttfbench: can't load %s\n", argv[a]);
+         return 1;
+      }
+      if (check) {
+         int e = check_metrics(&f) + check_kerning(&f) + check_compiled(&f) + check_variations(&f);
+         printf("%s: %s\n", f.path, e ? "MISMATCH" : "ok");
+         errors += e;
+         free_font(&f);
+         continue;
+      }
+      printf("%s: %d glyphs, %d bytes\n", f.path, f.info.numGlyphs, (int) f.size);
+      printf("  %-16s %8s %12s %12s\n", "benchmark", "ops", "min ns/op", "median ns/op");
+      if (json)
+         fprintf(json, "%s\n    {\n      \"font\": \"%s\",\n      \"glyphs\": %d,\n      \"benchmarks\": [",
+                 a == first_font ? "" : ",", f.path, f.info.numGlyphs);
+
+      for (b=0; b < NUM_BENCHMARKS; ++b) {
+         const benchmark *bm = &benchmarks[b];
+         int ops = 0, n = iters, i;
+         double t;
+
+         if (bm->pixels)
+            f.scale = stbtt_ScaleForPixelHeight(&f.info, bm->pixels);
+         // warm up, and calibrate the batch count
+         t = now_ns();
+         ops = bm->run(&f);
+         t = now_ns() - t;
+         if (ops == 0)
+            continue; // doesn't apply to this font
+         if (n <= 0) {
+            n = (int) (target_ns / (t > 1 ? t : 1));
+            if (n < 1) n = 1;
+         }
+         for (r=0; r < reps; ++r) {
+            t = now_ns();
+            for (i=0; i < n; ++i)
+               bm->run(&f);
+            times[r] = (now_ns() - t) / ((double) n * ops);
+         }
+         qsort(times, reps, sizeof(times[0]), cmp_double);
+         printf("  %-16s %8d %12.1f %12.1f\n", bm->name, ops, times[0], times[reps/2]);
+         if (json)
+            fprintf(json, "%s\n        { \"name\": \"%s\", \"ops\": %d, \"iters\": %d, \"min_ns\": %.1f, \"median_ns\": %.1f }",
+                    b ? "," : "", bm->name, ops, n, times[0], times[reps/2]);
+      }
+      if (json)
+         fprintf(json, "\n      ]\n    }");
+      free_font(&f);
+   }
+
+   if (json) {
+      fprintf(json, "\n  ]\n}\n");
+      fclose(json);
+   }
+   free(times);
+   return errors != 0;
+}
@@ -117,6 +117,12 @@
 //           stbtt_GetFontOffsetForIndex()        -- indexing for TTC font collections
 //           stbtt_GetNumberOfFonts()             -- number of fonts for TTC font collections
 //
+//   Load a font file by mapping it into memory (read-only, shared between processes;
+//   #define STBTT_MMAP before including this file to get these)
+//           stbtt_InitFontFromFile()             -- map the file and call stbtt_InitFont
+//           stbtt_OpenFontMapping()              -- just map the file
+//           stbtt_CloseFontMapping()             -- unmap when you're done with the font
+//
 //   Render a unicode codepoint to a bitmap
 //           stbtt_GetCodepointBitmap()           -- allocates and returns a bitmap
 //           stbtt_MakeCodepointBitmap()          -- renders into bitmap you provide
@@ -127,6 +133,7 @@
 //           stbtt_GetFontVMetrics()
 //           stbtt_GetFontVMetricsOS2()
 //           stbtt_GetCodepointKernAdvance()
+//           stbtt_MapUTF8Glyphs()                -- all of the above for a UTF-8 string
 //
 //   Starting with version 1.06, the rasterizer was replaced with a new,
 //   faster and generally-more-precise rasterizer. The new rasterizer more
@@ -487,6 +494,24 @@ int main(int arg, char **argv)
    #define STBTT_memcpy       memcpy
    #define STBTT_memset       memset
    #endif
+
+   // #define STBTT_MMAP to get stbtt_OpenFontMapping() and friends. Under a
+   // strict ISO C mode, the POSIX declarations also need _POSIX_C_SOURCE
+   // (200112L or later) defined before any system header is included.
+   #ifdef STBTT_MMAP
+   #if defined(_WIN32)
+   #ifndef WIN32_LEAN_AND_MEAN
+   #define WIN32_LEAN_AND_MEAN
+   #endif
+   #include <windows.h>
+   #else
+   #include <sys/types.h>
+   #include <sys/stat.h>
+   #include <sys/mman.h>
+   #include <fcntl.h>
+   #include <unistd.h>
+   #endif
+   #endif
 #endif
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -517,6 +542,21 @@ typedef struct
    int size;
 } stbtt__buf;
 
+// private structure
+typedef struct
+{
+   unsigned int tag;                  // four-character tag, big-endian packed
+   unsigned int offset;               // offset of table from start of file
+   unsigned int length;               // length of table in bytes
+} stbtt__table;
+
+// maximum number of table directory entries indexed in stbtt_fontinfo;
+// fonts with more tables fall back to scanning the directory in the file.
+// (must be the same in every file that includes this header)
+#ifndef STBTT_MAX_TABLES
+#define STBTT_MAX_TABLES 48
+#endif
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // TEXTURE BAKING API
@@ -563,6 +603,8 @@ STBTT_DEF void stbtt_GetBakedQuad(const stbtt_bakedchar *chardata, int pw, int p
 
 STBTT_DEF void stbtt_GetScaledFontVMetrics(const unsigned char *fontdata, long dsize, int index, float size, float *ascent, float *descent, float *lineGap);
 // Query the font vertical metrics without having to create a font first.
+// Only the 'head' and 'hhea' tables are read; if they can't be found, the
+// metrics are 0. To query them repeatedly, see stbtt_InitSizedFont.
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -723,12 +765,30 @@ struct stbtt_fontinfo
    int index_map;                     // a cmap mapping for our chosen character encoding
    int indexToLocFormat;              // format needed to map from glyph index to glyph
 
+   struct stbtt__glyphmap *glyphmap;  // optional, see stbtt_BuildGlyphIndexMap
+   struct stbtt__revmap *revmap;      // optional, see stbtt_BuildReverseGlyphIndexMap
+   struct stbtt__outline_cache *outlines; // optional, see stbtt_BuildOutlineCache
+   struct stbtt__boxtable *boxes;     // optional, see stbtt_BuildGlyphBoxTable
+   struct stbtt__fdmap *fdmap;        // optional, see stbtt_BuildFDSelectMap
+   struct stbtt__cscache *compiled;   // optional, see stbtt_CompileGlyphCharstrings
+   struct stbtt__var *var;            // optional, see stbtt_SetVariationCoords
+   stbtt_int16 *hmetrics;             // optional, see stbtt_BuildHMetricsTable
+   struct stbtt__kerntable *kerning;  // optional, see stbtt_BuildKerningTable
+   struct stbtt__gposclasses *gposclasses; // optional, see stbtt_BuildGPOSClassTables
+   struct stbtt__asciitable *ascii;   // optional, see stbtt_BuildASCIITable
+
+   int numTables;                     // number of entries in tables[], or -1 if the directory is too big to index
+   stbtt__table tables[STBTT_MAX_TABLES]; // table directory sorted by tag, for binary search
+
    stbtt__buf cff;                    // cff font data
    stbtt__buf charstrings;            // the charstring index
    stbtt__buf gsubrs;                 // global charstring subroutines index
    stbtt__buf subrs;                  // private charstring subroutines index
    stbtt__buf fontdicts;              // array of font dicts
    stbtt__buf fdselect;               // map from glyph to fontdict
+   int cff_state;                     // whether the cff indexes above have been parsed yet
+
+   int validated;                     // set by stbtt_ValidateFont
 };
 
 STBTT_DEF int stbtt_InitFont(stbtt_fontinfo *info, const unsigned char *data, long dsize, int offset);
@@ -736,7 +796,84 @@ STBTT_DEF int stbtt_InitFont(stbtt_fontinfo *info, const unsigned char *data, lo
 // the necessary cached info for the rest of the system. You must allocate
 // the stbtt_fontinfo yourself, and stbtt_InitFont will fill it out. You don't
 // need to do anything special to free it, because the contents are pure
-// value data with no additional data structures. Returns 0 on failure.
+// value data with no additional data structures (unless you build optional
+// tables, see stbtt_FreeFontCaches). Returns 0 on failure.
+
+enum { // flags for stbtt_InitFontEx
+   STBTT_INIT_LAZY_CFF  = 1,    // don't parse CFF outline data until the first outline or box is requested
+   STBTT_INIT_GLYPH_MAP = 2,    // call stbtt_BuildGlyphIndexMap
+   STBTT_INIT_REVERSE_MAP = 4,  // call stbtt_BuildReverseGlyphIndexMap
+   STBTT_INIT_VALIDATE  = 8,    // call stbtt_ValidateFont, and fail if it fails
+   STBTT_INIT_OUTLINE_CACHE = 16, // call stbtt_BuildOutlineCache with STBTT_OUTLINE_CACHE_BYTES
+   STBTT_INIT_GLYPH_BOXES = 32, // call stbtt_BuildGlyphBoxTable
+   STBTT_INIT_FDSELECT_MAP = 64, // call stbtt_BuildFDSelectMap
+   STBTT_INIT_HMETRICS  = 128,  // call stbtt_BuildHMetricsTable
+   STBTT_INIT_KERNING   = 256,  // call stbtt_BuildKerningTable
+   STBTT_INIT_GPOS_CLASSES = 512, // call stbtt_BuildGPOSClassTables
+   STBTT_INIT_ASCII_TABLE = 1024 // call stbtt_BuildASCIITable
+};
+
+STBTT_DEF int stbtt_InitFontEx(stbtt_fontinfo *info, const unsigned char *data, long dsize, int offset, int flags);
+// Same as stbtt_InitFont, with flags from the enum above.
+//
+// STBTT_INIT_LAZY_CFF is for OpenType/CFF fonts that are only opened for
+// metrics or character coverage: parsing of the CFF header and INDEX
+// structures is deferred until a glyph's outline or bounding box is first
+// needed. That first use may happen concurrently on several threads. A
+// font whose CFF data turns out to be unusable then has empty glyphs,
+// instead of stbtt_InitFontEx failing.
+//
+// The other flags build optional lookup tables as part of initialization,
+// the same as calling the corresponding stbtt_Build* function afterwards.
+// Failing to build one of them doesn't make stbtt_InitFontEx fail.
+//
+// STBTT_INIT_VALIDATE checks the table directory before anything else is
+// read from the font, so use it for fonts from untrusted sources.
+
+STBTT_DEF int stbtt_ValidateFont(stbtt_fontinfo *info);
+// Checks the structure of the font against dsize once, up front: that all
+// tables lie inside the buffer and are big enough for what's read from
+// them, that 'loca' is monotonic and every glyph's outline data (including
+// compound glyph references, with nesting up to STBTT_MAX_COMPOUND_DEPTH)
+// is inside its glyph, that the cmap subtable is well-formed, that 'hmtx'
+// covers every glyph, that the CFF INDEX and FDSelect structures are in
+// bounds, and the same for the kerning data in 'kern' and 'GPOS'. Returns
+// 1 if it all checks out. Glyph metric and outline accessors then skip
+// their own bounds checks; glyph indices passed to them must still be less
+// than the number of glyphs in the font.
+
+STBTT_DEF void stbtt_FreeFontCaches(stbtt_fontinfo *info);
+// Frees the optional tables built by the stbtt_Build* functions (or by
+// stbtt_InitFontEx flags), and the variable font instances selected with
+// stbtt_SetVariationCoords. The fontinfo can still be used afterwards, just
+// without the speed-up, and as the default instance. Build them before
+// sharing the fontinfo between threads, and free them once no thread is
+// using it.
+
+#ifdef STBTT_MMAP
+typedef struct
+{
+   unsigned char *data;               // read-only view of the whole file
+   long size;                         // size of the mapping in bytes; pass as dsize
+   void *handle;                      // platform-specific, don't touch
+} stbtt_fontmapping;
+
+STBTT_DEF int  stbtt_OpenFontMapping(stbtt_fontmapping *map, const char *filename);
+// Maps a font file read-only into memory. Unlike reading the file into a
+// buffer, nothing is copied: every process that maps the same file shares
+// the one copy in the OS page cache. Returns 0 on failure.
+
+STBTT_DEF void stbtt_CloseFontMapping(stbtt_fontmapping *map);
+// Unmaps a file mapped by stbtt_OpenFontMapping or stbtt_InitFontFromFile.
+// Fonts initialized from the mapping must not be used after this.
+
+STBTT_DEF int  stbtt_InitFontFromFile(stbtt_fontinfo *info, stbtt_fontmapping *map, const char *filename, int index);
+// Maps 'filename' into 'map' and initializes the index'th font in it (use
+// index=0 for a plain .ttf/.otf). The OS is told to read ahead the tables
+// needed for metrics and character mapping, and to expect random access to
+// the glyph outlines. Returns 0 on failure, in which case nothing is left
+// mapped; otherwise call stbtt_CloseFontMapping when done with the font.
+#endif
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -750,6 +887,79 @@ STBTT_DEF int stbtt_FindGlyphIndex(const stbtt_fontinfo *info, int unicode_codep
 // codepoint-based functions.
 // Returns 0 if the character codepoint is not defined in the font.
 
+STBTT_DEF void stbtt_FindGlyphIndices(const stbtt_fontinfo *info, const int *codepoints, int n, int *glyphs);
+// Same as calling stbtt_FindGlyphIndex for each of the n codepoints, but
+// faster on real text: the cmap range a codepoint is found in is reused for
+// the codepoints that follow it as long as they're in the same range.
+
+STBTT_DEF int stbtt_MapUTF8Glyphs(const stbtt_fontinfo *info, const char *text, int len, int *glyphs, int *advances, int *kerning);
+// Decodes len bytes of UTF-8 text and stores, for each character, its glyph
+// index, its unscaled advance width, and the unscaled kerning between it and
+// the previous character (0 for the first one). Any of the output arrays may
+// be NULL; each must have room for len entries. Returns the number of
+// characters. Bytes that aren't part of a valid UTF-8 sequence decode as
+// U+FFFD. Runs of ASCII are found 16 bytes at a time with SSE2, and mapped
+// through a table without decoding or kerning each character, unless
+// kerning is asked for without glyphs.
+
+STBTT_DEF int stbtt_BuildASCIITable(stbtt_fontinfo *info);
+// Looks up the glyph index and advance width of the 128 ASCII characters
+// once, so stbtt_MapUTF8Glyphs maps ASCII text with a table load per
+// character. Without it, each call looks up the characters it sees, with
+// a cmap search and an 'hmtx' read for each distinct one. It takes 512
+// bytes. The advances are those of a variable font's default instance;
+// while another one is selected, they're read as usual. Free it with
+// stbtt_FreeFontCaches(). Returns 0 if out of memory.
+
+STBTT_DEF int stbtt_BuildGlyphIndexMap(stbtt_fontinfo *info);
+// Expands the font's character map into a two-level table, after which
+// stbtt_FindGlyphIndex is two array loads instead of a search of the cmap
+// data. It costs 512 bytes for each block of 256 codepoints the font maps
+// at least one character in, plus 2 bytes per block up to the highest one.
+// Free it with stbtt_FreeFontCaches(). Returns 0 if out of memory or if the
+// font's cmap format isn't supported; stbtt_FindGlyphIndex still works then.
+
+STBTT_DEF int stbtt_GetCodepointsForGlyph(const stbtt_fontinfo *info, int glyph_index, int *codepoints, int max_codepoints);
+// The reverse of stbtt_FindGlyphIndex: stores up to max_codepoints of the
+// codepoints that map to glyph_index, and returns how many there are in
+// total (which may be more than max_codepoints). Glyph 0 has none.
+
+STBTT_DEF int stbtt_BuildReverseGlyphIndexMap(stbtt_fontinfo *info);
+// Builds an index that makes stbtt_GetCodepointsForGlyph a table lookup
+// rather than a pass over the cmap. It takes 4 bytes per glyph plus 4 bytes
+// per mapped codepoint. Free it with stbtt_FreeFontCaches(). Returns 0 if
+// out of memory or if the font's cmap format isn't supported.
+
+typedef struct
+{
+   unsigned int *ranges;   // num_ranges pairs of first,last codepoint, sorted and disjoint
+   int num_ranges;
+   unsigned int *bmp;      // bit (c&31) of bmp[c>>5] is set if codepoint c < 0x10000 is covered
+   void *userdata;
+} stbtt_coverage;
+
+STBTT_DEF int stbtt_GetFontCoverage(const stbtt_fontinfo *info, stbtt_coverage *coverage);
+// Computes the set of Unicode codepoints that stbtt_FindGlyphIndex maps to
+// a glyph other than 0. The set doesn't refer to the font once built, so it
+// can be kept around (or saved, see below) to pick fallback fonts without
+// loading them. Returns 0 if out of memory or if the font's cmap format
+// isn't supported.
+
+STBTT_DEF int stbtt_CoverageFromRanges(stbtt_coverage *coverage, const unsigned int *ranges, int num_ranges, void *userdata);
+// Rebuilds a coverage set from its 'ranges' array, e.g. one saved to a file.
+// The ranges must be sorted and disjoint. Returns 0 if out of memory.
+
+STBTT_DEF int stbtt_CoverageHas(const stbtt_coverage *coverage, int codepoint);
+// Returns 1 if codepoint is in the set. This is a bit test for the BMP, and
+// a binary search of the ranges above it.
+
+STBTT_DEF int stbtt_CoverageMissing(const stbtt_coverage *coverage, const int *codepoints, int n, int *missing);
+// Stores the positions in codepoints[0..n) of the codepoints that aren't
+// in the set into missing[], and returns how many there are.
+
+STBTT_DEF void stbtt_FreeCoverage(stbtt_coverage *coverage);
+// Frees the memory of a coverage set.
+
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -802,6 +1012,37 @@ STBTT_DEF int  stbtt_GetGlyphKernAdvance(const stbtt_fontinfo *info, int glyph1,
 STBTT_DEF int  stbtt_GetGlyphBox(const stbtt_fontinfo *info, int glyph_index, int *x0, int *y0, int *x1, int *y1);
 // as above, but takes one or more glyph indices for greater efficiency
 
+STBTT_DEF void stbtt_GetGlyphRunKernAdvances(const stbtt_fontinfo *info, const int *glyphs, int num_glyphs, int *kerning);
+// Stores the kerning between glyphs[i] and glyphs[i+1] into kerning[i] for
+// each of the num_glyphs-1 adjacent pairs, the same as calling
+// stbtt_GetGlyphKernAdvance for each pair. The font's kerning tables are
+// looked up once for the whole run rather than once per pair, and with
+// 'GPOS' the search for a left glyph's first subtable isn't repeated while
+// the glyph stays the same.
+
+typedef struct stbtt_glyphpos
+{
+   short x_placement, y_placement; // moves the glyph, in unscaled coordinates
+   short x_advance, y_advance;     // added to its advance
+} stbtt_glyphpos;
+
+STBTT_DEF int stbtt_GetGlyphPairPositioning(const stbtt_fontinfo *info, int glyph1, int glyph2, stbtt_glyphpos *first, stbtt_glyphpos *second);
+// Gets all the adjustments of the pair that stbtt_GetGlyphKernAdvance reads
+// its result from (which is first->x_advance): 'GPOS' pairs can move either
+// glyph and change either glyph's advance, horizontally and vertically,
+// while 'kern' pairs only change the first glyph's x advance. Device tables
+// and variation deltas aren't applied. Either pointer may be NULL. Returns 1
+// if the font has an entry for the pair, else 0 with everything set to 0.
+
+STBTT_DEF int stbtt_BuildHMetricsTable(stbtt_fontinfo *info);
+// Expands 'hmtx' into an advance width and left side bearing per glyph, 4
+// bytes per glyph, so stbtt_GetGlyphHMetrics (and everything measuring
+// text through it) is two loads instead of a look at 'hhea' and a branch
+// on the glyph being past the font's long metrics. For a variable font the
+// table holds the selected instance's metrics, and each instance of
+// stbtt_SetVariationCoords gets its own. Free it with stbtt_FreeFontCaches().
+// Returns 0 if out of memory.
+
 typedef struct stbtt_kerningentry
 {
    int glyph1; // use stbtt_FindGlyphIndex
@@ -815,6 +1056,105 @@ STBTT_DEF int  stbtt_GetKerningTable(const stbtt_fontinfo *info, stbtt_kerningen
 // stbtt_GetKerningTable never writes more than table_length entries and returns how many entries it did write.
 // The table will be sorted by (a.glyph1 == b.glyph1)?(a.glyph2 < b.glyph2):(a.glyph1 < b.glyph1)
 
+STBTT_DEF int stbtt_BuildKerningTable(stbtt_fontinfo *info);
+// Compiles the font's pair kerning (from 'GPOS' if it has one, otherwise
+// from 'kern', as stbtt_GetGlyphKernAdvance picks them) into a sorted array
+// of right glyphs and adjustments per left glyph, plus the class matrices
+// of class-based 'GPOS' subtables with the right glyphs' classes expanded
+// per glyph. A pair is then a short binary search or two array loads,
+// instead of a walk over the lookups with a coverage search per subtable.
+// It takes 12 bytes per glyph, 4 bytes per listed pair, and 2 bytes per
+// glyph for each class-based subtable; if any pair adjusts more than the
+// first glyph's x advance, the decoded adjustments that
+// stbtt_GetGlyphPairPositioning returns add 16 bytes per listed pair and
+// per entry of the class matrices. Free it with stbtt_FreeFontCaches().
+// Returns 0 if out of memory or if the kerning data isn't well-formed, in
+// which case the uncompiled lookups are used.
+
+STBTT_DEF int stbtt_BuildGPOSClassTables(stbtt_fontinfo *info);
+// A lighter alternative to stbtt_BuildKerningTable for 'GPOS' kerning: lists
+// the pair adjustment subtables once, and expands their coverage tables and
+// class definitions into arrays of 2 bytes per glyph, so the lookups that
+// stbtt_GetGlyphKernAdvance makes for each subtable are a load instead of a
+// binary search. Subtables that point at the same coverage or class table
+// share its array. Free it with stbtt_FreeFontCaches(). Returns 0 if out of
+// memory or if the font has no well-formed 'GPOS' table.
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// SIZED FONTS
+//
+// For text laid out at a few fixed sizes: a sized font holds the scale and
+// the scaled vertical metrics of a font at one size, and remembers each
+// glyph's scaled advance and recent pairs' scaled kerning once they've been
+// asked for, so measuring text doesn't go back to the font tables for them.
+
+typedef struct stbtt_sized_font
+{
+   const stbtt_fontinfo *info;
+   float scale;                       // multiplies unscaled coordinates
+   float ascent, descent, line_gap;   // as from stbtt_GetFontVMetrics, scaled
+
+   // private
+   float *advance;                    // scaled advance width of each glyph, if has_advance
+   unsigned char *has_advance;        // a bit per glyph
+   struct stbtt__sized_kern *kern;    // STBTT_SIZED_KERN_CACHE recently used pairs
+} stbtt_sized_font;
+
+STBTT_DEF int stbtt_InitSizedFont(stbtt_sized_font *sf, const stbtt_fontinfo *info, float size);
+// Sets up sf for info at size, which is the height from the lowest descender
+// to the highest ascender in pixels as in stbtt_ScaleForPixelHeight, or an
+// em size wrapped in STBTT_POINT_SIZE() as in stbtt_PackFontRange. info has
+// to outlive sf. The advances are those of the variation instance that is
+// selected when they're first asked for, so make a new sized font after
+// stbtt_SetVariationCoords. Returns 0 if out of memory.
+
+STBTT_DEF void stbtt_FreeSizedFont(stbtt_sized_font *sf);
+// Frees the memory of a sized font.
+
+STBTT_DEF float stbtt_GetSizedGlyphAdvance(stbtt_sized_font *sf, int glyph_index);
+STBTT_DEF float stbtt_GetSizedGlyphKernAdvance(stbtt_sized_font *sf, int glyph1, int glyph2);
+// stbtt_GetGlyphHMetrics' advance width and stbtt_GetGlyphKernAdvance,
+// multiplied by the scale. Both fill sf's tables as they go, so a sized
+// font shouldn't be used by more than one thread at a time.
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// VARIABLE FONTS
+//
+
+STBTT_DEF int stbtt_GetNumVariationAxes(const stbtt_fontinfo *info);
+// Returns the number of design axes (weight, width, ...) of a variable font,
+// from its 'fvar' table, or 0 if it isn't one.
+
+STBTT_DEF int stbtt_GetVariationAxis(const stbtt_fontinfo *info, int axis, char *tag, float *min_value, float *default_value, float *max_value);
+// Stores the four-letter tag of the axis (e.g. "wght", not 0-terminated)
+// and its range in the units the font's designer used (e.g. 100..900 with
+// 400 as the default for weight). Any of the pointers may be NULL. Returns
+// 0 if there's no such axis.
+
+STBTT_DEF float stbtt_NormalizeVariationCoord(const stbtt_fontinfo *info, int axis, float value);
+// Maps a value in the axis' own units to the -1..1 scale that
+// stbtt_SetVariationCoords takes, on which the axis default is 0.
+
+STBTT_DEF int stbtt_SetVariationCoords(stbtt_fontinfo *info, const float *coords, int num_coords);
+// Selects the instance of a TrueType variable font that outlines, bounding
+// boxes and advance widths come from, by its normalized coordinate on each
+// axis (see stbtt_NormalizeVariationCoord). Axes past num_coords stay at 0,
+// so num_coords=0 selects the default instance again. The font's 'avar'
+// mapping is applied to the coordinates, outlines get the 'gvar' deltas,
+// and advances (and side bearings, if the font has them) the 'HVAR' deltas,
+// or those of the 'gvar' phantom points if there's no 'HVAR'. Vertical
+// metrics, kerning and CFF2 outlines don't vary.
+//
+// The outline cache and glyph box table belong to the instance. The last
+// STBTT_MAX_VAR_INSTANCES instances selected keep theirs, so moving between
+// a few weights doesn't decode their outlines again, and a new instance gets
+// the same caches as the one selected before it. Don't call this while
+// another thread is using the fontinfo. stbtt_FreeFontCaches() frees the
+// instances and goes back to the default one. Returns 0 if the font isn't a
+// variable font or if out of memory.
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // GLYPH SHAPES (you probably don't need these, but they have to go before
@@ -843,6 +1183,37 @@ STBTT_DEF int  stbtt_GetKerningTable(const stbtt_fontinfo *info, stbtt_kerningen
 STBTT_DEF int stbtt_IsGlyphEmpty(const stbtt_fontinfo *info, int glyph_index);
 // returns non-zero if nothing is drawn for this glyph
 
+STBTT_DEF int stbtt_BuildGlyphBoxTable(stbtt_fontinfo *info);
+// Attaches a table of 12 bytes per glyph that remembers each glyph's
+// bounding box and whether it's empty the first time they're asked for.
+// For OpenType/CFF fonts, stbtt_GetGlyphBox and stbtt_IsGlyphEmpty have
+// to run the glyph's charstring, and the bitmap functions ask for the box
+// several times per glyph, so this saves most of the cost of sizing and
+// packing glyphs. The table fills in safely from several threads at once.
+// stbtt_PackFontRanges builds one for CFF fonts by itself. Free it with
+// stbtt_FreeFontCaches(). Returns 0 if out of memory.
+
+STBTT_DEF int stbtt_BuildFDSelectMap(stbtt_fontinfo *info);
+// For CID-keyed OpenType/CFF fonts: finds the local subroutines of every
+// font dict up front, and expands the FDSelect table into two bytes per
+// glyph, so decoding a glyph doesn't search FDSelect and parse its font
+// dict and private dict again. It takes 2 bytes per glyph plus 4KB. Free it
+// with stbtt_FreeFontCaches(). Returns 0 if out of memory or if the font
+// isn't CID-keyed.
+
+STBTT_DEF int stbtt_CompileGlyphCharstrings(stbtt_fontinfo *info, const int *glyphs, int num_glyphs);
+// For OpenType/CFF fonts: runs the charstrings of the given glyphs once and
+// keeps what they draw as a flat list of moves, lines and curves, with the
+// subroutine calls, hints and operand decoding already done. Outlines and
+// bounding boxes of those glyphs then replay the list instead of
+// interpreting the charstring, with the same results. Compile the glyphs
+// you render most, such as those stbtt_FindGlyphIndices gives for Latin
+// text and digits; it can be called again to add more. It takes about 13
+// bytes per drawing operation, plus 4 bytes per glyph in the font. Free it
+// with stbtt_FreeFontCaches(). Returns 0 if out of memory or if the font
+// isn't CFF-based; glyphs compiled before running out of memory are kept,
+// and a later call picks up the rest.
+
 STBTT_DEF int stbtt_GetCodepointShape(const stbtt_fontinfo *info, int unicode_codepoint, stbtt_vertex **vertices);
 STBTT_DEF int stbtt_GetGlyphShape(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **vertices);
 // returns # of vertices and fills *vertices with the pointer to them
@@ -858,6 +1229,27 @@ STBTT_DEF int stbtt_GetGlyphShape(const stbtt_fontinfo *info, int glyph_index, s
 STBTT_DEF void stbtt_FreeShape(const stbtt_fontinfo *info, stbtt_vertex *vertices);
 // frees the data allocated above
 
+STBTT_DEF int stbtt_GetGlyphShapeBound(const stbtt_fontinfo *info, int glyph_index);
+STBTT_DEF int stbtt_GetGlyphShapeInto(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex *vertices, int max_vertices);
+// The same as stbtt_GetGlyphShape, but without allocating: GetGlyphShapeBound
+// returns how many vertices to make room for (an upper bound on the number
+// the glyph decodes to), and GetGlyphShapeInto decodes into the caller's
+// array and returns the number of vertices written. GetGlyphShapeInto
+// returns 0 if the glyph doesn't fit, which can't happen when max_vertices
+// is at least the bound, so one large buffer can be reused for every glyph
+// without calling GetGlyphShapeBound each time.
+
+STBTT_DEF int stbtt_BuildOutlineCache(stbtt_fontinfo *info, int budget_bytes);
+// Attaches a cache of decoded outlines to the font, so that rendering a
+// glyph again (at another size, or as an SDF after a bitmap) copies its
+// vertices instead of decoding the glyph data or running the CFF charstring
+// again. It uses at most budget_bytes, including a table of 4 bytes per
+// glyph; when full, outlines that haven't been used recently are evicted.
+// stbtt_GetGlyphShape, stbtt_GetGlyphShapeInto, and the bitmap and SDF
+// functions all use it, and it's safe to use from several threads at once.
+// Free it with stbtt_FreeFontCaches(). Returns 0 if out of memory or if the
+// budget is too small to be useful.
+
 STBTT_DEF unsigned char *stbtt_FindSVGDoc(const stbtt_fontinfo *info, int gl);
 STBTT_DEF int stbtt_GetCodepointSVG(const stbtt_fontinfo *info, int unicode_codepoint, const char **svg);
 STBTT_DEF int stbtt_GetGlyphSVG(const stbtt_fontinfo *info, int gl, const char **svg);
@@ -1120,12 +1512,73 @@ typedef int stbtt__test_oversample_pow2[(STBTT_MAX_OVERSAMPLE & (STBTT_MAX_OVERS
 #define STBTT_RASTERIZER_VERSION 2
 #endif
 
+// default budget for STBTT_INIT_OUTLINE_CACHE
+#ifndef STBTT_OUTLINE_CACHE_BYTES
+#define STBTT_OUTLINE_CACHE_BYTES  (1 << 20)
+#endif
+
+// how many variable font instances stbtt_SetVariationCoords keeps caches for
+#ifndef STBTT_MAX_VAR_INSTANCES
+#define STBTT_MAX_VAR_INSTANCES  4
+#endif
+
+// how many kerning pairs a sized font remembers; a power of 2
+#ifndef STBTT_SIZED_KERN_CACHE
+#define STBTT_SIZED_KERN_CACHE  1024
+#endif
+
+typedef int stbtt__test_sized_kern_cache_pow2[(STBTT_SIZED_KERN_CACHE & (STBTT_SIZED_KERN_CACHE-1)) == 0 ? 1 : -1];
+
 #ifdef _MSC_VER
 #define STBTT__NOTUSED(v)  (void)(v)
 #else
 #define STBTT__NOTUSED(v)  (void)sizeof(v)
 #endif
 
+// Lazily-computed state in a const stbtt_fontinfo may be filled in by
+// whichever thread gets there first. #define STBTT_NO_THREADS if fonts are
+// never shared between threads.
+#if defined(STBTT_NO_THREADS)
+#define stbtt__atomic_load(p)       (*(p))
+#define stbtt__atomic_store(p,v)    (*(p) = (v))
+#define stbtt__atomic_cas(p,o,n)    (*(p) == (o) ? (*(p) = (n), 1) : 0)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define stbtt__atomic_load(p)       _InterlockedOr((volatile long *) (p), 0)
+#define stbtt__atomic_store(p,v)    _InterlockedExchange((volatile long *) (p), (v))
+#define stbtt__atomic_cas(p,o,n)    (_InterlockedCompareExchange((volatile long *) (p), (n), (o)) == (o))
+#elif defined(__GNUC__) || defined(__clang__)
+#define stbtt__atomic_load(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define stbtt__atomic_store(p,v)    __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define stbtt__atomic_cas(p,o,n)    __sync_bool_compare_and_swap((p), (o), (n))
+#else
+// unknown compiler: not thread-safe
+#define stbtt__atomic_load(p)       (*(p))
+#define stbtt__atomic_store(p,v)    (*(p) = (v))
+#define stbtt__atomic_cas(p,o,n)    (*(p) == (o) ? (*(p) = (n), 1) : 0)
+#endif
+
+// #define STBTT_NO_SIMD to leave out the SSE2 code
+#if !defined(STBTT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define STBTT__SSE2
+#endif
+
+// for functions with big stack buffers, called from recursive ones
+#if defined(_MSC_VER)
+#define STBTT__NOINLINE __declspec(noinline)
+#elif defined(__GNUC__) || defined(__clang__)
+#define STBTT__NOINLINE __attribute__((noinline))
+#else
+#define STBTT__NOINLINE
+#endif
+
+// #define STBTT_COMPUTED_GOTO to dispatch charstring operators through a table
+// of label addresses (a GCC and Clang extension) rather than a switch
+#if defined(STBTT_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define STBTT__COMPUTED_GOTO
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 //
 // stbtt__buf helpers to parse data from file
@@ -1303,17 +1756,85 @@ static int stbtt__isfont(stbtt_uint8 *font)
    return 0;
 }
 
-// @OPTIMIZE: binary search
-static stbtt_uint32 stbtt__find_table(stbtt_uint8 *data, stbtt_uint32 fontstart, const char *tag)
+#define stbtt__tag32(str)  (((stbtt_uint32) (stbtt_uint8) (str)[0] << 24) | ((stbtt_uint32) (stbtt_uint8) (str)[1] << 16) | \
+                            ((stbtt_uint32) (stbtt_uint8) (str)[2] <<  8) |  (stbtt_uint32) (stbtt_uint8) (str)[3])
+
+// linear scan of the table directory in the file; only used before a
+// fontinfo exists, or if the directory was too big to index
+static stbtt_uint32 stbtt__find_table_dir(stbtt_uint8 *data, stbtt_uint32 fontstart, const char *tag, stbtt_uint32 *length)
 {
    stbtt_int32 num_tables = ttUSHORT(data+fontstart+4);
    stbtt_uint32 tabledir = fontstart + 12;
    stbtt_int32 i;
    for (i=0; i < num_tables; ++i) {
       stbtt_uint32 loc = tabledir + 16*i;
-      if (stbtt_tag(data+loc+0, tag))
+      if (stbtt_tag(data+loc+0, tag)) {
+         if (length) *length = ttULONG(data+loc+12);
          return ttULONG(data+loc+8);
+      }
+   }
+   if (length) *length = 0;
+   return 0;
+}
+
+static stbtt_uint32 stbtt__find_table(stbtt_uint8 *data, stbtt_uint32 fontstart, const char *tag)
+{
+   return stbtt__find_table_dir(data, fontstart, tag, NULL);
+}
+
+// copy the table directory into the fontinfo, sorted by tag. The spec requires
+// the directory to be sorted already, but we don't rely on that.
+static int stbtt__index_tables(stbtt_fontinfo *info)
+{
+   stbtt_uint8 *dir = info->data + info->fontstart;
+   stbtt_int32 i, j, n;
+
+   if (info->fontstart < 0 || info->dsize - info->fontstart < 12)
+      return 0;
+   n = ttUSHORT(dir+4);
+   if (n > (info->dsize - info->fontstart - 12) / 16)
+      return 0; // directory runs off the end of the buffer
+   if (n > STBTT_MAX_TABLES) {
+      info->numTables = -1;
+      return 1;
+   }
+
+   for (i=0; i < n; ++i) {
+      stbtt__table t;
+      stbtt_uint8 *rec = dir + 12 + 16*i;
+      t.tag    = ttULONG(rec+0);
+      t.offset = ttULONG(rec+8);
+      t.length = ttULONG(rec+12);
+      // insertion sort; almost always a no-op
+      for (j=i; j > 0 && info->tables[j-1].tag > t.tag; --j)
+         info->tables[j] = info->tables[j-1];
+      info->tables[j] = t;
+   }
+   info->numTables = n;
+   return 1;
+}
+
+static stbtt_uint32 stbtt__get_table(const stbtt_fontinfo *info, const char *tag, stbtt_uint32 *length)
+{
+   stbtt_uint32 needle = stbtt__tag32(tag);
+   stbtt_int32 l = 0, r = info->numTables - 1;
+
+   if (info->numTables < 0)
+      return stbtt__find_table_dir(info->data, info->fontstart, tag, length);
+
+   while (l <= r) {
+      stbtt_int32 m = (l + r) >> 1;
+      stbtt_uint32 straw = info->tables[m].tag;
+      if (needle < straw)
+         r = m - 1;
+      else if (needle > straw)
+         l = m + 1;
+      else {
+         if (length) *length = info->tables[m].length;
+         return info->tables[m].offset;
+      }
    }
+   if (length) *length = 0;
    return 0;
 }
 
@@ -1370,7 +1891,7 @@ static int stbtt__get_svg(stbtt_fontinfo *info)
 {
    stbtt_uint32 t;
    if (info->svg < 0) {
-      t = stbtt__find_table(info->data, info->fontstart, "SVG ");
+      t = stbtt__get_table(info, "SVG ", NULL);
       if (t) {
          stbtt_uint32 offset = ttULONG(info->data + t + 2);
          info->svg = t + offset;
@@ -1381,262 +1902,2658 @@ static int stbtt__get_svg(stbtt_fontinfo *info)
    return info->svg;
 }
 
-static int stbtt_InitFont_internal(stbtt_fontinfo *info, unsigned char *data, long dsize, int fontstart)
-{
-   stbtt_uint32 cmap, t;
-   stbtt_int32 i,numTables;
+enum {
+   STBTT__CFF_PENDING,
+   STBTT__CFF_PARSING,
+   STBTT__CFF_READY,
+   STBTT__CFF_FAILED
+};
 
-   info->data = data;
-   info->dsize = dsize;
-   info->fontstart = fontstart;
-   info->cff = stbtt__new_buf(NULL, 0);
+// parse the CFF header and the INDEXes needed to run charstrings
+static int stbtt__parse_cff(stbtt_fontinfo *info)
+{
+   stbtt__buf b, topdict, topdictidx;
+   stbtt_uint32 cstype = 2, charstrings = 0, fdarrayoff = 0, fdselectoff = 0;
+
+   info->fontdicts = stbtt__new_buf(NULL, 0);
+   info->fdselect = stbtt__new_buf(NULL, 0);
+   b = info->cff;
+
+   // read the header
+   stbtt__buf_skip(&b, 2);
+   stbtt__buf_seek(&b, stbtt__buf_get8(&b)); // hdrsize
+
+   // @TODO the name INDEX could list multiple fonts,
+   // but we just use the first one.
+   stbtt__cff_get_index(&b);  // name INDEX
+   topdictidx = stbtt__cff_get_index(&b);
+   topdict = stbtt__cff_index_get(topdictidx, 0);
+   stbtt__cff_get_index(&b);  // string INDEX
+   info->gsubrs = stbtt__cff_get_index(&b);
+
+   stbtt__dict_get_ints(&topdict, 17, 1, &charstrings);
+   stbtt__dict_get_ints(&topdict, 0x100 | 6, 1, &cstype);
+   stbtt__dict_get_ints(&topdict, 0x100 | 36, 1, &fdarrayoff);
+   stbtt__dict_get_ints(&topdict, 0x100 | 37, 1, &fdselectoff);
+   info->subrs = stbtt__get_subrs(b, topdict);
+
+   // we only support Type 2 charstrings
+   if (cstype != 2) return 0;
+   if (charstrings == 0) return 0;
+
+   if (fdarrayoff) {
+      // looks like a CID font
+      if (!fdselectoff) return 0;
+      stbtt__buf_seek(&b, fdarrayoff);
+      info->fontdicts = stbtt__cff_get_index(&b);
+      info->fdselect = stbtt__buf_range(&b, fdselectoff, b.size-fdselectoff);
+   }
 
-   cmap = stbtt__find_table(data, fontstart, "cmap");       // required
-   info->loca = stbtt__find_table(data, fontstart, "loca"); // required
-   info->head = stbtt__find_table(data, fontstart, "head"); // required
-   info->glyf = stbtt__find_table(data, fontstart, "glyf"); // required
-   info->hhea = stbtt__find_table(data, fontstart, "hhea"); // required
-   info->hmtx = stbtt__find_table(data, fontstart, "hmtx"); // required
-   info->kern = stbtt__find_table(data, fontstart, "kern"); // not required
-   info->gpos = stbtt__find_table(data, fontstart, "GPOS"); // not required
+   stbtt__buf_seek(&b, charstrings);
+   info->charstrings = stbtt__cff_get_index(&b);
+   return 1;
+}
 
-   if (!cmap || !info->head || !info->hhea || !info->hmtx)
-      return 0;
-   if (info->glyf) {
-      // required for truetype
-      if (!info->loca) return 0;
-   } else {
-      // initialization for CFF / Type2 fonts (OTF)
-      stbtt__buf b, topdict, topdictidx;
-      stbtt_uint32 cstype = 2, charstrings = 0, fdarrayoff = 0, fdselectoff = 0;
-      stbtt_uint32 cff;
+// make sure the CFF indexes are parsed; returns 0 if they're unusable
+static int stbtt__cff_resolve(const stbtt_fontinfo *info)
+{
+   stbtt_fontinfo *mutable_info = (stbtt_fontinfo *) info;
+   int state = stbtt__atomic_load(&mutable_info->cff_state);
+   if (state == STBTT__CFF_READY)
+      return 1;
+   if (state == STBTT__CFF_PENDING && stbtt__atomic_cas(&mutable_info->cff_state, STBTT__CFF_PENDING, STBTT__CFF_PARSING)) {
+      state = stbtt__parse_cff(mutable_info) ? STBTT__CFF_READY : STBTT__CFF_FAILED;
+      stbtt__atomic_store(&mutable_info->cff_state, state);
+      return state == STBTT__CFF_READY;
+   }
+   // another thread is parsing; it only takes a moment
+   while ((state = stbtt__atomic_load(&mutable_info->cff_state)) == STBTT__CFF_PARSING)
+      ;
+   return state == STBTT__CFF_READY;
+}
 
-      cff = stbtt__find_table(data, fontstart, "CFF ");
-      if (!cff) return 0;
+//////////////////////////////////////////////////////////////////////////
+//
+// structural validation, see stbtt_ValidateFont
+//
 
-      info->fontdicts = stbtt__new_buf(NULL, 0);
-      info->fdselect = stbtt__new_buf(NULL, 0);
-
-      // @TODO this should use size from table (not 512MB)
-      info->cff = stbtt__new_buf(data+cff, 512*1024*1024);
-      b = info->cff;
-
-      // read the header
-      stbtt__buf_skip(&b, 2);
-      stbtt__buf_seek(&b, stbtt__buf_get8(&b)); // hdrsize
-
-      // @TODO the name INDEX could list multiple fonts,
-      // but we just use the first one.
-      stbtt__cff_get_index(&b);  // name INDEX
-      topdictidx = stbtt__cff_get_index(&b);
-      topdict = stbtt__cff_index_get(topdictidx, 0);
-      stbtt__cff_get_index(&b);  // string INDEX
-      info->gsubrs = stbtt__cff_get_index(&b);
-
-      stbtt__dict_get_ints(&topdict, 17, 1, &charstrings);
-      stbtt__dict_get_ints(&topdict, 0x100 | 6, 1, &cstype);
-      stbtt__dict_get_ints(&topdict, 0x100 | 36, 1, &fdarrayoff);
-      stbtt__dict_get_ints(&topdict, 0x100 | 37, 1, &fdselectoff);
-      info->subrs = stbtt__get_subrs(b, topdict);
-
-      // we only support Type 2 charstrings
-      if (cstype != 2) return 0;
-      if (charstrings == 0) return 0;
-
-      if (fdarrayoff) {
-         // looks like a CID font
-         if (!fdselectoff) return 0;
-         stbtt__buf_seek(&b, fdarrayoff);
-         info->fontdicts = stbtt__cff_get_index(&b);
-         info->fdselect = stbtt__buf_range(&b, fdselectoff, b.size-fdselectoff);
-      }
+// compound glyphs may nest this deep
+#ifndef STBTT_MAX_COMPOUND_DEPTH
+#define STBTT_MAX_COMPOUND_DEPTH 16
+#endif
 
-      stbtt__buf_seek(&b, charstrings);
-      info->charstrings = stbtt__cff_get_index(&b);
-   }
+// glyphs needing more vertices than this are treated as empty
+#define STBTT__MAX_SHAPE_VERTICES  (1 << 24)
 
-   t = stbtt__find_table(data, fontstart, "maxp");
-   if (t)
-      info->numGlyphs = ttUSHORT(data+t+4);
-   else
-      info->numGlyphs = 0xffff;
+// and so are glyphs made of more components than this, counting those in
+// nested compound glyphs each time they're used
+#define STBTT__MAX_SHAPE_COMPONENTS  (1 << 16)
 
-   info->svg = -1;
+// the range [off, off+size) lies inside [0, limit)
+#define stbtt__fits(off,size,limit)  ((stbtt_uint32) (off) <= (stbtt_uint32) (limit) && (stbtt_uint32) (size) <= (stbtt_uint32) (limit) - (stbtt_uint32) (off))
 
-   // find a cmap encoding table we understand *now* to avoid searching
-   // later. (todo: could make this installable)
-   // the same regardless of glyph.
-   numTables = ttUSHORT(data + cmap + 2);
-   info->index_map = 0;
-   for (i=0; i < numTables; ++i) {
-      stbtt_uint32 encoding_record = cmap + 4 + 8 * i;
-      // find an encoding we understand:
-      switch(ttUSHORT(data+encoding_record)) {
-         case STBTT_PLATFORM_ID_MICROSOFT:
-            switch (ttUSHORT(data+encoding_record+2)) {
-               case STBTT_MS_EID_UNICODE_BMP:
-               case STBTT_MS_EID_UNICODE_FULL:
-                  // MS/Unicode
-                  info->index_map = cmap + ttULONG(data+encoding_record+4);
-                  break;
-            }
-            break;
-        case STBTT_PLATFORM_ID_UNICODE:
-            // Mac/iOS has these
-            // all the encodingIDs are unicode, so we don't bother to check it
-            info->index_map = cmap + ttULONG(data+encoding_record+4);
-            break;
-      }
-   }
-   if (info->index_map == 0)
-      return 0;
+// every table is inside the buffer, and the tables read by
+// stbtt_InitFont are big enough
+static int stbtt__validate_tables(const stbtt_fontinfo *info)
+{
+   stbtt_uint8 *dir = info->data + info->fontstart;
+   stbtt_uint32 len, t;
+   stbtt_int32 i, n = ttUSHORT(dir+4);
 
-   info->indexToLocFormat = ttUSHORT(data+info->head + 50);
+   for (i=0; i < n; ++i)
+      if (!stbtt__fits(ttULONG(dir+12+16*i+8), ttULONG(dir+12+16*i+12), info->dsize))
+         return 0;
+
+   if (!stbtt__get_table(info, "head", &len) || len < 54) return 0;
+   if (!stbtt__get_table(info, "hhea", &len) || len < 36) return 0;
+   if (!stbtt__get_table(info, "maxp", &len) || len < 6)  return 0;
+   t = stbtt__get_table(info, "cmap", &len);
+   if (!t || len < 4 || (len - 4) / 8 < ttUSHORT(info->data + t + 2)) return 0;
    return 1;
 }
 
-STBTT_DEF int stbtt_FindGlyphIndex(const stbtt_fontinfo *info, int unicode_codepoint)
+static int stbtt__validate_hmtx(const stbtt_fontinfo *info)
 {
-   stbtt_uint8 *data = info->data;
-   stbtt_uint32 index_map = info->index_map;
+   stbtt_uint32 len, n = info->numGlyphs;
+   stbtt_uint32 long_metrics = ttUSHORT(info->data + info->hhea + 34);
 
-   stbtt_uint16 format = ttUSHORT(data + index_map + 0);
-   if (format == 0) { // apple byte encoding
-      stbtt_int32 bytes = ttUSHORT(data + index_map + 2);
-      if (unicode_codepoint < bytes-6)
-         return ttBYTE(data + index_map + 6 + unicode_codepoint);
+   stbtt__get_table(info, "hmtx", &len);
+   if (long_metrics == 0 || len / 4 < long_metrics)
       return 0;
-   } else if (format == 6) {
-      stbtt_uint32 first = ttUSHORT(data + index_map + 6);
-      stbtt_uint32 count = ttUSHORT(data + index_map + 8);
-      if ((stbtt_uint32) unicode_codepoint >= first && (stbtt_uint32) unicode_codepoint < first+count)
-         return ttUSHORT(data + index_map + 10 + (unicode_codepoint - first)*2);
+   // glyphs after the last long metric only have a left side bearing
+   if (n > long_metrics && (len - 4*long_metrics) / 2 < n - long_metrics)
       return 0;
-   } else if (format == 2) {
-      STBTT_assert(0); // @TODO: high-byte mapping for japanese/chinese/korean
+   return 1;
+}
+
+static int stbtt__validate_cmap4(stbtt_uint8 *data, stbtt_uint32 index_map, stbtt_uint32 avail)
+{
+   stbtt_uint32 segcount2, searchRange, entrySelector, rangeShift, i, prev_end = 0;
+
+   if (avail < 16)
+      return 0;
+   segcount2     = ttUSHORT(data + index_map + 6);
+   searchRange   = ttUSHORT(data + index_map + 8);
+   entrySelector = ttUSHORT(data + index_map + 10);
+   rangeShift    = ttUSHORT(data + index_map + 12);
+   if (segcount2 == 0 || (segcount2 & 1) || (avail - 16) / 4 < segcount2)
       return 0;
-   } else if (format == 4) { // standard mapping for windows fonts: binary search collection of ranges
-      stbtt_uint16 segcount = ttUSHORT(data+index_map+6) >> 1;
-      stbtt_uint16 searchRange = ttUSHORT(data+index_map+8) >> 1;
-      stbtt_uint16 entrySelector = ttUSHORT(data+index_map+10);
-      stbtt_uint16 rangeShift = ttUSHORT(data+index_map+12) >> 1;
 
-      // do a binary search of the segments
-      stbtt_uint32 endCount = index_map + 14;
-      stbtt_uint32 search = endCount;
+   // the binary search in stbtt_FindGlyphIndex trusts these
+   if (entrySelector > 15 || searchRange != (2u << entrySelector) || searchRange > segcount2 || rangeShift != segcount2 - searchRange)
+      return 0;
 
-      if (unicode_codepoint > 0xffff)
+   for (i=0; i < segcount2; i += 2) {
+      stbtt_uint32 end    = ttUSHORT(data + index_map + 14 + i);
+      stbtt_uint32 start  = ttUSHORT(data + index_map + 16 + segcount2 + i);
+      stbtt_uint32 offset = ttUSHORT(data + index_map + 16 + segcount2*3 + i);
+      if (start > end || (i && end <= prev_end))
          return 0;
+      if (offset && !stbtt__fits(16 + segcount2*3 + i + offset, (end - start + 1) * 2, avail))
+         return 0;
+      prev_end = end;
+   }
+   return 1;
+}
 
-      // they lie from endCount .. endCount + segCount
-      // but searchRange is the nearest power of two, so...
-      if (unicode_codepoint >= ttUSHORT(data + search + rangeShift*2))
-         search += rangeShift*2;
-
-      // now decrement to bias correctly to find smallest
-      search -= 2;
-      while (entrySelector) {
-         stbtt_uint16 end;
-         searchRange >>= 1;
-         end = ttUSHORT(data + search + searchRange*2);
-         if (unicode_codepoint > end)
-            search += searchRange*2;
-         --entrySelector;
-      }
-      search += 2;
-
-      {
-         stbtt_uint16 offset, start, last;
-         stbtt_uint16 item = (stbtt_uint16) ((search - endCount) >> 1);
+static int stbtt__validate_cmap(const stbtt_fontinfo *info)
+{
+   stbtt_uint8 *data = info->data;
+   stbtt_uint32 cmap_len, cmap = stbtt__get_table(info, "cmap", &cmap_len);
+   stbtt_uint32 index_map = info->index_map, avail, i, n, prev_end = 0;
 
-         start = ttUSHORT(data + index_map + 14 + segcount*2 + 2 + 2*item);
-         last = ttUSHORT(data + endCount + 2*item);
-         if (unicode_codepoint < start || unicode_codepoint > last)
+   if (!stbtt__fits(index_map - cmap, 4, cmap_len))
+      return 0;
+   avail = cmap + cmap_len - index_map;
+
+   switch (ttUSHORT(data + index_map)) {
+      case 0:
+         n = ttUSHORT(data + index_map + 2);
+         return n >= 6 && n <= avail;
+      case 6:
+         return avail >= 10 && (avail - 10) / 2 >= ttUSHORT(data + index_map + 8);
+      case 4:
+         return stbtt__validate_cmap4(data, index_map, avail);
+      case 12:
+      case 13:
+         if (avail < 16)
             return 0;
-
-         offset = ttUSHORT(data + index_map + 14 + segcount*6 + 2 + 2*item);
-         if (offset == 0)
-            return (stbtt_uint16) (unicode_codepoint + ttSHORT(data + index_map + 14 + segcount*4 + 2 + 2*item));
-
-         return ttUSHORT(data + offset + (unicode_codepoint-start)*2 + index_map + 14 + segcount*6 + 2 + 2*item);
-      }
-   } else if (format == 12 || format == 13) {
-      stbtt_uint32 ngroups = ttULONG(data+index_map+12);
-      stbtt_int32 low,high;
-      low = 0; high = (stbtt_int32)ngroups;
-      // Binary search the right group.
-      while (low < high) {
-         stbtt_int32 mid = low + ((high-low) >> 1); // rounds down, so low <= mid < high
-         stbtt_uint32 start_char = ttULONG(data+index_map+16+mid*12);
-         stbtt_uint32 end_char = ttULONG(data+index_map+16+mid*12+4);
-         if ((stbtt_uint32) unicode_codepoint < start_char)
-            high = mid;
-         else if ((stbtt_uint32) unicode_codepoint > end_char)
-            low = mid+1;
-         else {
-            stbtt_uint32 start_glyph = ttULONG(data+index_map+16+mid*12+8);
-            if (format == 12)
-               return start_glyph + unicode_codepoint-start_char;
-            else // format == 13
-               return start_glyph;
+         n = ttULONG(data + index_map + 12);
+         if ((avail - 16) / 12 < n)
+            return 0;
+         // groups must be sorted for the binary search
+         for (i=0; i < n; ++i) {
+            stbtt_uint32 start_char = ttULONG(data + index_map + 16 + i*12);
+            stbtt_uint32 end_char   = ttULONG(data + index_map + 16 + i*12 + 4);
+            if (start_char > end_char || (i && start_char <= prev_end))
+               return 0;
+            prev_end = end_char;
          }
-      }
-      return 0; // not found
+         return 1;
+      default:
+         return 0; // not supported by stbtt_FindGlyphIndex
    }
-   // @TODO
-   STBTT_assert(0);
-   return 0;
-}
-
-STBTT_DEF int stbtt_GetCodepointShape(const stbtt_fontinfo *info, int unicode_codepoint, stbtt_vertex **vertices)
-{
-   return stbtt_GetGlyphShape(info, stbtt_FindGlyphIndex(info, unicode_codepoint), vertices);
 }
 
-static void stbtt_setvertex(stbtt_vertex *v, stbtt_uint8 type, stbtt_int32 x, stbtt_int32 y, stbtt_int32 cx, stbtt_int32 cy)
+static stbtt_uint32 stbtt__loca_entry(const stbtt_fontinfo *info, int glyph_index)
 {
-   v->type = type;
-   v->x = (stbtt_int16) x;
-   v->y = (stbtt_int16) y;
-   v->cx = (stbtt_int16) cx;
-   v->cy = (stbtt_int16) cy;
+   if (info->indexToLocFormat == 0)
+      return ttUSHORT(info->data + info->loca + glyph_index * 2) * 2;
+   return ttULONG(info->data + info->loca + glyph_index * 4);
 }
 
-static int stbtt__GetGlyfOffset(const stbtt_fontinfo *info, int glyph_index)
+// Checks one glyph's outline data, and recursively the glyphs it refers to.
+// Returns 1 + the compound nesting depth of the glyph, or 0 if it's bad;
+// height[] remembers the result for glyphs already checked.
+static int stbtt__validate_glyph(const stbtt_fontinfo *info, int glyph_index, stbtt_uint8 *height, int depth)
 {
-   int g1,g2;
-
-   STBTT_assert(!info->cff.size);
+   stbtt_uint32 start = stbtt__loca_entry(info, glyph_index);
+   stbtt_uint32 len = stbtt__loca_entry(info, glyph_index+1) - start;
+   stbtt_uint8 *g = info->data + info->glyf + start;
+   stbtt_int32 numberOfContours, h = 1;
 
-   if (glyph_index >= info->numGlyphs) return -1; // glyph index out of range
-   if (info->indexToLocFormat >= 2)    return -1; // unknown index->glyph map format
+   if (height[glyph_index] == 0xff || depth > STBTT_MAX_COMPOUND_DEPTH)
+      return 0; // refers to itself, or nested too deep
+   if (height[glyph_index])
+      return height[glyph_index];
+   if (len == 0)
+      return height[glyph_index] = 1;
+   if (len < 10 || ttSHORT(g+2) > ttSHORT(g+6) || ttSHORT(g+4) > ttSHORT(g+8))
+      return 0; // too short, or the bounding box is inside out
+   height[glyph_index] = 0xff;
 
-   if (info->indexToLocFormat == 0) {
-      g1 = info->glyf + ttUSHORT(info->data + info->loca + glyph_index * 2) * 2;
-      g2 = info->glyf + ttUSHORT(info->data + info->loca + glyph_index * 2 + 2) * 2;
-   } else {
-      g1 = info->glyf + ttULONG (info->data + info->loca + glyph_index * 4);
+   numberOfContours = ttSHORT(g);
+   if (numberOfContours > 0) {
+      stbtt_uint32 p, i, n, ins, xbytes = 0, ybytes = 0, prev = 0;
+      stbtt_int32 j;
+      stbtt_uint8 flags = 0;
+      if (len < 12 || (len - 12) / 2 < (stbtt_uint32) numberOfContours)
+         return 0;
+      for (j=0; j < numberOfContours; ++j) {
+         stbtt_uint32 end = ttUSHORT(g + 10 + j*2);
+         if (j && end <= prev)
+            return 0;
+         prev = end;
+      }
+      n = prev + 1;
+      p = 12 + numberOfContours*2;
+      ins = ttUSHORT(g + p - 2);
+      if (len - p < ins)
+         return 0;
+      p += ins;
+      for (i=0; i < n; ) {
+         stbtt_uint32 repeat = 1;
+         if (p >= len)
+            return 0;
+         flags = g[p++];
+         if (flags & 8) {
+            if (p >= len)
+               return 0;
+            repeat += g[p++];
+         }
+         if (repeat > n - i)
+            repeat = n - i;
+         xbytes += repeat * ((flags & 2) ? 1 : (flags & 16) ? 0 : 2);
+         ybytes += repeat * ((flags & 4) ? 1 : (flags & 32) ? 0 : 2);
+         i += repeat;
+      }
+      if (len - p < xbytes + ybytes)
+         return 0;
+      // the outline decoder reads one point past a contour that starts
+      // off-curve, which overruns if it's a single point at the end
+      if (!(flags & 1) && (numberOfContours == 1 ? n == 1 : ttUSHORT(g + 10 + numberOfContours*2 - 4) + 2u == n))
+         return 0;
+   } else if (numberOfContours < 0) {
+      stbtt_uint32 p = 10, more = 1;
+      while (more) {
+         stbtt_uint32 flags, gidx, size;
+         stbtt_int32 sub;
+         if (len - p < 4)
+            return 0;
+         flags = ttUSHORT(g + p);
+         gidx  = ttUSHORT(g + p + 2);
+         p += 4;
+         if (!(flags & 2))
+            return 0; // point matching isn't supported
+         size = (flags & 1) ? 4 : 2;
+         if (flags & (1<<3))      size += 2;
+         else if (flags & (1<<6)) size += 4;
+         else if (flags & (1<<7)) size += 8;
+         if (len - p < size)
+            return 0;
+         p += size;
+         if (gidx >= (stbtt_uint32) info->numGlyphs)
+            return 0;
+         sub = stbtt__validate_glyph(info, gidx, height, depth+1);
+         if (!sub)
+            return 0;
+         if (sub + 1 > h)
+            h = sub + 1;
+         more = flags & (1<<5);
+      }
+   }
+   return height[glyph_index] = (stbtt_uint8) h;
+}
+
+static int stbtt__validate_glyf(const stbtt_fontinfo *info)
+{
+   stbtt_uint32 loca_len, glyf_len, prev = 0, off;
+   stbtt_uint8 *height;
+   int i, ok = 1, n = info->numGlyphs;
+
+   stbtt__get_table(info, "loca", &loca_len);
+   stbtt__get_table(info, "glyf", &glyf_len);
+   if (info->indexToLocFormat > 1 || loca_len / (info->indexToLocFormat ? 4 : 2) < (stbtt_uint32) n + 1)
+      return 0;
+   for (i=0; i <= n; ++i) {
+      off = stbtt__loca_entry(info, i);
+      if (off < prev || off > glyf_len)
+         return 0;
+      prev = off;
+   }
+
+   height = (stbtt_uint8 *) STBTT_malloc(n + 1, info->userdata);
+   if (height == NULL)
+      return 0;
+   STBTT_memset(height, 0, n + 1);
+   for (i=0; i < n && ok; ++i)
+      ok = stbtt__validate_glyph(info, i, height, 0) != 0;
+   STBTT_free(height, info->userdata);
+   return ok;
+}
+
+static int stbtt__cff_index_valid(stbtt__buf b)
+{
+   stbtt_uint32 count, offsize, i, o, prev = 1;
+   if (b.size == 0)
+      return 1; // absent
+   if (b.size < 2)
+      return 0;
+   count = stbtt__buf_get16(&b);
+   if (count == 0)
+      return 1;
+   offsize = stbtt__buf_get8(&b);
+   if (offsize < 1 || offsize > 4 || b.size < 3 || (b.size - 3) / offsize < count + 1)
+      return 0;
+   for (i=0; i <= count; ++i) {
+      o = stbtt__buf_get(&b, offsize);
+      if (i == 0 ? o != 1 : o < prev)
+         return 0;
+      prev = o;
+   }
+   return prev - 1 <= (stbtt_uint32) b.size - 3 - (count+1) * offsize;
+}
+
+// reads the INDEX at the cursor like stbtt__cff_get_index, but fails
+// instead of asserting if it's malformed or runs off the end
+static int stbtt__cff_skip_index(stbtt__buf *b)
+{
+   stbtt_uint32 count, offsize, last;
+   int start = b->cursor;
+   if (b->size - b->cursor < 2)
+      return 0;
+   count = stbtt__buf_get16(b);
+   if (count == 0)
+      return 1;
+   offsize = stbtt__buf_get8(b);
+   if (offsize < 1 || offsize > 4 || (stbtt_uint32) (b->size - b->cursor) / offsize < count + 1)
+      return 0;
+   stbtt__buf_skip(b, offsize * count);
+   last = stbtt__buf_get(b, offsize);
+   if (last < 1 || last - 1 > (stbtt_uint32) (b->size - b->cursor))
+      return 0;
+   stbtt__buf_skip(b, last - 1);
+   return stbtt__cff_index_valid(stbtt__buf_range(b, start, b->cursor - start));
+}
+
+// every operand in the dict can be skipped, and the operators read with
+// stbtt__dict_get_ints have only integer operands
+static int stbtt__cff_dict_valid(stbtt__buf b)
+{
+   int b0, op, real;
+   while (b.cursor < b.size) {
+      real = 0;
+      while ((b0 = stbtt__buf_peek8(&b)) >= 28) {
+         if (b0 == 31 || b0 == 255)
+            return 0;
+         real |= b0 == 30;
+         stbtt__cff_skip_operand(&b);
+      }
+      op = stbtt__buf_get8(&b);
+      if (op == 12)  op = stbtt__buf_get8(&b) | 0x100;
+      if (real && (op == 17 || op == 18 || op == 19 || op == (0x100|6) || op == (0x100|36) || op == (0x100|37)))
+         return 0;
+   }
+   return 1;
+}
+
+// stbtt__get_subrs can read the private dict and subrs of fontdict
+static int stbtt__cff_subrs_valid(stbtt__buf cff, stbtt__buf fontdict)
+{
+   stbtt_uint32 subrsoff = 0, private_loc[2] = { 0, 0 };
+   stbtt__buf pdict;
+   if (!stbtt__cff_dict_valid(fontdict))
+      return 0;
+   stbtt__dict_get_ints(&fontdict, 18, 2, private_loc);
+   if (!private_loc[1] || !private_loc[0])
+      return 1;
+   pdict = stbtt__buf_range(&cff, private_loc[1], private_loc[0]);
+   if (!stbtt__cff_dict_valid(pdict))
+      return 0;
+   stbtt__dict_get_ints(&pdict, 19, 1, &subrsoff);
+   if (!subrsoff)
+      return 1;
+   if (!stbtt__fits(private_loc[1], subrsoff, cff.size))
+      return 0;
+   stbtt__buf_seek(&cff, private_loc[1]+subrsoff);
+   return stbtt__cff_skip_index(&cff);
+}
+
+// stbtt__parse_cff can run on this font without tripping its asserts
+static int stbtt__validate_cff_header(const stbtt_fontinfo *info)
+{
+   stbtt__buf b = info->cff, topdictidx, topdict;
+   stbtt_uint32 charstrings = 0, fdarrayoff = 0;
+   int start;
+
+   if (b.size < 4 || b.data[2] > b.size)
+      return 0;
+   stbtt__buf_seek(&b, b.data[2]); // hdrsize
+   if (!stbtt__cff_skip_index(&b))  // name INDEX
+      return 0;
+   start = b.cursor;
+   if (!stbtt__cff_skip_index(&b))
+      return 0;
+   topdictidx = stbtt__buf_range(&b, start, b.cursor - start);
+   if (stbtt__cff_index_count(&topdictidx) < 1)
+      return 0;
+   topdict = stbtt__cff_index_get(topdictidx, 0);
+   if (!stbtt__cff_dict_valid(topdict))
+      return 0;
+   if (!stbtt__cff_skip_index(&b) || !stbtt__cff_skip_index(&b)) // string INDEX, gsubrs
+      return 0;
+   if (!stbtt__cff_subrs_valid(info->cff, topdict))
+      return 0;
+
+   stbtt__dict_get_ints(&topdict, 17, 1, &charstrings);
+   stbtt__dict_get_ints(&topdict, 0x100 | 36, 1, &fdarrayoff);
+   if (charstrings) {
+      if (charstrings > (stbtt_uint32) b.size)
+         return 0;
+      stbtt__buf_seek(&b, charstrings);
+      if (!stbtt__cff_skip_index(&b))
+         return 0;
+   }
+   if (fdarrayoff) {
+      if (fdarrayoff > (stbtt_uint32) b.size)
+         return 0;
+      stbtt__buf_seek(&b, fdarrayoff);
+      if (!stbtt__cff_skip_index(&b))
+         return 0;
+   }
+   return 1;
+}
+
+static int stbtt__validate_cff(const stbtt_fontinfo *info)
+{
+   stbtt__buf b, fdselect;
+   int i, n = info->numGlyphs, num_fds;
+
+   if (!stbtt__validate_cff_header(info) || !stbtt__cff_resolve(info))
+      return 0;
+   fdselect = info->fdselect; // only valid once resolved
+   b = info->charstrings;
+   if (!stbtt__cff_index_valid(b) || b.size == 0 || stbtt__cff_index_count(&b) < n)
+      return 0;
+   if (!stbtt__cff_index_valid(info->gsubrs) || !stbtt__cff_index_valid(info->subrs))
+      return 0;
+   if (fdselect.size == 0)
+      return 1;
+
+   // CID font: check each font dict's subrs, and that FDSelect covers
+   // every glyph with a font dict that exists
+   b = info->fontdicts;
+   if (!stbtt__cff_index_valid(b) || b.size == 0)
+      return 0;
+   num_fds = stbtt__cff_index_count(&b);
+   for (i=0; i < num_fds; ++i)
+      if (!stbtt__cff_subrs_valid(info->cff, stbtt__cff_index_get(info->fontdicts, i)))
+         return 0;
+
+   stbtt__buf_seek(&fdselect, 0);
+   switch (stbtt__buf_get8(&fdselect)) {
+      case 0:
+         if (fdselect.size - 1 < n)
+            return 0;
+         for (i=0; i < n; ++i)
+            if (stbtt__buf_get8(&fdselect) >= num_fds)
+               return 0;
+         return 1;
+      case 3: {
+         int nranges, start, end;
+         if (fdselect.size < 5)
+            return 0;
+         nranges = stbtt__buf_get16(&fdselect);
+         if ((fdselect.size - 5) / 3 < nranges)
+            return 0;
+         start = stbtt__buf_get16(&fdselect);
+         if (start != 0)
+            return 0;
+         for (i=0; i < nranges; ++i) {
+            if (stbtt__buf_get8(&fdselect) >= num_fds)
+               return 0;
+            end = stbtt__buf_get16(&fdselect);
+            if (end < start)
+               return 0;
+            start = end;
+         }
+         return start >= n;
+      }
+      default:
+         return 0;
+   }
+}
+
+static int stbtt__validate_kern(const stbtt_fontinfo *info)
+{
+   stbtt_uint32 len;
+   stbtt_uint8 *data = info->data + info->kern;
+   if (!info->kern)
+      return 1;
+   stbtt__get_table(info, "kern", &len);
+   if (len < 4)
+      return 0;
+   if (ttUSHORT(data+2) < 1)
+      return 1; // ignored by the kerning code
+   return len >= 18 && (ttUSHORT(data+8) != 1 || (len - 18) / 6 >= ttUSHORT(data+10));
+}
+
+// Returns the number of glyphs covered (or an upper bound), or -1 if bad.
+static stbtt_int32 stbtt__validate_coverage(stbtt_uint8 *t, stbtt_uint32 avail)
+{
+   stbtt_uint32 count, i, covered = 0;
+   if (avail < 4)
+      return -1;
+   count = ttUSHORT(t + 2);
+   switch (ttUSHORT(t)) {
+      case 1:
+         return (avail - 4) / 2 >= count ? (stbtt_int32) count : -1;
+      case 2:
+         if ((avail - 4) / 6 < count)
+            return -1;
+         for (i=0; i < count; ++i) {
+            stbtt_uint8 *r = t + 4 + 6*i;
+            stbtt_uint32 start = ttUSHORT(r), end = ttUSHORT(r+2);
+            if (end >= start && ttUSHORT(r+4) + end - start + 1 > covered)
+               covered = ttUSHORT(r+4) + end - start + 1;
+         }
+         return (stbtt_int32) covered;
+      default:
+         return 0; // ignored by the kerning code
+   }
+}
+
+static int stbtt__validate_classdef(stbtt_uint8 *t, stbtt_uint32 avail)
+{
+   if (avail < 4)
+      return 0;
+   switch (ttUSHORT(t)) {
+      case 1:  return avail >= 6 && (avail - 6) / 2 >= ttUSHORT(t + 4);
+      case 2:  return (avail - 4) / 6 >= ttUSHORT(t + 2);
+      default: return 1; // ignored by the kerning code
+   }
+}
+
+static stbtt_uint32 stbtt__value_record_size(stbtt_uint32 format)
+{
+   stbtt_uint32 size = 0;
+   for (; format; format >>= 1)
+      size += (format & 1) * 2;
+   return size;
+}
+
+static int stbtt__validate_pairpos(stbtt_uint8 *t, stbtt_uint32 avail)
+{
+   stbtt_uint32 coverage, rec, i;
+   stbtt_int32 covered;
+   if (avail < 8)
+      return 0;
+   coverage = ttUSHORT(t + 2);
+   if (coverage > avail)
+      return 0;
+   covered = stbtt__validate_coverage(t + coverage, avail - coverage);
+   if (covered < 0)
+      return 0;
+   rec = stbtt__value_record_size(ttUSHORT(t + 4)) + stbtt__value_record_size(ttUSHORT(t + 6));
+
+   switch (ttUSHORT(t)) {
+      case 1: {
+         stbtt_uint32 count;
+         if (avail < 10)
+            return 0;
+         count = ttUSHORT(t + 8);
+         if ((avail - 10) / 2 < count || (stbtt_uint32) covered > count)
+            return 0;
+         for (i=0; i < count; ++i) {
+            stbtt_uint32 set = ttUSHORT(t + 10 + 2*i);
+            if (!stbtt__fits(set, 2, avail) || (avail - set - 2) / (2 + rec) < ttUSHORT(t + set))
+               return 0;
+         }
+         return 1;
+      }
+      case 2: {
+         stbtt_uint32 cd1, cd2, c1, c2;
+         if (avail < 16)
+            return 0;
+         cd1 = ttUSHORT(t + 8);
+         cd2 = ttUSHORT(t + 10);
+         c1 = ttUSHORT(t + 12);
+         c2 = ttUSHORT(t + 14);
+         if (cd1 > avail || !stbtt__validate_classdef(t + cd1, avail - cd1))
+            return 0;
+         if (cd2 > avail || !stbtt__validate_classdef(t + cd2, avail - cd2))
+            return 0;
+         return rec == 0 || c2 == 0 || (avail - 16) / rec / c2 >= c1;
+      }
+      default:
+         return 1; // ignored by the kerning code
+   }
+}
+
+static int stbtt__validate_gpos(const stbtt_fontinfo *info)
+{
+   stbtt_uint32 len, list, count, i, j;
+   stbtt_uint8 *data = info->data + info->gpos;
+   if (!info->gpos)
+      return 1;
+   stbtt__get_table(info, "GPOS", &len);
+   if (len < 10)
+      return 0;
+   if (ttUSHORT(data+0) != 1 || ttUSHORT(data+2) != 0)
+      return 1; // ignored by the kerning code
+
+   list = ttUSHORT(data+8);
+   if (!stbtt__fits(list, 2, len))
+      return 0;
+   count = ttUSHORT(data + list);
+   if ((len - list - 2) / 2 < count)
+      return 0;
+   for (i=0; i < count; ++i) {
+      stbtt_uint32 lookup = list + ttUSHORT(data + list + 2 + 2*i), subtables;
+      if (!stbtt__fits(lookup, 6, len))
+         return 0;
+      if (ttUSHORT(data + lookup) != 2)
+         continue; // only pair adjustments are read
+      subtables = ttUSHORT(data + lookup + 4);
+      if ((len - lookup - 6) / 2 < subtables)
+         return 0;
+      for (j=0; j < subtables; ++j) {
+         stbtt_uint32 sub = lookup + ttUSHORT(data + lookup + 6 + 2*j);
+         if (sub > len || !stbtt__validate_pairpos(data + sub, len - sub))
+            return 0;
+      }
+   }
+   return 1;
+}
+
+STBTT_DEF int stbtt_ValidateFont(stbtt_fontinfo *info)
+{
+   info->validated = stbtt__validate_tables(info)
+                  && stbtt__validate_hmtx(info)
+                  && stbtt__validate_cmap(info)
+                  && (info->cff.size ? stbtt__validate_cff(info) : stbtt__validate_glyf(info))
+                  && stbtt__validate_kern(info)
+                  && stbtt__validate_gpos(info);
+   return info->validated;
+}
+
+static int stbtt_InitFont_internal(stbtt_fontinfo *info, unsigned char *data, long dsize, int fontstart, int flags)
+{
+   stbtt_uint32 cmap, t;
+   stbtt_int32 i,numTables;
+
+   info->data = data;
+   info->dsize = dsize;
+   info->fontstart = fontstart;
+   info->cff = stbtt__new_buf(NULL, 0);
+   info->cff_state = STBTT__CFF_PENDING;
+   info->validated = 0;
+   info->glyphmap = NULL;
+   info->revmap = NULL;
+   info->outlines = NULL;
+   info->boxes = NULL;
+   info->fdmap = NULL;
+   info->compiled = NULL;
+   info->var = NULL;
+   info->hmetrics = NULL;
+   info->kerning = NULL;
+   info->gposclasses = NULL;
+   info->ascii = NULL;
+
+   if (!stbtt__index_tables(info))
+      return 0;
+   if ((flags & STBTT_INIT_VALIDATE) && !stbtt__validate_tables(info))
+      return 0;
+
+   cmap = stbtt__get_table(info, "cmap", NULL);       // required
+   info->loca = stbtt__get_table(info, "loca", NULL); // required
+   info->head = stbtt__get_table(info, "head", NULL); // required
+   info->glyf = stbtt__get_table(info, "glyf", NULL); // required
+   info->hhea = stbtt__get_table(info, "hhea", NULL); // required
+   info->hmtx = stbtt__get_table(info, "hmtx", NULL); // required
+   info->kern = stbtt__get_table(info, "kern", NULL); // not required
+   info->gpos = stbtt__get_table(info, "GPOS", NULL); // not required
+
+   if (!cmap || !info->head || !info->hhea || !info->hmtx)
+      return 0;
+   if (info->glyf) {
+      // required for truetype
+      if (!info->loca) return 0;
+   } else {
+      // initialization for CFF / Type2 fonts (OTF)
+      stbtt_uint32 cff, cff_len;
+
+      cff = stbtt__get_table(info, "CFF ", &cff_len);
+      if (!cff) return 0;
+
+      // clamp to the buffer in case the directory is wrong
+      if (cff > (stbtt_uint32) dsize)
+         cff_len = 0;
+      else if (cff_len > (stbtt_uint32) dsize - cff)
+         cff_len = (stbtt_uint32) dsize - cff;
+      if (cff_len >= 0x40000000)
+         cff_len = 0x40000000 - 1;
+      info->cff = stbtt__new_buf(data+cff, cff_len);
+      info->charstrings = info->gsubrs = info->subrs = stbtt__new_buf(NULL, 0);
+      info->fontdicts = info->fdselect = stbtt__new_buf(NULL, 0);
+
+      if (!(flags & STBTT_INIT_LAZY_CFF)) {
+         if ((flags & STBTT_INIT_VALIDATE) && !stbtt__validate_cff_header(info)) return 0;
+         if (!stbtt__parse_cff(info)) return 0;
+         info->cff_state = STBTT__CFF_READY;
+      }
+   }
+
+   t = stbtt__get_table(info, "maxp", NULL);
+   if (t)
+      info->numGlyphs = ttUSHORT(data+t+4);
+   else
+      info->numGlyphs = 0xffff;
+
+   info->svg = -1;
+
+   // find a cmap encoding table we understand *now* to avoid searching
+   // later. (todo: could make this installable)
+   // the same regardless of glyph.
+   numTables = ttUSHORT(data + cmap + 2);
+   info->index_map = 0;
+   for (i=0; i < numTables; ++i) {
+      stbtt_uint32 encoding_record = cmap + 4 + 8 * i;
+      // find an encoding we understand:
+      switch(ttUSHORT(data+encoding_record)) {
+         case STBTT_PLATFORM_ID_MICROSOFT:
+            switch (ttUSHORT(data+encoding_record+2)) {
+               case STBTT_MS_EID_UNICODE_BMP:
+               case STBTT_MS_EID_UNICODE_FULL:
+                  // MS/Unicode
+                  info->index_map = cmap + ttULONG(data+encoding_record+4);
+                  break;
+            }
+            break;
+        case STBTT_PLATFORM_ID_UNICODE:
+            // Mac/iOS has these
+            // all the encodingIDs are unicode, so we don't bother to check it
+            info->index_map = cmap + ttULONG(data+encoding_record+4);
+            break;
+      }
+   }
+   if (info->index_map == 0)
+      return 0;
+
+   info->indexToLocFormat = ttUSHORT(data+info->head + 50);
+
+   if ((flags & STBTT_INIT_VALIDATE) && !stbtt_ValidateFont(info))
+      return 0;
+   if (flags & STBTT_INIT_GLYPH_MAP)
+      stbtt_BuildGlyphIndexMap(info);
+   if (flags & STBTT_INIT_REVERSE_MAP)
+      stbtt_BuildReverseGlyphIndexMap(info);
+   if (flags & STBTT_INIT_OUTLINE_CACHE)
+      stbtt_BuildOutlineCache(info, STBTT_OUTLINE_CACHE_BYTES);
+   if (flags & STBTT_INIT_GLYPH_BOXES)
+      stbtt_BuildGlyphBoxTable(info);
+   if (flags & STBTT_INIT_FDSELECT_MAP)
+      stbtt_BuildFDSelectMap(info);
+   if (flags & STBTT_INIT_HMETRICS)
+      stbtt_BuildHMetricsTable(info);
+   if (flags & STBTT_INIT_KERNING)
+      stbtt_BuildKerningTable(info);
+   if (flags & STBTT_INIT_GPOS_CLASSES)
+      stbtt_BuildGPOSClassTables(info);
+   if (flags & STBTT_INIT_ASCII_TABLE)
+      stbtt_BuildASCIITable(info);
+   return 1;
+}
+
+typedef struct stbtt__glyphmap
+{
+   int num_blocks;                    // number of 256-codepoint blocks covered by top[]
+   stbtt_uint16 *top;                 // page of glyph ids for each block; page 0 is all zero
+   stbtt_uint16 *pages;               // 256 glyph ids per page
+} stbtt__glyphmap;
+
+// binary search the segments of a format 4 cmap for the one that would
+// contain unicode_codepoint (which must be <= 0xffff)
+static stbtt_uint16 stbtt__cmap4_segment(stbtt_uint8 *data, stbtt_uint32 index_map, int unicode_codepoint)
+{
+   stbtt_uint16 searchRange = ttUSHORT(data+index_map+8) >> 1;
+   stbtt_uint16 entrySelector = ttUSHORT(data+index_map+10);
+   stbtt_uint16 rangeShift = ttUSHORT(data+index_map+12) >> 1;
+
+   // do a binary search of the segments
+   stbtt_uint32 endCount = index_map + 14;
+   stbtt_uint32 search = endCount;
+
+   // they lie from endCount .. endCount + segCount
+   // but searchRange is the nearest power of two, so...
+   if (unicode_codepoint >= ttUSHORT(data + search + rangeShift*2))
+      search += rangeShift*2;
+
+   // now decrement to bias correctly to find smallest
+   search -= 2;
+   while (entrySelector) {
+      stbtt_uint16 end;
+      searchRange >>= 1;
+      end = ttUSHORT(data + search + searchRange*2);
+      if (unicode_codepoint > end)
+         search += searchRange*2;
+      --entrySelector;
+   }
+   search += 2;
+
+   return (stbtt_uint16) ((search - endCount) >> 1);
+}
+
+STBTT_DEF int stbtt_FindGlyphIndex(const stbtt_fontinfo *info, int unicode_codepoint)
+{
+   stbtt_uint8 *data = info->data;
+   stbtt_uint32 index_map = info->index_map;
+   stbtt_uint16 format;
+
+   if (info->glyphmap) {
+      stbtt__glyphmap *m = info->glyphmap;
+      if ((stbtt_uint32) unicode_codepoint < ((stbtt_uint32) m->num_blocks << 8))
+         return m->pages[((stbtt_uint32) m->top[unicode_codepoint >> 8] << 8) | (unicode_codepoint & 255)];
+      return 0;
+   }
+
+   format = ttUSHORT(data + index_map + 0);
+   if (format == 0) { // apple byte encoding
+      stbtt_int32 bytes = ttUSHORT(data + index_map + 2);
+      if (unicode_codepoint < bytes-6)
+         return ttBYTE(data + index_map + 6 + unicode_codepoint);
+      return 0;
+   } else if (format == 6) {
+      stbtt_uint32 first = ttUSHORT(data + index_map + 6);
+      stbtt_uint32 count = ttUSHORT(data + index_map + 8);
+      if ((stbtt_uint32) unicode_codepoint >= first && (stbtt_uint32) unicode_codepoint < first+count)
+         return ttUSHORT(data + index_map + 10 + (unicode_codepoint - first)*2);
+      return 0;
+   } else if (format == 2) {
+      STBTT_assert(0); // @TODO: high-byte mapping for japanese/chinese/korean
+      return 0;
+   } else if (format == 4) { // standard mapping for windows fonts: binary search collection of ranges
+      stbtt_uint16 segcount = ttUSHORT(data+index_map+6) >> 1;
+      stbtt_uint32 endCount = index_map + 14;
+
+      if (unicode_codepoint > 0xffff)
+         return 0;
+
+      {
+         stbtt_uint16 offset, start, last;
+         stbtt_uint16 item = stbtt__cmap4_segment(data, index_map, unicode_codepoint);
+
+         start = ttUSHORT(data + index_map + 14 + segcount*2 + 2 + 2*item);
+         last = ttUSHORT(data + endCount + 2*item);
+         if (unicode_codepoint < start || unicode_codepoint > last)
+            return 0;
+
+         offset = ttUSHORT(data + index_map + 14 + segcount*6 + 2 + 2*item);
+         if (offset == 0)
+            return (stbtt_uint16) (unicode_codepoint + ttSHORT(data + index_map + 14 + segcount*4 + 2 + 2*item));
+
+         return ttUSHORT(data + offset + (unicode_codepoint-start)*2 + index_map + 14 + segcount*6 + 2 + 2*item);
+      }
+   } else if (format == 12 || format == 13) {
+      stbtt_uint32 ngroups = ttULONG(data+index_map+12);
+      stbtt_int32 low,high;
+      low = 0; high = (stbtt_int32)ngroups;
+      // Binary search the right group.
+      while (low < high) {
+         stbtt_int32 mid = low + ((high-low) >> 1); // rounds down, so low <= mid < high
+         stbtt_uint32 start_char = ttULONG(data+index_map+16+mid*12);
+         stbtt_uint32 end_char = ttULONG(data+index_map+16+mid*12+4);
+         if ((stbtt_uint32) unicode_codepoint < start_char)
+            high = mid;
+         else if ((stbtt_uint32) unicode_codepoint > end_char)
+            low = mid+1;
+         else {
+            stbtt_uint32 start_glyph = ttULONG(data+index_map+16+mid*12+8);
+            if (format == 12)
+               return start_glyph + unicode_codepoint-start_char;
+            else // format == 13
+               return start_glyph;
+         }
+      }
+      return 0; // not found
+   }
+   // @TODO
+   STBTT_assert(0);
+   return 0;
+}
+
+// Number of codepoints at the front of cp[0..n) that lie in [lo,hi].
+static int stbtt__codepoint_run(const int *cp, int n, stbtt_uint32 lo, stbtt_uint32 hi)
+{
+   int k = 0;
+   while (k < n && (stbtt_uint32) cp[k] - lo <= hi - lo)
+      ++k;
+   return k;
+}
+
+STBTT_DEF void stbtt_FindGlyphIndices(const stbtt_fontinfo *info, const int *codepoints, int n, int *glyphs)
+{
+   stbtt_uint8 *data = info->data;
+   stbtt_uint32 index_map = info->index_map;
+   stbtt_uint16 format = ttUSHORT(data + index_map + 0);
+   int i, k, m;
+
+   if (info->glyphmap) {
+      stbtt__glyphmap *map = info->glyphmap;
+      stbtt_uint32 limit = (stbtt_uint32) map->num_blocks << 8;
+      for (i=0; i < n; ++i) {
+         stbtt_uint32 c = (stbtt_uint32) codepoints[i];
+         glyphs[i] = c < limit ? map->pages[((stbtt_uint32) map->top[c >> 8] << 8) | (c & 255)] : 0;
+      }
+   } else if (format == 4) {
+      stbtt_uint32 segcount = ttUSHORT(data+index_map+6) >> 1;
+      stbtt_uint32 start = 0, last = 0, offset = 0, item = 0;
+      stbtt_int32 delta = 0;
+      int found = 0;
+      for (i=0; i < n; i += m) {
+         stbtt_int32 c = codepoints[i];
+         if (!found || (stbtt_uint32) c - start > last - start) {
+            // not in the current segment, so look it up
+            if (c < 0 || c > 0xffff) {
+               glyphs[i] = 0;
+               m = 1;
+               continue;
+            }
+            item   = stbtt__cmap4_segment(data, index_map, c);
+            start  = ttUSHORT(data + index_map + 14 + segcount*2 + 2 + 2*item);
+            last   = ttUSHORT(data + index_map + 14 + 2*item);
+            delta  = ttSHORT (data + index_map + 14 + segcount*4 + 2 + 2*item);
+            offset = ttUSHORT(data + index_map + 14 + segcount*6 + 2 + 2*item);
+            found = (stbtt_uint32) c >= start && (stbtt_uint32) c <= last;
+            if (!found) {
+               glyphs[i] = 0;
+               m = 1;
+               continue;
+            }
+         }
+         m = stbtt__codepoint_run(codepoints+i, n-i, start, last);
+         if (offset == 0) {
+            // this loop has no branches, so it can be vectorized
+            for (k=0; k < m; ++k)
+               glyphs[i+k] = (stbtt_uint16) (codepoints[i+k] + delta);
+         } else {
+            stbtt_uint8 *ids = data + offset + index_map + 14 + segcount*6 + 2 + 2*item;
+            for (k=0; k < m; ++k)
+               glyphs[i+k] = ttUSHORT(ids + (codepoints[i+k] - start)*2);
+         }
+      }
+   } else if (format == 12 || format == 13) {
+      stbtt_uint32 ngroups = ttULONG(data+index_map+12);
+      stbtt_uint32 start_char = 0, end_char = 0, start_glyph = 0;
+      int found = 0;
+      for (i=0; i < n; i += m) {
+         stbtt_uint32 c = (stbtt_uint32) codepoints[i];
+         if (!found || c - start_char > end_char - start_char) {
+            // not in the current group, so binary search for it
+            stbtt_int32 low = 0, high = (stbtt_int32) ngroups;
+            found = 0;
+            while (low < high) {
+               stbtt_int32 mid = low + ((high-low) >> 1);
+               stbtt_uint32 s = ttULONG(data+index_map+16+mid*12);
+               stbtt_uint32 e = ttULONG(data+index_map+16+mid*12+4);
+               if (c < s)
+                  high = mid;
+               else if (c > e)
+                  low = mid+1;
+               else {
+                  start_char = s;
+                  end_char = e;
+                  start_glyph = ttULONG(data+index_map+16+mid*12+8);
+                  found = 1;
+                  break;
+               }
+            }
+            if (!found) {
+               glyphs[i] = 0;
+               m = 1;
+               continue;
+            }
+         }
+         m = stbtt__codepoint_run(codepoints+i, n-i, start_char, end_char);
+         if (format == 12) {
+            for (k=0; k < m; ++k)
+               glyphs[i+k] = start_glyph + codepoints[i+k] - start_char;
+         } else {
+            for (k=0; k < m; ++k)
+               glyphs[i+k] = start_glyph;
+         }
+      }
+   } else {
+      for (i=0; i < n; ++i)
+         glyphs[i] = stbtt_FindGlyphIndex(info, codepoints[i]);
+   }
+}
+
+typedef struct stbtt__asciitable
+{
+   stbtt_uint16 glyph[128];
+   stbtt_int16 advance[128];          // of the default instance
+} stbtt__asciitable;
+
+static void stbtt__GetGlyphHMetricsDefault(const stbtt_fontinfo *info, int glyph_index, int *advanceWidth, int *leftSideBearing);
+static int stbtt__var_selected(const stbtt_fontinfo *info);
+
+STBTT_DEF int stbtt_BuildASCIITable(stbtt_fontinfo *info)
+{
+   stbtt__asciitable *t;
+   int c;
+   if (info->ascii)
+      return 1;
+   t = (stbtt__asciitable *) STBTT_malloc(sizeof(*t), info->userdata);
+   if (!t)
+      return 0;
+   for (c=0; c < 128; ++c) {
+      int advance;
+      t->glyph[c] = (stbtt_uint16) stbtt_FindGlyphIndex(info, c);
+      stbtt__GetGlyphHMetricsDefault(info, t->glyph[c], &advance, NULL);
+      t->advance[c] = (stbtt_int16) advance;
+   }
+   info->ascii = t;
+   return 1;
+}
+
+// Number of bytes at the front of s[0..len) that are ASCII.
+static int stbtt__ascii_prefix(const stbtt_uint8 *s, int len)
+{
+   int i = 0;
+#ifdef STBTT__SSE2
+   while (i + 16 <= len) {
+      int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (s + i)));
+      if (mask) {
+         while (!(mask & 1))
+            mask >>= 1, ++i;
+         return i;
+      }
+      i += 16;
+   }
+#endif
+   while (i < len && s[i] < 0x80)
+      ++i;
+   return i;
+}
+
+// Decodes the UTF-8 sequence at the front of s[0..len), len > 0. Returns
+// its length in bytes, or 1 and U+FFFD if it's malformed.
+static int stbtt__decode_utf8(const stbtt_uint8 *s, int len, int *codepoint)
+{
+   int c = s[0], n, k, min;
+   if (c < 0x80) {
+      *codepoint = c;
+      return 1;
+   }
+   if      (c >= 0xc2 && c < 0xe0) n = 1, c &= 0x1f, min = 0x80;
+   else if (c >= 0xe0 && c < 0xf0) n = 2, c &= 0x0f, min = 0x800;
+   else if (c >= 0xf0 && c < 0xf5) n = 3, c &= 0x07, min = 0x10000;
+   else {
+      *codepoint = 0xfffd;
+      return 1;
+   }
+   for (k=1; k <= n; ++k) {
+      if (k >= len || (s[k] & 0xc0) != 0x80) {
+         *codepoint = 0xfffd;
+         return 1;
+      }
+      c = (c << 6) | (s[k] & 0x3f);
+   }
+   if (c < min || c > 0x10ffff || (c >= 0xd800 && c < 0xe000)) {
+      *codepoint = 0xfffd;
+      return 1;
+   }
+   *codepoint = c;
+   return n+1;
+}
+
+STBTT_DEF int stbtt_MapUTF8Glyphs(const stbtt_fontinfo *info, const char *text, int len, int *glyphs, int *advances, int *kerning)
+{
+   const stbtt_uint8 *s = (const stbtt_uint8 *) text;
+   const stbtt__asciitable *ascii = stbtt__var_selected(info) ? NULL : info->ascii;
+   stbtt__asciitable seen;
+   stbtt_uint8 known[128];
+   int i = 0, n = 0, k, prev = -1;
+   int do_kern = kerning && (info->kern || info->gpos);
+   int run_kern = do_kern && glyphs; // kern the whole run at the end
+
+   if (!ascii)
+      STBTT_memset(known, 0, sizeof(known));
+   while (i < len) {
+      int g, advance, c;
+      if (s[i] < 0x80 && (run_kern || !do_kern)) {
+         // map a whole run of ASCII through the table; without one, through
+         // a table of the characters seen so far in this call
+         const stbtt__asciitable *t = ascii;
+         const stbtt_uint8 *r = s + i;
+         int run = stbtt__ascii_prefix(r, len - i);
+         if (!t) {
+            for (k=0; k < run; ++k) {
+               if (!known[c = r[k]]) {
+                  seen.glyph[c] = (stbtt_uint16) stbtt_FindGlyphIndex(info, c);
+                  stbtt_GetGlyphHMetrics(info, seen.glyph[c], &advance, NULL);
+                  seen.advance[c] = (stbtt_int16) advance;
+                  known[c] = 1;
+               }
+            }
+            t = &seen;
+         }
+         if (glyphs)
+            for (k=0; k < run; ++k)
+               glyphs[n+k] = t->glyph[r[k]];
+         if (advances)
+            for (k=0; k < run; ++k)
+               advances[n+k] = t->advance[r[k]];
+         if (kerning)
+            STBTT_memset(kerning + n, 0, run * sizeof(int));
+         i += run;
+         n += run;
+         continue;
+      }
+      if (ascii && s[i] < 0x80) {
+         c = s[i++];
+         g = ascii->glyph[c];
+         if (glyphs)   glyphs[n] = g;
+         if (advances) advances[n] = ascii->advance[c];
+      } else {
+         i += stbtt__decode_utf8(s+i, len-i, &c);
+         g = stbtt_FindGlyphIndex(info, c);
+         if (glyphs)   glyphs[n] = g;
+         if (advances) {
+            stbtt_GetGlyphHMetrics(info, g, &advance, NULL);
+            advances[n] = advance;
+         }
+      }
+      if (kerning)  kerning[n] = do_kern && !run_kern && prev >= 0 ? stbtt_GetGlyphKernAdvance(info, prev, g) : 0;
+      prev = g;
+      ++n;
+   }
+   if (run_kern)
+      stbtt_GetGlyphRunKernAdvances(info, glyphs, n, kerning + 1);
+   return n;
+}
+
+// Calls fn() for each run of codepoints in the chosen cmap subtable, in
+// the order they're stored. Codepoint c of a run maps to glyph
+// first_glyph + step * (c - first), with step 0 or 1; runs may include
+// codepoints that map to glyph 0. Returns 0 if the format isn't supported.
+typedef void stbtt__cmap_run_func(void *ctx, stbtt_uint32 first, stbtt_uint32 last, stbtt_uint32 first_glyph, int step);
+
+static int stbtt__walk_cmap(const stbtt_fontinfo *info, stbtt__cmap_run_func *fn, void *ctx)
+{
+   stbtt_uint8 *data = info->data;
+   stbtt_uint32 index_map = info->index_map;
+   stbtt_uint16 format = ttUSHORT(data + index_map + 0);
+   stbtt_uint32 i, c;
+
+   if (format == 0) { // apple byte encoding
+      stbtt_int32 bytes = ttUSHORT(data + index_map + 2);
+      for (i=0; (stbtt_int32) i < bytes-6; ++i)
+         fn(ctx, i, i, ttBYTE(data + index_map + 6 + i), 0);
+   } else if (format == 6) {
+      stbtt_uint32 first = ttUSHORT(data + index_map + 6);
+      stbtt_uint32 count = ttUSHORT(data + index_map + 8);
+      for (i=0; i < count; ++i)
+         fn(ctx, first+i, first+i, ttUSHORT(data + index_map + 10 + i*2), 0);
+   } else if (format == 4) {
+      stbtt_uint32 segcount = ttUSHORT(data+index_map+6) >> 1;
+      for (i=0; i < segcount; ++i) {
+         stbtt_uint32 last   = ttUSHORT(data + index_map + 14 + 2*i);
+         stbtt_uint32 start  = ttUSHORT(data + index_map + 14 + segcount*2 + 2 + 2*i);
+         stbtt_int32  delta  = ttSHORT (data + index_map + 14 + segcount*4 + 2 + 2*i);
+         stbtt_uint32 offset = ttUSHORT(data + index_map + 14 + segcount*6 + 2 + 2*i);
+         if (start > last)
+            continue;
+         if (offset == 0) {
+            // glyph ids wrap around at 65536
+            stbtt_uint32 g = (stbtt_uint32) (start + delta) & 0xffff;
+            if (g + (last - start) > 0xffff) {
+               fn(ctx, start, start + (0xffff - g), g, 1);
+               fn(ctx, start + (0x10000 - g), last, 0, 1);
+            } else
+               fn(ctx, start, last, g, 1);
+         } else {
+            for (c=start; c <= last; ++c)
+               fn(ctx, c, c, ttUSHORT(data + offset + (c-start)*2 + index_map + 14 + segcount*6 + 2 + 2*i), 0);
+         }
+      }
+   } else if (format == 12 || format == 13) {
+      stbtt_uint32 ngroups = ttULONG(data+index_map+12);
+      for (i=0; i < ngroups; ++i) {
+         stbtt_uint32 start_char = ttULONG(data+index_map+16+i*12);
+         stbtt_uint32 end_char = ttULONG(data+index_map+16+i*12+4);
+         stbtt_uint32 start_glyph = ttULONG(data+index_map+16+i*12+8);
+         if (start_char <= end_char)
+            fn(ctx, start_char, end_char, start_glyph, format == 12);
+      }
+   } else {
+      return 0;
+   }
+   return 1;
+}
+
+#define STBTT__MAX_CODEPOINT  0x10ffff
+#define STBTT__NUM_BLOCKS     ((STBTT__MAX_CODEPOINT >> 8) + 1)
+
+typedef struct
+{
+   stbtt__glyphmap *map;
+   int num_blocks;
+   stbtt_uint8 used[STBTT__NUM_BLOCKS];
+} stbtt__glyphmap_builder;
+
+static void stbtt__glyphmap_mark(void *ctx, stbtt_uint32 first, stbtt_uint32 last, stbtt_uint32 first_glyph, int step)
+{
+   stbtt__glyphmap_builder *b = (stbtt__glyphmap_builder *) ctx;
+   stbtt_uint32 k;
+   if (first > STBTT__MAX_CODEPOINT || (first_glyph == 0 && (step == 0 || first == last)))
+      return;
+   if (last > STBTT__MAX_CODEPOINT)
+      last = STBTT__MAX_CODEPOINT;
+   for (k = first >> 8; k <= (last >> 8); ++k)
+      b->used[k] = 1;
+   if ((int) (last >> 8) >= b->num_blocks)
+      b->num_blocks = (last >> 8) + 1;
+}
+
+static void stbtt__glyphmap_fill(void *ctx, stbtt_uint32 first, stbtt_uint32 last, stbtt_uint32 first_glyph, int step)
+{
+   stbtt__glyphmap *m = ((stbtt__glyphmap_builder *) ctx)->map;
+   stbtt_uint32 c, g = first_glyph;
+   if (first > STBTT__MAX_CODEPOINT)
+      return;
+   if (last > STBTT__MAX_CODEPOINT)
+      last = STBTT__MAX_CODEPOINT;
+   for (c = first; c <= last; ++c, g += step)
+      if (g)
+         m->pages[((stbtt_uint32) m->top[c >> 8] << 8) | (c & 255)] = (stbtt_uint16) g;
+}
+
+STBTT_DEF int stbtt_BuildGlyphIndexMap(stbtt_fontinfo *info)
+{
+   stbtt__glyphmap_builder *b;
+   stbtt__glyphmap *m;
+   int i, num_pages = 1;
+
+   if (info->glyphmap)
+      return 1;
+
+   b = (stbtt__glyphmap_builder *) STBTT_malloc(sizeof(*b), info->userdata);
+   if (b == NULL)
+      return 0;
+   STBTT_memset(b, 0, sizeof(*b));
+
+   // first pass finds which blocks have any characters in them
+   if (!stbtt__walk_cmap(info, stbtt__glyphmap_mark, b)) {
+      STBTT_free(b, info->userdata);
+      return 0;
+   }
+   for (i=0; i < b->num_blocks; ++i)
+      num_pages += b->used[i];
+
+   m = (stbtt__glyphmap *) STBTT_malloc(sizeof(*m) + b->num_blocks * sizeof(stbtt_uint16) + num_pages * 256 * sizeof(stbtt_uint16), info->userdata);
+   if (m == NULL) {
+      STBTT_free(b, info->userdata);
+      return 0;
+   }
+   m->num_blocks = b->num_blocks;
+   m->pages = (stbtt_uint16 *) (m + 1);
+   m->top = m->pages + num_pages * 256;
+   STBTT_memset(m->pages, 0, num_pages * 256 * sizeof(stbtt_uint16));
+   num_pages = 1;
+   for (i=0; i < b->num_blocks; ++i)
+      m->top[i] = (stbtt_uint16) (b->used[i] ? num_pages++ : 0);
+
+   // second pass fills them in
+   b->map = m;
+   stbtt__walk_cmap(info, stbtt__glyphmap_fill, b);
+   STBTT_free(b, info->userdata);
+
+   info->glyphmap = m;
+   return 1;
+}
+
+typedef struct stbtt__revmap
+{
+   stbtt_uint32 *start;               // glyph g has codepoints[start[g] .. start[g+1])
+   int *codepoints;
+} stbtt__revmap;
+
+typedef struct
+{
+   const stbtt_fontinfo *info;
+   stbtt__revmap *map;
+   stbtt_uint32 glyph;
+   int *out, max, count;
+} stbtt__revmap_builder;
+
+// a cmap run can claim codepoints that a lookup never reaches, e.g. if
+// format 4 segments overlap, so every codepoint is checked against the
+// forward mapping
+static void stbtt__revmap_count(void *ctx, stbtt_uint32 first, stbtt_uint32 last, stbtt_uint32 first_glyph, int step)
+{
+   stbtt__revmap_builder *b = (stbtt__revmap_builder *) ctx;
+   stbtt_uint32 c, g = first_glyph;
+   if (last > STBTT__MAX_CODEPOINT)
+      last = STBTT__MAX_CODEPOINT;
+   for (c = first; c <= last && first <= STBTT__MAX_CODEPOINT; ++c, g += step)
+      if (g && g < (stbtt_uint32) b->info->numGlyphs && (stbtt_uint32) stbtt_FindGlyphIndex(b->info, c) == g)
+         ++b->map->start[g+1];
+}
+
+static void stbtt__revmap_fill(void *ctx, stbtt_uint32 first, stbtt_uint32 last, stbtt_uint32 first_glyph, int step)
+{
+   stbtt__revmap_builder *b = (stbtt__revmap_builder *) ctx;
+   stbtt_uint32 c, g = first_glyph;
+   if (last > STBTT__MAX_CODEPOINT)
+      last = STBTT__MAX_CODEPOINT;
+   for (c = first; c <= last && first <= STBTT__MAX_CODEPOINT; ++c, g += step)
+      if (g && g < (stbtt_uint32) b->info->numGlyphs && (stbtt_uint32) stbtt_FindGlyphIndex(b->info, c) == g)
+         b->map->codepoints[b->map->start[g]++] = c;
+}
+
+static void stbtt__revmap_add(stbtt__revmap_builder *b, stbtt_uint32 c)
+{
+   if ((stbtt_uint32) stbtt_FindGlyphIndex(b->info, c) == b->glyph) {
+      if (b->count < b->max)
+         b->out[b->count] = c;
+      ++b->count;
+   }
+}
+
+static void stbtt__revmap_find(void *ctx, stbtt_uint32 first, stbtt_uint32 last, stbtt_uint32 first_glyph, int step)
+{
+   stbtt__revmap_builder *b = (stbtt__revmap_builder *) ctx;
+   stbtt_uint32 c;
+   if (last > STBTT__MAX_CODEPOINT)
+      last = STBTT__MAX_CODEPOINT;
+   if (first > last)
+      return;
+   if (step) {
+      // only one codepoint of the run can have the glyph
+      if (b->glyph >= first_glyph && b->glyph - first_glyph <= last - first)
+         stbtt__revmap_add(b, first + (b->glyph - first_glyph));
+   } else if (first_glyph == b->glyph) {
+      for (c = first; c <= last; ++c)
+         stbtt__revmap_add(b, c);
+   }
+}
+
+STBTT_DEF int stbtt_BuildReverseGlyphIndexMap(stbtt_fontinfo *info)
+{
+   stbtt__revmap_builder b;
+   stbtt__revmap *m;
+   int g, n = info->numGlyphs;
+
+   if (info->revmap)
+      return 1;
+   if (n < 0)
+      return 0;
+
+   m = (stbtt__revmap *) STBTT_malloc(sizeof(*m) + (n+1) * sizeof(stbtt_uint32), info->userdata);
+   if (m == NULL)
+      return 0;
+   m->start = (stbtt_uint32 *) (m + 1);
+   m->codepoints = NULL;
+   STBTT_memset(m->start, 0, (n+1) * sizeof(stbtt_uint32));
+   b.info = info;
+   b.map = m;
+
+   // count the codepoints for each glyph, then turn the counts into offsets
+   if (!stbtt__walk_cmap(info, stbtt__revmap_count, &b)) {
+      STBTT_free(m, info->userdata);
+      return 0;
+   }
+   for (g=0; g < n; ++g)
+      m->start[g+1] += m->start[g];
+
+   m->codepoints = (int *) STBTT_malloc(m->start[n] * sizeof(int) + 1, info->userdata);
+   if (m->codepoints == NULL) {
+      STBTT_free(m, info->userdata);
+      return 0;
+   }
+
+   // filling in advances start[g] to the end of glyph g, i.e. start[g+1]
+   stbtt__walk_cmap(info, stbtt__revmap_fill, &b);
+   for (g=n; g > 0; --g)
+      m->start[g] = m->start[g-1];
+   m->start[0] = 0;
+
+   info->revmap = m;
+   return 1;
+}
+
+STBTT_DEF int stbtt_GetCodepointsForGlyph(const stbtt_fontinfo *info, int glyph_index, int *codepoints, int max_codepoints)
+{
+   stbtt__revmap_builder b;
+
+   if (glyph_index <= 0 || glyph_index >= info->numGlyphs)
+      return 0;
+
+   if (info->revmap) {
+      stbtt__revmap *m = info->revmap;
+      int k, count = (int) (m->start[glyph_index+1] - m->start[glyph_index]);
+      for (k=0; k < count && k < max_codepoints; ++k)
+         codepoints[k] = m->codepoints[m->start[glyph_index] + k];
+      return count;
+   }
+
+   b.info = info;
+   b.map = NULL;
+   b.glyph = glyph_index;
+   b.out = codepoints;
+   b.max = max_codepoints;
+   b.count = 0;
+   stbtt__walk_cmap(info, stbtt__revmap_find, &b);
+   return b.count;
+}
+
+typedef struct
+{
+   stbtt_uint32 *ranges;
+   int count;
+} stbtt__coverage_builder;
+
+static void stbtt__coverage_add(void *ctx, stbtt_uint32 first, stbtt_uint32 last, stbtt_uint32 first_glyph, int step)
+{
+   stbtt__coverage_builder *b = (stbtt__coverage_builder *) ctx;
+   if (first_glyph == 0) {
+      // a run that starts at glyph 0 only covers the rest of its codepoints
+      if (step == 0 || first == last)
+         return;
+      ++first;
+   }
+   if (last > STBTT__MAX_CODEPOINT)
+      last = STBTT__MAX_CODEPOINT;
+   if (first > last)
+      return;
+   if (b->ranges) {
+      b->ranges[b->count*2+0] = first;
+      b->ranges[b->count*2+1] = last;
+   }
+   ++b->count;
+}
+
+static int stbtt__coverage_finish(stbtt_coverage *coverage)
+{
+   stbtt_uint32 *r = coverage->ranges;
+   int i, j, n = coverage->num_ranges;
+
+   // cmap runs are almost always in order already, so insertion sort
+   for (i=1; i < n; ++i) {
+      stbtt_uint32 first = r[i*2], last = r[i*2+1];
+      for (j=i; j > 0 && r[j*2-2] > first; --j) {
+         r[j*2+0] = r[j*2-2];
+         r[j*2+1] = r[j*2-1];
+      }
+      r[j*2+0] = first;
+      r[j*2+1] = last;
+   }
+
+   // merge ranges that overlap or touch
+   for (i=0, j=-1; i < n; ++i) {
+      if (j >= 0 && r[i*2] <= r[j*2+1] + 1) {
+         if (r[i*2+1] > r[j*2+1])
+            r[j*2+1] = r[i*2+1];
+      } else {
+         ++j;
+         r[j*2+0] = r[i*2+0];
+         r[j*2+1] = r[i*2+1];
+      }
+   }
+   coverage->num_ranges = j+1;
+
+   STBTT_memset(coverage->bmp, 0, 2048 * sizeof(stbtt_uint32));
+   for (i=0; i < coverage->num_ranges && r[i*2] <= 0xffff; ++i) {
+      stbtt_uint32 c, last = r[i*2+1] > 0xffff ? 0xffff : r[i*2+1];
+      for (c = r[i*2]; c <= last; ++c)
+         coverage->bmp[c >> 5] |= 1u << (c & 31);
+   }
+   return 1;
+}
+
+static int stbtt__coverage_alloc(stbtt_coverage *coverage, int num_ranges, void *userdata)
+{
+   coverage->bmp = (unsigned int *) STBTT_malloc((2048 + num_ranges*2) * sizeof(stbtt_uint32), userdata);
+   coverage->ranges = coverage->bmp ? coverage->bmp + 2048 : NULL;
+   coverage->num_ranges = num_ranges;
+   coverage->userdata = userdata;
+   return coverage->bmp != NULL;
+}
+
+STBTT_DEF int stbtt_GetFontCoverage(const stbtt_fontinfo *info, stbtt_coverage *coverage)
+{
+   stbtt__coverage_builder b;
+   b.ranges = NULL;
+   b.count = 0;
+   if (!stbtt__walk_cmap(info, stbtt__coverage_add, &b))
+      return 0;
+   if (!stbtt__coverage_alloc(coverage, b.count, info->userdata))
+      return 0;
+   b.ranges = coverage->ranges;
+   b.count = 0;
+   stbtt__walk_cmap(info, stbtt__coverage_add, &b);
+   return stbtt__coverage_finish(coverage);
+}
+
+STBTT_DEF int stbtt_CoverageFromRanges(stbtt_coverage *coverage, const unsigned int *ranges, int num_ranges, void *userdata)
+{
+   if (!stbtt__coverage_alloc(coverage, num_ranges, userdata))
+      return 0;
+   STBTT_memcpy(coverage->ranges, ranges, num_ranges * 2 * sizeof(stbtt_uint32));
+   return stbtt__coverage_finish(coverage);
+}
+
+STBTT_DEF int stbtt_CoverageHas(const stbtt_coverage *coverage, int codepoint)
+{
+   stbtt_uint32 c = (stbtt_uint32) codepoint;
+   int low, high;
+   if (c <= 0xffff)
+      return (coverage->bmp[c >> 5] >> (c & 31)) & 1;
+   low = 0;
+   high = coverage->num_ranges;
+   while (low < high) {
+      int mid = low + ((high-low) >> 1);
+      if (c < coverage->ranges[mid*2])
+         high = mid;
+      else if (c > coverage->ranges[mid*2+1])
+         low = mid+1;
+      else
+         return 1;
+   }
+   return 0;
+}
+
+STBTT_DEF int stbtt_CoverageMissing(const stbtt_coverage *coverage, const int *codepoints, int n, int *missing)
+{
+   int i, count = 0;
+   for (i=0; i < n; ++i)
+      if (!stbtt_CoverageHas(coverage, codepoints[i]))
+         missing[count++] = i;
+   return count;
+}
+
+STBTT_DEF void stbtt_FreeCoverage(stbtt_coverage *coverage)
+{
+   STBTT_free(coverage->bmp, coverage->userdata);
+   coverage->bmp = NULL;
+   coverage->ranges = NULL;
+   coverage->num_ranges = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// decoded outline cache, see stbtt_BuildOutlineCache
+//
+
+// the arena is split into chunks of this many vertices; an outline takes a
+// chain of them, so eviction never has to deal with fragmentation
+#define STBTT__CHUNK_VERTICES  32
+
+typedef struct
+{
+   int glyph;                         // -1 if the entry is free
+   int first_chunk;                   // or the next free entry
+   int num_vertices;
+   int referenced;                    // CLOCK bit, set on every hit
+} stbtt__outline_entry;
+
+typedef struct stbtt__outline_cache
+{
+   int lock;
+   int budget;                        // budget_bytes it was built with
+   int num_chunks, free_chunks, first_free_chunk;
+   int hand, first_free_entry;
+   int *glyph_entry;                  // per glyph: 1 + index of its entry, or 0
+   int *chunk_next;                   // next chunk in an outline's chain or the free list, or -1
+   stbtt__outline_entry *entries;     // num_chunks of them, since every outline takes a chunk
+   stbtt_vertex *chunks;              // num_chunks * STBTT__CHUNK_VERTICES
+} stbtt__outline_cache;
+
+static void stbtt__outline_cache_lock(stbtt__outline_cache *c)
+{
+   while (!stbtt__atomic_cas(&c->lock, 0, 1))
+      ;
+}
+
+static void stbtt__outline_cache_unlock(stbtt__outline_cache *c)
+{
+   stbtt__atomic_store(&c->lock, 0);
+}
+
+STBTT_DEF int stbtt_BuildOutlineCache(stbtt_fontinfo *info, int budget_bytes)
+{
+   stbtt__outline_cache *c;
+   int i, n, per_chunk = STBTT__CHUNK_VERTICES * sizeof(stbtt_vertex) + sizeof(int) + sizeof(stbtt__outline_entry);
+
+   if (info->outlines)
+      return 1;
+   if (info->numGlyphs <= 0)
+      return 0;
+   n = (budget_bytes - (int) sizeof(*c) - info->numGlyphs * (int) sizeof(int)) / per_chunk;
+   if (n < 4)
+      return 0;
+
+   c = (stbtt__outline_cache *) STBTT_malloc(sizeof(*c), info->userdata);
+   if (!c)
+      return 0;
+   c->glyph_entry = (int *) STBTT_malloc(info->numGlyphs * sizeof(int), info->userdata);
+   c->chunk_next = (int *) STBTT_malloc(n * sizeof(int), info->userdata);
+   c->entries = (stbtt__outline_entry *) STBTT_malloc(n * sizeof(stbtt__outline_entry), info->userdata);
+   c->chunks = (stbtt_vertex *) STBTT_malloc(n * STBTT__CHUNK_VERTICES * sizeof(stbtt_vertex), info->userdata);
+   if (!c->glyph_entry || !c->chunk_next || !c->entries || !c->chunks) {
+      STBTT_free(c->glyph_entry, info->userdata);
+      STBTT_free(c->chunk_next, info->userdata);
+      STBTT_free(c->entries, info->userdata);
+      STBTT_free(c->chunks, info->userdata);
+      STBTT_free(c, info->userdata);
+      return 0;
+   }
+
+   STBTT_memset(c->glyph_entry, 0, info->numGlyphs * sizeof(int));
+   for (i=0; i < n; ++i) {
+      c->chunk_next[i] = i+1 < n ? i+1 : -1;
+      c->entries[i].glyph = -1;
+      c->entries[i].first_chunk = i+1 < n ? i+1 : -1;
+      c->entries[i].num_vertices = 0;
+      c->entries[i].referenced = 0;
+   }
+   c->lock = 0;
+   c->budget = budget_bytes;
+   c->num_chunks = c->free_chunks = n;
+   c->first_free_chunk = 0;
+   c->first_free_entry = 0;
+   c->hand = 0;
+   info->outlines = c;
+   return 1;
+}
+
+static void stbtt__free_outline_cache(stbtt__outline_cache *c, void *userdata)
+{
+   STBTT_free(c->glyph_entry, userdata);
+   STBTT_free(c->chunk_next, userdata);
+   STBTT_free(c->entries, userdata);
+   STBTT_free(c->chunks, userdata);
+   STBTT_free(c, userdata);
+}
+
+static void stbtt__outline_cache_copy(stbtt__outline_cache *c, stbtt__outline_entry *e, stbtt_vertex *out)
+{
+   int k = e->first_chunk, i;
+   for (i=0; i < e->num_vertices; i += STBTT__CHUNK_VERTICES) {
+      int n = e->num_vertices - i < STBTT__CHUNK_VERTICES ? e->num_vertices - i : STBTT__CHUNK_VERTICES;
+      STBTT_memcpy(out + i, c->chunks + k * STBTT__CHUNK_VERTICES, n * sizeof(stbtt_vertex));
+      k = c->chunk_next[k];
+   }
+}
+
+// Copies the cached outline of 'glyph' into buffer if it fits, otherwise
+// (if pvertices isn't NULL) into a new allocation. *pvertices is set to the
+// one used. Returns the number of vertices, or -1 if it isn't cached.
+static int stbtt__outline_cache_get(const stbtt_fontinfo *info, int glyph, stbtt_vertex *buffer, int buffer_size, stbtt_vertex **pvertices)
+{
+   stbtt__outline_cache *c = info->outlines;
+   stbtt__outline_entry *e;
+   stbtt_vertex *heap;
+   int n;
+
+   if (glyph < 0 || glyph >= info->numGlyphs)
+      return -1;
+   stbtt__outline_cache_lock(c);
+   if (c->glyph_entry[glyph] == 0) {
+      stbtt__outline_cache_unlock(c);
+      return -1;
+   }
+   e = &c->entries[c->glyph_entry[glyph] - 1];
+   n = e->num_vertices;
+   if (n <= buffer_size) {
+      e->referenced = 1;
+      stbtt__outline_cache_copy(c, e, buffer);
+      stbtt__outline_cache_unlock(c);
+      if (pvertices) *pvertices = buffer;
+      return n;
+   }
+   stbtt__outline_cache_unlock(c);
+   if (!pvertices)
+      return -1;
+
+   // don't allocate while holding the lock; the entry may be gone after
+   heap = (stbtt_vertex *) STBTT_malloc(n * sizeof(stbtt_vertex), info->userdata);
+   if (!heap)
+      return -1;
+   stbtt__outline_cache_lock(c);
+   if (c->glyph_entry[glyph] == 0 || c->entries[c->glyph_entry[glyph] - 1].num_vertices != n) {
+      stbtt__outline_cache_unlock(c);
+      STBTT_free(heap, info->userdata);
+      return -1;
+   }
+   e = &c->entries[c->glyph_entry[glyph] - 1];
+   e->referenced = 1;
+   stbtt__outline_cache_copy(c, e, heap);
+   stbtt__outline_cache_unlock(c);
+   *pvertices = heap;
+   return n;
+}
+
+static void stbtt__outline_cache_evict(stbtt__outline_cache *c, int i)
+{
+   stbtt__outline_entry *e = &c->entries[i];
+   int k = e->first_chunk;
+   while (k >= 0) {
+      int next = c->chunk_next[k];
+      c->chunk_next[k] = c->first_free_chunk;
+      c->first_free_chunk = k;
+      ++c->free_chunks;
+      k = next;
+   }
+   c->glyph_entry[e->glyph] = 0;
+   e->glyph = -1;
+   e->first_chunk = c->first_free_entry;
+   c->first_free_entry = i;
+}
+
+static void stbtt__outline_cache_put(const stbtt_fontinfo *info, int glyph, const stbtt_vertex *vertices, int num_vertices)
+{
+   stbtt__outline_cache *c = info->outlines;
+   int need = (num_vertices + STBTT__CHUNK_VERTICES-1) / STBTT__CHUNK_VERTICES, i, k, *link;
+   stbtt__outline_entry *e;
+
+   // empty glyphs are cheap to decode, and a quarter of the cache is the
+   // most one outline may take
+   if (glyph < 0 || glyph >= info->numGlyphs || num_vertices <= 0 || need > c->num_chunks / 4)
+      return;
+
+   stbtt__outline_cache_lock(c);
+   if (c->glyph_entry[glyph]) { // another thread got here first
+      stbtt__outline_cache_unlock(c);
+      return;
+   }
+   // CLOCK: evict outlines that haven't been used since the hand last
+   // passed them until there's room
+   while (c->free_chunks < need) {
+      e = &c->entries[c->hand];
+      if (e->glyph >= 0) {
+         if (e->referenced)
+            e->referenced = 0;
+         else
+            stbtt__outline_cache_evict(c, c->hand);
+      }
+      c->hand = c->hand+1 < c->num_chunks ? c->hand+1 : 0;
+   }
+
+   i = c->first_free_entry;
+   e = &c->entries[i];
+   c->first_free_entry = e->first_chunk;
+   e->glyph = glyph;
+   e->num_vertices = num_vertices;
+   e->referenced = 0;
+   link = &e->first_chunk;
+   for (k=0; k < num_vertices; k += STBTT__CHUNK_VERTICES) {
+      int chunk = c->first_free_chunk, n = num_vertices - k < STBTT__CHUNK_VERTICES ? num_vertices - k : STBTT__CHUNK_VERTICES;
+      c->first_free_chunk = c->chunk_next[chunk];
+      --c->free_chunks;
+      STBTT_memcpy(c->chunks + chunk * STBTT__CHUNK_VERTICES, vertices + k, n * sizeof(stbtt_vertex));
+      *link = chunk;
+      link = &c->chunk_next[chunk];
+   }
+   *link = -1;
+   c->glyph_entry[glyph] = i+1;
+   stbtt__outline_cache_unlock(c);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// variable fonts, see stbtt_SetVariationCoords
+//
+
+// gvar deltas for up to this many points are worked out on the stack
+#define STBTT__GVAR_STACK  64
+
+typedef struct
+{
+   stbtt_int16 *coords;               // normalized, after 'avar', as F2Dot14
+   struct stbtt__outline_cache *outlines; // its caches, while another instance is selected
+   struct stbtt__boxtable *boxes;
+   stbtt_int16 *hmetrics;
+   unsigned int used;                 // when it was last selected
+} stbtt__var_instance;
+
+typedef struct stbtt__var
+{
+   int num_axes;
+   stbtt_uint8 *gvar, *hvar;          // NULL if the font doesn't have them or they're unusable
+   stbtt_uint32 gvar_len, hvar_len;
+   stbtt_uint32 hvar_store, hvar_regions; // offsets in 'HVAR'
+   int num_shared, num_regions;
+   float *shared_scalars;             // per gvar shared tuple, for the selected instance
+   float *region_scalars;             // per HVAR variation region
+   int active;                        // whether the selected instance isn't the default one
+   int current, num_instances;
+   unsigned int clock;
+   stbtt__var_instance instances[STBTT_MAX_VAR_INSTANCES];
+   stbtt_int16 *pending;              // the coordinates being selected
+} stbtt__var;
+
+#define stbtt__gvar_active(info)  ((info)->var && (info)->var->active && (info)->var->gvar)
+
+// whether an instance other than the default one is selected
+static int stbtt__var_selected(const stbtt_fontinfo *info)
+{
+   return info->var && info->var->active;
+}
+
+// like stbtt__get_table, but NULL unless the table is inside the buffer
+static stbtt_uint8 *stbtt__var_table(const stbtt_fontinfo *info, const char *tag, stbtt_uint32 *length)
+{
+   stbtt_uint32 t = stbtt__get_table(info, tag, length);
+   if (!t || !stbtt__fits(t, *length, info->dsize)) {
+      *length = 0;
+      return NULL;
+   }
+   return info->data + t;
+}
+
+// returns the axis records of 'fvar', and sets *num_axes and the size of a record
+static stbtt_uint8 *stbtt__fvar_axes(const stbtt_fontinfo *info, int *num_axes, int *stride)
+{
+   stbtt_uint32 len, axes;
+   stbtt_uint8 *fvar = stbtt__var_table(info, "fvar", &len);
+
+   *num_axes = 0;
+   if (!fvar || len < 16 || ttUSHORT(fvar) != 1)
+      return NULL;
+   axes = ttUSHORT(fvar + 4);
+   *stride = ttUSHORT(fvar + 10);
+   if (*stride < 20 || axes > len || ttUSHORT(fvar + 8) > (len - axes) / *stride)
+      return NULL;
+   *num_axes = ttUSHORT(fvar + 8);
+   return fvar + axes;
+}
+
+STBTT_DEF int stbtt_GetNumVariationAxes(const stbtt_fontinfo *info)
+{
+   int n, stride;
+   stbtt__fvar_axes(info, &n, &stride);
+   return n;
+}
+
+STBTT_DEF int stbtt_GetVariationAxis(const stbtt_fontinfo *info, int axis, char *tag, float *min_value, float *default_value, float *max_value)
+{
+   int n, stride;
+   stbtt_uint8 *a = stbtt__fvar_axes(info, &n, &stride);
+   if (axis < 0 || axis >= n)
+      return 0;
+   a += axis * stride;
+   if (tag)           STBTT_memcpy(tag, a, 4);
+   if (min_value)     *min_value     = ttLONG(a +  4) / 65536.0f;
+   if (default_value) *default_value = ttLONG(a +  8) / 65536.0f;
+   if (max_value)     *max_value     = ttLONG(a + 12) / 65536.0f;
+   return 1;
+}
+
+STBTT_DEF float stbtt_NormalizeVariationCoord(const stbtt_fontinfo *info, int axis, float value)
+{
+   float lo, def, hi;
+   if (!stbtt_GetVariationAxis(info, axis, NULL, &lo, &def, &hi))
+      return 0;
+   if (value < lo) value = lo;
+   if (value > hi) value = hi;
+   if (value < def)
+      return (value - def) / (def - lo);
+   if (value > def)
+      return (value - def) / (hi - def);
+   return 0;
+}
+
+// maps normalized coordinate v of an axis through its 'avar' segment map
+static float stbtt__avar_map(stbtt_uint8 *avar, stbtt_uint32 len, int axis, float v)
+{
+   stbtt_uint32 p = 8;
+   stbtt_uint8 *map;
+   int i, n;
+
+   if (!avar || len < 8 || ttUSHORT(avar) != 1 || axis >= ttUSHORT(avar + 6))
+      return v;
+   for (i=0; i < axis; ++i) {
+      if (!stbtt__fits(p, 2, len))
+         return v;
+      p += 2 + 4 * ttUSHORT(avar + p);
+   }
+   if (!stbtt__fits(p, 2, len) || !stbtt__fits(p + 2, 4 * ttUSHORT(avar + p), len))
+      return v;
+   n = ttUSHORT(avar + p);
+   map = avar + p + 2;
+   if (n == 0)
+      return v;
+
+   #define STBTT__AVAR_FROM(i)  (ttSHORT(map + 4*(i)) / 16384.0f)
+   #define STBTT__AVAR_TO(i)    (ttSHORT(map + 4*(i) + 2) / 16384.0f)
+   if (v <= STBTT__AVAR_FROM(0))
+      return v + STBTT__AVAR_TO(0) - STBTT__AVAR_FROM(0);
+   for (i=1; i < n; ++i) {
+      float from0 = STBTT__AVAR_FROM(i-1), from1 = STBTT__AVAR_FROM(i);
+      if (v <= from1) {
+         if (from1 == from0)
+            return STBTT__AVAR_TO(i);
+         return STBTT__AVAR_TO(i-1) + (v - from0) * (STBTT__AVAR_TO(i) - STBTT__AVAR_TO(i-1)) / (from1 - from0);
+      }
+   }
+   return v + STBTT__AVAR_TO(n-1) - STBTT__AVAR_FROM(n-1);
+   #undef STBTT__AVAR_FROM
+   #undef STBTT__AVAR_TO
+}
+
+// the scalar of one axis of a variation region at normalized coordinate v,
+// all in F2Dot14; axes with an invalid range don't restrict the region
+static float stbtt__var_axis_scalar(int v, int start, int peak, int end)
+{
+   if (peak == 0 || start > peak || peak > end || (start < 0 && end > 0))
+      return 1;
+   if (v == peak)
+      return 1;
+   if (v <= start || v >= end)
+      return 0;
+   if (v < peak)
+      return (float) (v - start) / (float) (peak - start);
+   return (float) (end - v) / (float) (end - peak);
+}
+
+// the scalar of a gvar tuple for the selected instance; start and end are
+// NULL unless it has an intermediate region
+static float stbtt__gvar_tuple_scalar(const stbtt__var *var, stbtt_uint8 *peak, stbtt_uint8 *start, stbtt_uint8 *end)
+{
+   const stbtt_int16 *coords = var->instances[var->current].coords;
+   float scalar = 1;
+   int i;
+   for (i=0; i < var->num_axes && scalar != 0; ++i) {
+      int p = ttSHORT(peak + 2*i), s, e;
+      if (start) {
+         s = ttSHORT(start + 2*i);
+         e = ttSHORT(end + 2*i);
+      } else {
+         s = p < 0 ? p : 0;
+         e = p > 0 ? p : 0;
+      }
+      scalar *= stbtt__var_axis_scalar(coords[i], s, p, e);
+   }
+   return scalar;
+}
+
+// checks that the 'gvar' header has num_axes axes, and that its shared
+// tuples and glyph offsets are inside it
+static int stbtt__gvar_valid(stbtt_uint8 *gvar, stbtt_uint32 len, int num_axes)
+{
+   stbtt_uint32 shared;
+   if (len < 20 || ttUSHORT(gvar) != 1 || ttUSHORT(gvar + 4) != num_axes)
+      return 0;
+   shared = ttULONG(gvar + 8);
+   if (shared > len || ttUSHORT(gvar + 6) > (len - shared) / (2 * num_axes))
+      return 0;
+   return stbtt__fits(20, (ttUSHORT(gvar + 12) + 1) * (ttUSHORT(gvar + 14) & 1 ? 4 : 2), len);
+}
+
+// checks the 'HVAR' header and its variation region list, and sets the
+// offsets of the item variation store and the region list
+static int stbtt__hvar_valid(stbtt__var *var, stbtt_uint8 *hvar, stbtt_uint32 len)
+{
+   stbtt_uint32 store, regions;
+   if (len < 20 || ttUSHORT(hvar) != 1)
+      return 0;
+   store = ttULONG(hvar + 4);
+   if (!stbtt__fits(store, 8, len) || ttUSHORT(hvar + store) != 1)
+      return 0;
+   regions = ttULONG(hvar + store + 2);
+   if (regions > len - store || !stbtt__fits(store + regions, 4, len))
+      return 0;
+   regions += store;
+   if (ttUSHORT(hvar + regions) != var->num_axes || ttUSHORT(hvar + regions + 2) > (len - regions - 4) / (6 * var->num_axes))
+      return 0;
+   var->hvar_store = store;
+   var->hvar_regions = regions;
+   return 1;
+}
+
+static stbtt__var *stbtt__var_create(const stbtt_fontinfo *info)
+{
+   stbtt__var *var, v;
+   stbtt_uint8 *gvar, *hvar;
+   stbtt_uint32 gvar_len, hvar_len;
+   stbtt_int16 *coords;
+   int stride, k;
+   size_t size;
+
+   STBTT_memset(&v, 0, sizeof(v));
+   if (!stbtt__fvar_axes(info, &v.num_axes, &stride) || v.num_axes == 0)
+      return NULL;
+   gvar = stbtt__var_table(info, "gvar", &gvar_len);
+   if (gvar && !info->cff.size && stbtt__gvar_valid(gvar, gvar_len, v.num_axes)) {
+      v.gvar = gvar;
+      v.gvar_len = gvar_len;
+      v.num_shared = ttUSHORT(gvar + 6);
+   }
+   hvar = stbtt__var_table(info, "HVAR", &hvar_len);
+   if (hvar && stbtt__hvar_valid(&v, hvar, hvar_len)) {
+      v.hvar = hvar;
+      v.hvar_len = hvar_len;
+      v.num_regions = ttUSHORT(hvar + v.hvar_regions + 2);
+   }
+
+   size = sizeof(v) + (v.num_shared + v.num_regions) * sizeof(float) + (STBTT_MAX_VAR_INSTANCES + 1) * v.num_axes * sizeof(stbtt_int16);
+   var = (stbtt__var *) STBTT_malloc(size, info->userdata);
+   if (!var)
+      return NULL;
+   *var = v;
+   var->shared_scalars = (float *) (var+1);
+   var->region_scalars = var->shared_scalars + v.num_shared;
+   coords = (stbtt_int16 *) (var->region_scalars + v.num_regions);
+   STBTT_memset(coords, 0, (STBTT_MAX_VAR_INSTANCES + 1) * v.num_axes * sizeof(stbtt_int16));
+   for (k=0; k < STBTT_MAX_VAR_INSTANCES; ++k)
+      var->instances[k].coords = coords + k * v.num_axes;
+   var->pending = coords + STBTT_MAX_VAR_INSTANCES * v.num_axes;
+   var->num_instances = 1; // the default one
+   return var;
+}
+
+// recomputes what depends on the coordinates of the selected instance
+static void stbtt__var_update(stbtt__var *var)
+{
+   const stbtt_int16 *coords = var->instances[var->current].coords;
+   int i, j;
+
+   var->active = 0;
+   for (i=0; i < var->num_axes; ++i)
+      if (coords[i])
+         var->active = 1;
+   for (i=0; i < var->num_shared; ++i)
+      var->shared_scalars[i] = stbtt__gvar_tuple_scalar(var, var->gvar + ttULONG(var->gvar + 8) + 2 * var->num_axes * i, NULL, NULL);
+   for (i=0; i < var->num_regions; ++i) {
+      stbtt_uint8 *r = var->hvar + var->hvar_regions + 4 + 6 * var->num_axes * i;
+      float scalar = 1;
+      for (j=0; j < var->num_axes; ++j, r += 6)
+         scalar *= stbtt__var_axis_scalar(coords[j], ttSHORT(r), ttSHORT(r+2), ttSHORT(r+4));
+      var->region_scalars[i] = scalar;
+   }
+}
+
+static void stbtt__var_free_instance(stbtt_fontinfo *info, stbtt__var_instance *inst)
+{
+   if (inst->outlines)
+      stbtt__free_outline_cache(inst->outlines, info->userdata);
+   if (inst->boxes)
+      STBTT_free(inst->boxes, info->userdata);
+   if (inst->hmetrics)
+      STBTT_free(inst->hmetrics, info->userdata);
+   inst->outlines = NULL;
+   inst->boxes = NULL;
+   inst->hmetrics = NULL;
+}
+
+static void stbtt__free_var(stbtt_fontinfo *info)
+{
+   int k;
+   for (k=0; k < info->var->num_instances; ++k)
+      stbtt__var_free_instance(info, &info->var->instances[k]);
+   STBTT_free(info->var, info->userdata);
+   info->var = NULL;
+}
+
+STBTT_DEF int stbtt_SetVariationCoords(stbtt_fontinfo *info, const float *coords, int num_coords)
+{
+   stbtt__var *var = info->var;
+   stbtt__var_instance *inst;
+   stbtt_uint8 *avar;
+   stbtt_uint32 avar_len;
+   int i, k, found = -1, budget, boxes, hmetrics;
+
+   if (!var && !(var = info->var = stbtt__var_create(info)))
+      return 0;
+
+   avar = stbtt__var_table(info, "avar", &avar_len);
+   for (i=0; i < var->num_axes; ++i) {
+      float v = i < num_coords ? coords[i] : 0;
+      v = v < -1 ? -1 : v > 1 ? 1 : v;
+      v = stbtt__avar_map(avar, avar_len, i, v);
+      v = v < -1 ? -1 : v > 1 ? 1 : v;
+      var->pending[i] = (stbtt_int16) STBTT_ifloor(v * 16384 + 0.5f);
+   }
+   for (k=0; k < var->num_instances && found < 0; ++k) {
+      for (i=0; i < var->num_axes && var->instances[k].coords[i] == var->pending[i]; ++i)
+         ;
+      if (i == var->num_axes)
+         found = k;
+   }
+   if (found == var->current)
+      return 1;
+
+   // the caches of the instance being left stay with it, and the new one
+   // gets the same kinds
+   inst = &var->instances[var->current];
+   inst->outlines = info->outlines;
+   inst->boxes = info->boxes;
+   inst->hmetrics = info->hmetrics;
+   budget = info->outlines ? info->outlines->budget : 0;
+   boxes = info->boxes != NULL;
+   hmetrics = info->hmetrics != NULL;
+
+   if (found < 0) {
+      if (var->num_instances < STBTT_MAX_VAR_INSTANCES)
+         found = var->num_instances++;
+      else {
+         // replace the instance selected longest ago
+         for (k=0; k < var->num_instances; ++k)
+            if (k != var->current && (found < 0 || var->instances[k].used < var->instances[found].used))
+               found = k;
+         if (found < 0)
+            found = var->current; // STBTT_MAX_VAR_INSTANCES is 1
+         stbtt__var_free_instance(info, &var->instances[found]);
+      }
+      STBTT_memcpy(var->instances[found].coords, var->pending, var->num_axes * sizeof(stbtt_int16));
+   }
+
+   inst = &var->instances[found];
+   info->outlines = inst->outlines;
+   info->boxes = inst->boxes;
+   info->hmetrics = inst->hmetrics;
+   inst->outlines = NULL;
+   inst->boxes = NULL;
+   inst->hmetrics = NULL;
+   inst->used = ++var->clock;
+   var->current = found;
+   stbtt__var_update(var);
+
+   if (!info->outlines && budget)
+      stbtt_BuildOutlineCache(info, budget);
+   if (!info->boxes && boxes)
+      stbtt_BuildGlyphBoxTable(info);
+   if (!info->hmetrics && hmetrics)
+      stbtt_BuildHMetricsTable(info);
+   return 1;
+}
+
+// floats of scratch space per point that stbtt__gvar_deltas needs
+#define STBTT__GVAR_WORK 7
+
+// reads the count at the start of packed point numbers into *num, 0 meaning
+// all points; returns 0 if it runs past end
+static int stbtt__gvar_point_count(stbtt_uint8 *data, stbtt_uint32 *pos, stbtt_uint32 end, int *num)
+{
+   stbtt_uint32 p = *pos;
+   if (p >= end)
+      return 0;
+   *num = data[p++];
+   if (*num & 0x80) {
+      if (p >= end)
+         return 0;
+      *num = ((*num & 0x7f) << 8) | data[p++];
+   }
+   *pos = p;
+   return 1;
+}
+
+// unpacks count run-length packed point numbers (if is_points) or deltas
+// from data[*pos..end) into out[]; returns 0 if they run past end
+static int stbtt__gvar_unpack(stbtt_uint8 *data, stbtt_uint32 *pos, stbtt_uint32 end, float *out, int count, int is_points)
+{
+   stbtt_uint32 p = *pos, last = 0;
+   int i;
+   while (count > 0) {
+      int control, run, size;
+      if (p >= end)
+         return 0;
+      control = data[p++];
+      if (is_points) {
+         run = (control & 0x7f) + 1;
+         size = control & 0x80 ? 2 : 1;
+      } else {
+         run = (control & 0x3f) + 1;
+         size = (control & 0xc0) == 0xc0 ? 4 : control & 0x80 ? 0 : control & 0x40 ? 2 : 1;
+      }
+      if (run > count)
+         run = count;
+      if (size && (end - p) / size < (stbtt_uint32) run)
+         return 0;
+      switch (size) {
+         case 0:
+            for (i=0; i < run; ++i) out[i] = 0;
+            break;
+         case 1:
+            if (is_points)
+               for (i=0; i < run; ++i) out[i] = (float) (last += data[p+i]);
+            else
+               for (i=0; i < run; ++i) out[i] = (stbtt_int8) data[p+i];
+            break;
+         case 2:
+            if (is_points)
+               for (i=0; i < run; ++i) out[i] = (float) (last += ttUSHORT(data + p + 2*i));
+            else
+               for (i=0; i < run; ++i) out[i] = ttSHORT(data + p + 2*i);
+            break;
+         default:
+            for (i=0; i < run; ++i) out[i] = (float) ttLONG(data + p + 4*i);
+            break;
+      }
+      p += run * size;
+      out += run;
+      count -= run;
+   }
+   *pos = p;
+   return 1;
+}
+
+// the delta of a point between two reference points, from their
+// coordinates c1, c2 and deltas d1, d2 on one axis
+static float stbtt__gvar_interp(int v, int c1, int c2, float d1, float d2)
+{
+   if (c1 == c2)
+      return d1 == d2 ? d1 : 0;
+   if (c1 > c2) {
+      int c = c1; float d = d1;
+      c1 = c2; d1 = d2;
+      c2 = c;  d2 = d;
+   }
+   if (v <= c1) return d1;
+   if (v >= c2) return d2;
+   return d1 + (v - c1) * (d2 - d1) / (float) (c2 - c1);
+}
+
+// infers the deltas of the points of each contour a tuple leaves out from
+// the nearest points on either side that it has deltas for
+static void stbtt__gvar_infer(const stbtt_vertex *points, int num_points, stbtt_uint8 *end_pts, int num_contours, float *tdx, float *tdy, stbtt_uint8 *touched)
+{
+   int c, start = 0;
+   for (c=0; c < num_contours; ++c, start = ttUSHORT(end_pts + 2*c - 2) + 1) {
+      int end = ttUSHORT(end_pts + 2*c), first, cur, next, i;
+      if (end < start || end >= num_points)
+         break;
+      for (first=start; first <= end && !touched[first]; ++first)
+         ;
+      if (first > end)
+         continue; // no deltas for this contour
+      cur = first;
+      do {
+         next = cur;
+         do next = next == end ? start : next+1; while (!touched[next]);
+         for (i = cur == end ? start : cur+1; i != next; i = i == end ? start : i+1) {
+            tdx[i] = stbtt__gvar_interp(points[i].x, points[cur].x, points[next].x, tdx[cur], tdx[next]);
+            tdy[i] = stbtt__gvar_interp(points[i].y, points[cur].y, points[next].y, tdy[cur], tdy[next]);
+            touched[i] = 1;
+         }
+         cur = next;
+      } while (cur != first);
+   }
+}
+
+// Works out the 'gvar' deltas of the selected instance for the n points of
+// glyph_index, which include the 4 phantom points, into work[0..n) for x
+// and work[n..2n) for y; work must have room for STBTT__GVAR_WORK*n floats.
+// For a simple glyph, points[] are its points as decoded and end_pts its
+// contour ends, which are needed to infer the deltas of points a tuple
+// leaves out; compound glyphs pass NULL. Returns 0 if the glyph has no deltas.
+static int stbtt__gvar_deltas(const stbtt_fontinfo *info, int glyph_index, int n, const stbtt_vertex *points, stbtt_uint8 *end_pts, int num_contours, float *work)
+{
+   stbtt__var *var = info->var;
+   stbtt_uint8 *gvar = var->gvar, *peak, *start, *end;
+   float *dx = work, *dy = work + n, *tdx = work + 2*n, *tdy = work + 3*n, scalar;
+   float *vals = work + 4*n, *pts = work + 5*n;
+   stbtt_uint8 *touched = (stbtt_uint8 *) (work + 6*n);
+   stbtt_uint32 off0, off1, base = ttULONG(gvar + 16), hdr, shared_points = 0, data, size;
+   int count, t, i, k, axes = var->num_axes, any = 0;
+
+   if (glyph_index < 0 || glyph_index >= ttUSHORT(gvar + 12))
+      return 0;
+   if (ttUSHORT(gvar + 14) & 1) {
+      off0 = ttULONG(gvar + 20 + 4*glyph_index);
+      off1 = ttULONG(gvar + 20 + 4*glyph_index + 4);
+   } else {
+      off0 = ttUSHORT(gvar + 20 + 2*glyph_index) * 2;
+      off1 = ttUSHORT(gvar + 20 + 2*glyph_index + 2) * 2;
+   }
+   if (off1 <= off0 || base > var->gvar_len || off1 > var->gvar_len - base)
+      return 0;
+   gvar += base + off0; // the glyph's variation data
+   size = off1 - off0;
+   if (size < 4 || ttUSHORT(gvar + 2) > size)
+      return 0;
+   count = ttUSHORT(gvar);
+   data = ttUSHORT(gvar + 2);
+   if (count & 0x8000) {
+      int num;
+      shared_points = data;
+      if (!stbtt__gvar_point_count(gvar, &data, size, &num) || num > n)
+         return 0;
+      if (!stbtt__gvar_unpack(gvar, &data, size, pts, num, 1))
+         return 0;
+   }
+   count &= 0x0fff;
+
+   STBTT_memset(dx, 0, 2 * n * sizeof(float));
+   hdr = 4;
+   for (t=0; t < count; ++t) {
+      stbtt_uint32 tuple_size, pos, ppos, pend;
+      int flags, num;
+
+      // the tuple variation header
+      if (size - hdr < 4)
+         break;
+      tuple_size = ttUSHORT(gvar + hdr);
+      flags = ttUSHORT(gvar + hdr + 2);
+      hdr += 4;
+      if (flags & 0x8000) {
+         if (size - hdr < (stbtt_uint32) 2*axes)
+            break;
+         peak = gvar + hdr;
+         hdr += 2*axes;
+      } else {
+         if ((flags & 0x0fff) >= var->num_shared)
+            break;
+         peak = var->gvar + ttULONG(var->gvar + 8) + 2*axes*(flags & 0x0fff);
+      }
+      start = end = NULL;
+      if (flags & 0x4000) {
+         if (size - hdr < (stbtt_uint32) 4*axes)
+            break;
+         start = gvar + hdr;
+         end = gvar + hdr + 2*axes;
+         hdr += 4*axes;
+      }
+      if (tuple_size > size - data)
+         break;
+      pos = data;
+      data += tuple_size;
+
+      if (start || (flags & 0x8000))
+         scalar = stbtt__gvar_tuple_scalar(var, peak, start, end);
+      else
+         scalar = var->shared_scalars[flags & 0x0fff];
+      if (scalar == 0)
+         continue;
+
+      // its serialized data: point numbers, unless shared, then x deltas and y deltas
+      if (flags & 0x2000) {
+         ppos = pos;
+         pend = data;
+      } else if (shared_points) {
+         ppos = shared_points;
+         pend = size;
+      } else
+         break;
+      if (!stbtt__gvar_point_count(gvar, &ppos, pend, &num) || num > n)
+         break;
+      if (!stbtt__gvar_unpack(gvar, &ppos, pend, pts, num, 1))
+         break;
+      if (flags & 0x2000)
+         pos = ppos;
+      if (num == 0) {
+         // all points, in order
+         if (!stbtt__gvar_unpack(gvar, &pos, data, tdx, n, 0) || !stbtt__gvar_unpack(gvar, &pos, data, tdy, n, 0))
+            break;
+         for (i=0; i < n; ++i) {
+            dx[i] += scalar * tdx[i];
+            dy[i] += scalar * tdy[i];
+         }
+         any = 1;
+         continue;
+      }
+
+      STBTT_memset(touched, 0, n);
+      for (k=0; k < 2; ++k) {
+         float *td = k ? tdy : tdx;
+         if (!stbtt__gvar_unpack(gvar, &pos, data, vals, num, 0))
+            break;
+         for (i=0; i < num; ++i)
+            if (pts[i] < n) {
+               td[(int) pts[i]] = vals[i];
+               touched[(int) pts[i]] = 1;
+            }
+      }
+      if (k < 2)
+         break;
+
+      if (points)
+         stbtt__gvar_infer(points, n-4, end_pts, num_contours, tdx, tdy, touched);
+      for (i=0; i < n; ++i)
+         if (touched[i]) {
+            dx[i] += scalar * tdx[i];
+            dy[i] += scalar * tdy[i];
+         }
+      any = 1;
+   }
+   return any;
+}
+
+// adds the 'gvar' deltas of the selected instance to the n points of a
+// simple glyph, decoded into points[]; returns 0 if out of memory
+static int stbtt__gvar_apply(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex *points, int n, stbtt_uint8 *end_pts, int num_contours)
+{
+   float stack[STBTT__GVAR_WORK * STBTT__GVAR_STACK], *work = stack;
+   int i;
+   if (n+4 > STBTT__GVAR_STACK) {
+      work = (float *) STBTT_malloc(STBTT__GVAR_WORK * (n+4) * sizeof(float), info->userdata);
+      if (!work)
+         return 0;
+   }
+   if (stbtt__gvar_deltas(info, glyph_index, n+4, points, end_pts, num_contours, work))
+      for (i=0; i < n; ++i) {
+         points[i].x = (stbtt_vertex_type) (points[i].x + STBTT_ifloor(work[i] + 0.5f));
+         points[i].y = (stbtt_vertex_type) (points[i].y + STBTT_ifloor(work[n+4+i] + 0.5f));
+      }
+   if (work != stack)
+      STBTT_free(work, info->userdata);
+   return 1;
+}
+
+static void stbtt__free_cscache(struct stbtt__cscache *cc, void *userdata);
+static void stbtt__free_kerntable(struct stbtt__kerntable *t, void *userdata);
+static void stbtt__free_gposclasses(struct stbtt__gposclasses *c, void *userdata);
+
+STBTT_DEF void stbtt_FreeFontCaches(stbtt_fontinfo *info)
+{
+   if (info->glyphmap) {
+      STBTT_free(info->glyphmap, info->userdata);
+      info->glyphmap = NULL;
+   }
+   if (info->revmap) {
+      STBTT_free(info->revmap->codepoints, info->userdata);
+      STBTT_free(info->revmap, info->userdata);
+      info->revmap = NULL;
+   }
+   if (info->outlines) {
+      stbtt__free_outline_cache(info->outlines, info->userdata);
+      info->outlines = NULL;
+   }
+   if (info->boxes) {
+      STBTT_free(info->boxes, info->userdata);
+      info->boxes = NULL;
+   }
+   if (info->fdmap) {
+      STBTT_free(info->fdmap, info->userdata);
+      info->fdmap = NULL;
+   }
+   if (info->compiled) {
+      stbtt__free_cscache(info->compiled, info->userdata);
+      info->compiled = NULL;
+   }
+   if (info->hmetrics) {
+      STBTT_free(info->hmetrics, info->userdata);
+      info->hmetrics = NULL;
+   }
+   if (info->kerning) {
+      stbtt__free_kerntable(info->kerning, info->userdata);
+      info->kerning = NULL;
+   }
+   if (info->gposclasses) {
+      stbtt__free_gposclasses(info->gposclasses, info->userdata);
+      info->gposclasses = NULL;
+   }
+   if (info->ascii) {
+      STBTT_free(info->ascii, info->userdata);
+      info->ascii = NULL;
+   }
+   if (info->var)
+      stbtt__free_var(info);
+}
+
+STBTT_DEF int stbtt_GetCodepointShape(const stbtt_fontinfo *info, int unicode_codepoint, stbtt_vertex **vertices)
+{
+   return stbtt_GetGlyphShape(info, stbtt_FindGlyphIndex(info, unicode_codepoint), vertices);
+}
+
+static void stbtt_setvertex(stbtt_vertex *v, stbtt_uint8 type, stbtt_int32 x, stbtt_int32 y, stbtt_int32 cx, stbtt_int32 cy)
+{
+   v->type = type;
+   v->x = (stbtt_int16) x;
+   v->y = (stbtt_int16) y;
+   v->cx = (stbtt_int16) cx;
+   v->cy = (stbtt_int16) cy;
+}
+
+static int stbtt__GetGlyfOffset(const stbtt_fontinfo *info, int glyph_index)
+{
+   int g1,g2;
+
+   STBTT_assert(!info->cff.size);
+
+   if (glyph_index >= info->numGlyphs) return -1; // glyph index out of range
+   if (info->indexToLocFormat >= 2)    return -1; // unknown index->glyph map format
+
+   if (!info->validated) {
+      // make sure the loca entries and the glyph are inside the buffer
+      stbtt_uint32 size = info->indexToLocFormat ? 4 : 2;
+      if (glyph_index < 0 || !stbtt__fits(info->loca + glyph_index * size, 2 * size, info->dsize))
+         return -1;
+   }
+
+   if (info->indexToLocFormat == 0) {
+      g1 = info->glyf + ttUSHORT(info->data + info->loca + glyph_index * 2) * 2;
+      g2 = info->glyf + ttUSHORT(info->data + info->loca + glyph_index * 2 + 2) * 2;
+   } else {
+      g1 = info->glyf + ttULONG (info->data + info->loca + glyph_index * 4);
       g2 = info->glyf + ttULONG (info->data + info->loca + glyph_index * 4 + 4);
    }
 
+   if (!info->validated && (g1 > g2 || !stbtt__fits(g1, g2 - g1, info->dsize)))
+      return -1;
+
    return g1==g2 ? -1 : g1; // if length is 0, return -1
 }
 
 static int stbtt__GetGlyphInfoT2(const stbtt_fontinfo *info, int glyph_index, int *x0, int *y0, int *x1, int *y1);
 
-STBTT_DEF int stbtt_GetGlyphBox(const stbtt_fontinfo *info, int glyph_index, int *x0, int *y0, int *x1, int *y1)
+// the box in the glyph header is the default instance's, so other instances
+// of a variable font take the bounds of the outline's points
+static int stbtt__var_glyph_box(const stbtt_fontinfo *info, int glyph_index, int *box)
+{
+   stbtt_vertex *v;
+   int n = stbtt_GetGlyphShape(info, glyph_index, &v), i;
+   if (n <= 0)
+      return 0;
+   box[0] = box[2] = v[0].x;
+   box[1] = box[3] = v[0].y;
+   for (i=0; i < n; ++i) {
+      int x = v[i].x, y = v[i].y, k;
+      for (k=0; k < 2; ++k) {
+         if (x < box[0]) box[0] = x;
+         if (y < box[1]) box[1] = y;
+         if (x > box[2]) box[2] = x;
+         if (y > box[3]) box[3] = y;
+         if (v[i].type != STBTT_vcurve)
+            break;
+         x = v[i].cx;
+         y = v[i].cy;
+      }
+   }
+   stbtt_FreeShape(info, v);
+   return 1;
+}
+
+// what stbtt_GetGlyphBox and stbtt_IsGlyphEmpty return, without the table;
+// box[] is left alone if there's no box
+static int stbtt__GetGlyphBoxUncached(const stbtt_fontinfo *info, int glyph_index, int *box, int *empty)
 {
    if (info->cff.size) {
-      stbtt__GetGlyphInfoT2(info, glyph_index, x0, y0, x1, y1);
+      *empty = stbtt__GetGlyphInfoT2(info, glyph_index, &box[0], &box[1], &box[2], &box[3]) == 0;
    } else {
       int g = stbtt__GetGlyfOffset(info, glyph_index);
+      *empty = 1;
       if (g < 0) return 0;
 
-      if (x0) *x0 = ttSHORT(info->data + g + 2);
-      if (y0) *y0 = ttSHORT(info->data + g + 4);
-      if (x1) *x1 = ttSHORT(info->data + g + 6);
-      if (y1) *y1 = ttSHORT(info->data + g + 8);
+      *empty = ttSHORT(info->data + g) == 0;
+      if (!*empty && stbtt__gvar_active(info) && stbtt__var_glyph_box(info, glyph_index, box))
+         return 1;
+      box[0] = ttSHORT(info->data + g + 2);
+      box[1] = ttSHORT(info->data + g + 4);
+      box[2] = ttSHORT(info->data + g + 6);
+      box[3] = ttSHORT(info->data + g + 8);
+   }
+   return 1;
+}
+
+#define STBTT__BOX_BUSY   1  // a thread is filling in the entry
+#define STBTT__BOX_KNOWN  2
+#define STBTT__BOX_HAS    4  // stbtt_GetGlyphBox returns 1
+#define STBTT__BOX_EMPTY  8  // stbtt_IsGlyphEmpty returns 1
+
+typedef struct stbtt__boxtable
+{
+   int *state;                        // per glyph: 0 until known, then STBTT__BOX_KNOWN | flags
+   stbtt_int16 *boxes;                // x0,y0,x1,y1 per glyph
+} stbtt__boxtable;
+
+STBTT_DEF int stbtt_BuildGlyphBoxTable(stbtt_fontinfo *info)
+{
+   stbtt__boxtable *t;
+   if (info->boxes)
+      return 1;
+   if (info->numGlyphs <= 0)
+      return 0;
+   t = (stbtt__boxtable *) STBTT_malloc(sizeof(*t) + info->numGlyphs * (sizeof(int) + 4 * sizeof(stbtt_int16)), info->userdata);
+   if (!t)
+      return 0;
+   t->state = (int *) (t+1);
+   t->boxes = (stbtt_int16 *) (t->state + info->numGlyphs);
+   STBTT_memset(t->state, 0, info->numGlyphs * sizeof(int));
+   info->boxes = t;
+   return 1;
+}
+
+// Looks glyph_index up in the box table, filling in its entry the first
+// time. Returns the entry's flags, with the box in box[] if it has one.
+static int stbtt__GetGlyphBoxCached(const stbtt_fontinfo *info, int glyph_index, int *box)
+{
+   stbtt__boxtable *t = info->boxes;
+   stbtt_int16 *b = t->boxes + 4 * glyph_index;
+   int state = stbtt__atomic_load(&t->state[glyph_index]), empty, flags, i;
+
+   if (state & STBTT__BOX_KNOWN) {
+      if (state & STBTT__BOX_HAS)
+         for (i=0; i < 4; ++i)
+            box[i] = b[i];
+      return state;
    }
+
+   flags = STBTT__BOX_KNOWN;
+   if (stbtt__GetGlyphBoxUncached(info, glyph_index, box, &empty))
+      flags |= STBTT__BOX_HAS;
+   if (empty)
+      flags |= STBTT__BOX_EMPTY;
+
+   // if another thread is already filling in the entry, leave it to that one
+   if (state == 0 && stbtt__atomic_cas(&t->state[glyph_index], 0, STBTT__BOX_BUSY)) {
+      int fits = 1;
+      if (flags & STBTT__BOX_HAS)
+         for (i=0; i < 4; ++i) {
+            fits &= box[i] == (stbtt_int16) box[i];
+            b[i] = (stbtt_int16) box[i];
+         }
+      stbtt__atomic_store(&t->state[glyph_index], fits ? flags : 0);
+   }
+   return flags;
+}
+
+STBTT_DEF int stbtt_GetGlyphBox(const stbtt_fontinfo *info, int glyph_index, int *x0, int *y0, int *x1, int *y1)
+{
+   int box[4], has, empty;
+   if (info->boxes && glyph_index >= 0 && glyph_index < info->numGlyphs)
+      has = (stbtt__GetGlyphBoxCached(info, glyph_index, box) & STBTT__BOX_HAS) != 0;
+   else
+      has = stbtt__GetGlyphBoxUncached(info, glyph_index, box, &empty);
+   if (!has) return 0;
+
+   if (x0) *x0 = box[0];
+   if (y0) *y0 = box[1];
+   if (x1) *x1 = box[2];
+   if (y1) *y1 = box[3];
    return 1;
 }
 
@@ -1648,7 +4565,9 @@ STBTT_DEF int stbtt_GetCodepointBox(const stbtt_fontinfo *info, int codepoint, i
 STBTT_DEF int stbtt_IsGlyphEmpty(const stbtt_fontinfo *info, int glyph_index)
 {
    stbtt_int16 numberOfContours;
-   int g;
+   int g, box[4];
+   if (info->boxes && glyph_index >= 0 && glyph_index < info->numGlyphs)
+      return (stbtt__GetGlyphBoxCached(info, glyph_index, box) & STBTT__BOX_EMPTY) != 0;
    if (info->cff.size)
       return stbtt__GetGlyphInfoT2(info, glyph_index, NULL, NULL, NULL, NULL) == 0;
    g = stbtt__GetGlyfOffset(info, glyph_index);
@@ -1673,227 +4592,200 @@ static int stbtt__close_shape(stbtt_vertex *vertices, int num_vertices, int was_
    return num_vertices;
 }
 
-static int stbtt__GetGlyphShapeTT(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
+// the number of vertices stbtt__simple_glyph_shape needs room for; a loose
+// bound on how many it outputs
+static int stbtt__simple_glyph_bound(stbtt_uint8 *glyph)
 {
-   stbtt_int16 numberOfContours;
-   stbtt_uint8 *endPtsOfContours;
-   stbtt_uint8 *data = info->data;
-   stbtt_vertex *vertices=0;
-   int num_vertices=0;
-   int g = stbtt__GetGlyfOffset(info, glyph_index);
-
-   *pvertices = NULL;
-
-   if (g < 0) return 0;
-
-   numberOfContours = ttSHORT(data + g);
-
-   if (numberOfContours > 0) {
-      stbtt_uint8 flags=0,flagcount;
-      stbtt_int32 ins, i,j=0,m,n, next_move, was_off=0, off, start_off=0;
-      stbtt_int32 x,y,cx,cy,sx,sy, scx,scy;
-      stbtt_uint8 *points;
-      endPtsOfContours = (data + g + 10);
-      ins = ttUSHORT(data + g + 10 + numberOfContours * 2);
-      points = data + g + 10 + numberOfContours * 2 + 2 + ins;
-
-      n = 1+ttUSHORT(endPtsOfContours + numberOfContours*2-2);
-
-      m = n + 2*numberOfContours;  // a loose bound on how many vertices we might need
-      vertices = (stbtt_vertex *) STBTT_malloc(m * sizeof(vertices[0]), info->userdata);
-      if (vertices == 0)
-         return 0;
-
-      next_move = 0;
-      flagcount=0;
-
-      // in first pass, we load uninterpreted data into the allocated array
-      // above, shifted to the end of the array so we won't overwrite it when
-      // we create our final data starting from the front
-
-      off = m - n; // starting offset for uninterpreted data, regardless of how m ends up being calculated
-
-      // first load flags
+   stbtt_int16 numberOfContours = ttSHORT(glyph);
+   return 1+ttUSHORT(glyph + 10 + numberOfContours*2-2) + 2*numberOfContours;
+}
 
-      for (i=0; i < n; ++i) {
-         if (flagcount == 0) {
-            flags = *points++;
-            if (flags & 8)
-               flagcount = *points++;
-         } else
-            --flagcount;
-         vertices[off+i].type = flags;
-      }
+// decodes the simple glyph at 'glyph' into m = stbtt__simple_glyph_bound
+// vertices; returns -1 if out of memory
+static int stbtt__simple_glyph_shape(const stbtt_fontinfo *info, int glyph_index, stbtt_uint8 *glyph, stbtt_vertex *vertices, int m)
+{
+   stbtt_uint8 flags=0,flagcount;
+   stbtt_int32 ins, i,j=0,n, next_move, was_off=0, off, start_off=0;
+   int num_vertices;
+   stbtt_int32 x,y,cx,cy,sx,sy, scx,scy;
+   stbtt_int16 numberOfContours = ttSHORT(glyph);
+   stbtt_uint8 *endPtsOfContours = glyph + 10;
+   stbtt_uint8 *points;
+   ins = ttUSHORT(glyph + 10 + numberOfContours * 2);
+   points = glyph + 10 + numberOfContours * 2 + 2 + ins;
+
+   n = 1+ttUSHORT(endPtsOfContours + numberOfContours*2-2);
+
+   next_move = 0;
+   flagcount=0;
+
+   // in first pass, we load uninterpreted data into the vertex array,
+   // shifted to the end of the array so we won't overwrite it when
+   // we create our final data starting from the front
+
+   off = m - n; // starting offset for uninterpreted data, regardless of how m ends up being calculated
+
+   // first load flags
+
+   for (i=0; i < n; ++i) {
+      if (flagcount == 0) {
+         flags = *points++;
+         if (flags & 8)
+            flagcount = *points++;
+      } else
+         --flagcount;
+      vertices[off+i].type = flags;
+   }
 
-      // now load x coordinates
-      x=0;
-      for (i=0; i < n; ++i) {
-         flags = vertices[off+i].type;
-         if (flags & 2) {
-            stbtt_int16 dx = *points++;
-            x += (flags & 16) ? dx : -dx; // ???
-         } else {
-            if (!(flags & 16)) {
-               x = x + (stbtt_int16) (points[0]*256 + points[1]);
-               points += 2;
-            }
+   // now load x coordinates
+   x=0;
+   for (i=0; i < n; ++i) {
+      flags = vertices[off+i].type;
+      if (flags & 2) {
+         stbtt_int16 dx = *points++;
+         x += (flags & 16) ? dx : -dx; // ???
+      } else {
+         if (!(flags & 16)) {
+            x = x + (stbtt_int16) (points[0]*256 + points[1]);
+            points += 2;
          }
-         vertices[off+i].x = (stbtt_int16) x;
       }
+      vertices[off+i].x = (stbtt_int16) x;
+   }
 
-      // now load y coordinates
-      y=0;
-      for (i=0; i < n; ++i) {
-         flags = vertices[off+i].type;
-         if (flags & 4) {
-            stbtt_int16 dy = *points++;
-            y += (flags & 32) ? dy : -dy; // ???
-         } else {
-            if (!(flags & 32)) {
-               y = y + (stbtt_int16) (points[0]*256 + points[1]);
-               points += 2;
-            }
+   // now load y coordinates
+   y=0;
+   for (i=0; i < n; ++i) {
+      flags = vertices[off+i].type;
+      if (flags & 4) {
+         stbtt_int16 dy = *points++;
+         y += (flags & 32) ? dy : -dy; // ???
+      } else {
+         if (!(flags & 32)) {
+            y = y + (stbtt_int16) (points[0]*256 + points[1]);
+            points += 2;
          }
-         vertices[off+i].y = (stbtt_int16) y;
       }
+      vertices[off+i].y = (stbtt_int16) y;
+   }
 
-      // now convert them to our format
-      num_vertices=0;
-      sx = sy = cx = cy = scx = scy = 0;
-      for (i=0; i < n; ++i) {
-         flags = vertices[off+i].type;
-         x     = (stbtt_int16) vertices[off+i].x;
-         y     = (stbtt_int16) vertices[off+i].y;
-
-         if (next_move == i) {
-            if (i != 0)
-               num_vertices = stbtt__close_shape(vertices, num_vertices, was_off, start_off, sx,sy,scx,scy,cx,cy);
-
-            // now start the new one
-            start_off = !(flags & 1);
-            if (start_off) {
-               // if we start off with an off-curve point, then when we need to find a point on the curve
-               // where we can start, and we need to save some state for when we wraparound.
-               scx = x;
-               scy = y;
-               if (!(vertices[off+i+1].type & 1)) {
-                  // next point is also a curve point, so interpolate an on-point curve
-                  sx = (x + (stbtt_int32) vertices[off+i+1].x) >> 1;
-                  sy = (y + (stbtt_int32) vertices[off+i+1].y) >> 1;
-               } else {
-                  // otherwise just use the next point as our start point
-                  sx = (stbtt_int32) vertices[off+i+1].x;
-                  sy = (stbtt_int32) vertices[off+i+1].y;
-                  ++i; // we're using point i+1 as the starting point, so skip it
-               }
+   // move the points to where the selected instance of a variable font has them
+   if (stbtt__gvar_active(info) && !stbtt__gvar_apply(info, glyph_index, vertices + off, n, endPtsOfContours, numberOfContours))
+      return -1;
+
+   // now convert them to our format
+   num_vertices=0;
+   sx = sy = cx = cy = scx = scy = 0;
+   for (i=0; i < n; ++i) {
+      flags = vertices[off+i].type;
+      x     = (stbtt_int16) vertices[off+i].x;
+      y     = (stbtt_int16) vertices[off+i].y;
+
+      if (next_move == i) {
+         if (i != 0)
+            num_vertices = stbtt__close_shape(vertices, num_vertices, was_off, start_off, sx,sy,scx,scy,cx,cy);
+
+         // now start the new one
+         start_off = !(flags & 1);
+         if (start_off) {
+            // if we start off with an off-curve point, then when we need to find a point on the curve
+            // where we can start, and we need to save some state for when we wraparound.
+            scx = x;
+            scy = y;
+            if (!(vertices[off+i+1].type & 1)) {
+               // next point is also a curve point, so interpolate an on-point curve
+               sx = (x + (stbtt_int32) vertices[off+i+1].x) >> 1;
+               sy = (y + (stbtt_int32) vertices[off+i+1].y) >> 1;
             } else {
-               sx = x;
-               sy = y;
+               // otherwise just use the next point as our start point
+               sx = (stbtt_int32) vertices[off+i+1].x;
+               sy = (stbtt_int32) vertices[off+i+1].y;
+               ++i; // we're using point i+1 as the starting point, so skip it
             }
-            stbtt_setvertex(&vertices[num_vertices++], STBTT_vmove,sx,sy,0,0);
-            was_off = 0;
-            next_move = 1 + ttUSHORT(endPtsOfContours+j*2);
-            ++j;
          } else {
-            if (!(flags & 1)) { // if it's a curve
-               if (was_off) // two off-curve control points in a row means interpolate an on-curve midpoint
-                  stbtt_setvertex(&vertices[num_vertices++], STBTT_vcurve, (cx+x)>>1, (cy+y)>>1, cx, cy);
-               cx = x;
-               cy = y;
-               was_off = 1;
-            } else {
-               if (was_off)
-                  stbtt_setvertex(&vertices[num_vertices++], STBTT_vcurve, x,y, cx, cy);
-               else
-                  stbtt_setvertex(&vertices[num_vertices++], STBTT_vline, x,y,0,0);
-               was_off = 0;
-            }
-         }
-      }
-      num_vertices = stbtt__close_shape(vertices, num_vertices, was_off, start_off, sx,sy,scx,scy,cx,cy);
-   } else if (numberOfContours < 0) {
-      // Compound shapes.
-      int more = 1;
-      stbtt_uint8 *comp = data + g + 10;
-      num_vertices = 0;
-      vertices = 0;
-      while (more) {
-         stbtt_uint16 flags, gidx;
-         int comp_num_verts = 0, i;
-         stbtt_vertex *comp_verts = 0, *tmp = 0;
-         float mtx[6] = {1,0,0,1,0,0}, m, n;
-
-         flags = ttSHORT(comp); comp+=2;
-         gidx = ttSHORT(comp); comp+=2;
-
-         if (flags & 2) { // XY values
-            if (flags & 1) { // shorts
-               mtx[4] = ttSHORT(comp); comp+=2;
-               mtx[5] = ttSHORT(comp); comp+=2;
-            } else {
-               mtx[4] = ttCHAR(comp); comp+=1;
-               mtx[5] = ttCHAR(comp); comp+=1;
-            }
-         }
-         else {
-            // @TODO handle matching point
-            STBTT_assert(0);
+            sx = x;
+            sy = y;
          }
-         if (flags & (1<<3)) { // WE_HAVE_A_SCALE
-            mtx[0] = mtx[3] = ttSHORT(comp)/16384.0f; comp+=2;
-            mtx[1] = mtx[2] = 0;
-         } else if (flags & (1<<6)) { // WE_HAVE_AN_X_AND_YSCALE
-            mtx[0] = ttSHORT(comp)/16384.0f; comp+=2;
-            mtx[1] = mtx[2] = 0;
-            mtx[3] = ttSHORT(comp)/16384.0f; comp+=2;
-         } else if (flags & (1<<7)) { // WE_HAVE_A_TWO_BY_TWO
-            mtx[0] = ttSHORT(comp)/16384.0f; comp+=2;
-            mtx[1] = ttSHORT(comp)/16384.0f; comp+=2;
-            mtx[2] = ttSHORT(comp)/16384.0f; comp+=2;
-            mtx[3] = ttSHORT(comp)/16384.0f; comp+=2;
+         stbtt_setvertex(&vertices[num_vertices++], STBTT_vmove,sx,sy,0,0);
+         was_off = 0;
+         next_move = 1 + ttUSHORT(endPtsOfContours+j*2);
+         ++j;
+      } else {
+         if (!(flags & 1)) { // if it's a curve
+            if (was_off) // two off-curve control points in a row means interpolate an on-curve midpoint
+               stbtt_setvertex(&vertices[num_vertices++], STBTT_vcurve, (cx+x)>>1, (cy+y)>>1, cx, cy);
+            cx = x;
+            cy = y;
+            was_off = 1;
+         } else {
+            if (was_off)
+               stbtt_setvertex(&vertices[num_vertices++], STBTT_vcurve, x,y, cx, cy);
+            else
+               stbtt_setvertex(&vertices[num_vertices++], STBTT_vline, x,y,0,0);
+            was_off = 0;
          }
+      }
+   }
+   num_vertices = stbtt__close_shape(vertices, num_vertices, was_off, start_off, sx,sy,scx,scy,cx,cy);
+   return num_vertices;
+}
 
-         // Find transformation scales.
-         m = (float) STBTT_sqrt(mtx[0]*mtx[0] + mtx[1]*mtx[1]);
-         n = (float) STBTT_sqrt(mtx[2]*mtx[2] + mtx[3]*mtx[3]);
-
-         // Get indexed glyph.
-         comp_num_verts = stbtt_GetGlyphShape(info, gidx, &comp_verts);
-         if (comp_num_verts > 0) {
-            // Transform vertices.
-            for (i = 0; i < comp_num_verts; ++i) {
-               stbtt_vertex* v = &comp_verts[i];
-               stbtt_vertex_type x,y;
-               x=v->x; y=v->y;
-               v->x = (stbtt_vertex_type)(m * (mtx[0]*x + mtx[2]*y + mtx[4]));
-               v->y = (stbtt_vertex_type)(n * (mtx[1]*x + mtx[3]*y + mtx[5]));
-               x=v->cx; y=v->cy;
-               v->cx = (stbtt_vertex_type)(m * (mtx[0]*x + mtx[2]*y + mtx[4]));
-               v->cy = (stbtt_vertex_type)(n * (mtx[1]*x + mtx[3]*y + mtx[5]));
-            }
-            // Append vertices.
-            tmp = (stbtt_vertex*)STBTT_malloc((num_vertices+comp_num_verts)*sizeof(stbtt_vertex), info->userdata);
-            if (!tmp) {
-               if (vertices) STBTT_free(vertices, info->userdata);
-               if (comp_verts) STBTT_free(comp_verts, info->userdata);
-               return 0;
-            }
-            if (num_vertices > 0 && vertices) STBTT_memcpy(tmp, vertices, num_vertices*sizeof(stbtt_vertex));
-            STBTT_memcpy(tmp+num_vertices, comp_verts, comp_num_verts*sizeof(stbtt_vertex));
-            if (vertices) STBTT_free(vertices, info->userdata);
-            vertices = tmp;
-            STBTT_free(comp_verts, info->userdata);
-            num_vertices += comp_num_verts;
-         }
-         // More components ?
-         more = flags & (1<<5);
+// reads the compound glyph component at 'comp' and returns the next one
+static stbtt_uint8 *stbtt__compound_component(stbtt_uint8 *comp, stbtt_uint16 *pflags, stbtt_uint16 *pgidx, float mtx[6])
+{
+   stbtt_uint16 flags;
+   mtx[0] = mtx[3] = 1;
+   mtx[1] = mtx[2] = mtx[4] = mtx[5] = 0;
+
+   flags = ttSHORT(comp); comp+=2;
+   *pgidx = ttSHORT(comp); comp+=2;
+   *pflags = flags;
+
+   if (flags & 2) { // XY values
+      if (flags & 1) { // shorts
+         mtx[4] = ttSHORT(comp); comp+=2;
+         mtx[5] = ttSHORT(comp); comp+=2;
+      } else {
+         mtx[4] = ttCHAR(comp); comp+=1;
+         mtx[5] = ttCHAR(comp); comp+=1;
       }
-   } else {
-      // numberOfCounters == 0, do nothing
    }
+   else {
+      // @TODO handle matching point
+      STBTT_assert(0);
+   }
+   if (flags & (1<<3)) { // WE_HAVE_A_SCALE
+      mtx[0] = mtx[3] = ttSHORT(comp)/16384.0f; comp+=2;
+      mtx[1] = mtx[2] = 0;
+   } else if (flags & (1<<6)) { // WE_HAVE_AN_X_AND_YSCALE
+      mtx[0] = ttSHORT(comp)/16384.0f; comp+=2;
+      mtx[1] = mtx[2] = 0;
+      mtx[3] = ttSHORT(comp)/16384.0f; comp+=2;
+   } else if (flags & (1<<7)) { // WE_HAVE_A_TWO_BY_TWO
+      mtx[0] = ttSHORT(comp)/16384.0f; comp+=2;
+      mtx[1] = ttSHORT(comp)/16384.0f; comp+=2;
+      mtx[2] = ttSHORT(comp)/16384.0f; comp+=2;
+      mtx[3] = ttSHORT(comp)/16384.0f; comp+=2;
+   }
+   return comp;
+}
 
-   *pvertices = vertices;
-   return num_vertices;
+static void stbtt__transform_vertices(stbtt_vertex *vertices, int num_vertices, float mtx[6])
+{
+   // Find transformation scales.
+   float m = (float) STBTT_sqrt(mtx[0]*mtx[0] + mtx[1]*mtx[1]);
+   float n = (float) STBTT_sqrt(mtx[2]*mtx[2] + mtx[3]*mtx[3]);
+   int i;
+   for (i = 0; i < num_vertices; ++i) {
+      stbtt_vertex* v = &vertices[i];
+      stbtt_vertex_type x,y;
+      x=v->x; y=v->y;
+      v->x = (stbtt_vertex_type)(m * (mtx[0]*x + mtx[2]*y + mtx[4]));
+      v->y = (stbtt_vertex_type)(n * (mtx[1]*x + mtx[3]*y + mtx[5]));
+      x=v->cx; y=v->cy;
+      v->cx = (stbtt_vertex_type)(m * (mtx[0]*x + mtx[2]*y + mtx[4]));
+      v->cy = (stbtt_vertex_type)(n * (mtx[1]*x + mtx[3]*y + mtx[5]));
+   }
 }
 
 typedef struct
@@ -1906,9 +4798,102 @@ typedef struct
 
    stbtt_vertex *pvertices;
    int num_vertices;
+   int max_vertices;
+   int grow;                          // whether pvertices may move to the heap when full
+   int on_heap;                       // whether it has
+   void *userdata;
+
+   struct stbtt__cscache *record;     // if set, the drawing operations are appended to it
 } stbtt__csctx;
 
-#define STBTT__CSCTX_INIT(bounds) {bounds,0, 0,0, 0,0, 0,0,0,0, NULL, 0}
+#define STBTT__CSCTX_INIT(bounds) {bounds,0, 0,0, 0,0, 0,0,0,0, NULL, 0, 0, 0, 0, NULL, NULL}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// compiled charstrings, see stbtt_CompileGlyphCharstrings
+//
+
+enum {
+   STBTT__CS_MOVE,                    // 2 args
+   STBTT__CS_LINE,                    // 2 args
+   STBTT__CS_CURVE                    // 6 args
+};
+
+typedef struct
+{
+   int first_op, num_ops, first_arg;
+} stbtt__cs_entry;
+
+typedef struct stbtt__cscache
+{
+   int *glyph_entry;                  // per glyph: 1 + index into entries, or 0
+   stbtt__cs_entry *entries;
+   stbtt_uint8 *ops;
+   float *args;
+   int num_entries, max_entries, num_ops, max_ops, num_args, max_args;
+   int failed;                        // out of memory while recording
+   void *userdata;
+} stbtt__cscache;
+
+// makes room for n more elements of the given size, doubling the array
+static int stbtt__cscache_reserve(void **p, int *max, int count, int n, int size, void *userdata)
+{
+   void *q;
+   int new_max = *max ? *max : 64;
+   if (count + n <= *max)
+      return 1;
+   while (new_max < count + n)
+      new_max *= 2;
+   q = STBTT_malloc(new_max * size, userdata);
+   if (!q)
+      return 0;
+   if (*p) {
+      STBTT_memcpy(q, *p, count * size);
+      STBTT_free(*p, userdata);
+   }
+   *p = q;
+   *max = new_max;
+   return 1;
+}
+
+static void stbtt__cscache_record(stbtt__cscache *cc, int op, float a0, float a1, float a2, float a3, float a4, float a5)
+{
+   int n = op == STBTT__CS_CURVE ? 6 : 2;
+   float *a;
+   if (cc->failed
+    || !stbtt__cscache_reserve((void **) &cc->ops, &cc->max_ops, cc->num_ops, 1, sizeof(*cc->ops), cc->userdata)
+    || !stbtt__cscache_reserve((void **) &cc->args, &cc->max_args, cc->num_args, n, sizeof(*cc->args), cc->userdata)) {
+      cc->failed = 1;
+      return;
+   }
+   cc->ops[cc->num_ops++] = (stbtt_uint8) op;
+   a = cc->args + cc->num_args;
+   a[0] = a0; a[1] = a1;
+   if (n == 6) {
+      a[2] = a2; a[3] = a3; a[4] = a4; a[5] = a5;
+   }
+   cc->num_args += n;
+}
+
+// doubles the output buffer; the first one belongs to the caller
+static int stbtt__csctx_grow(stbtt__csctx *c)
+{
+   int max_vertices = c->max_vertices < 32 ? 64 : c->max_vertices * 2;
+   stbtt_vertex *v = NULL;
+   if (c->num_vertices < STBTT__MAX_SHAPE_VERTICES)
+      v = (stbtt_vertex *) STBTT_malloc(max_vertices * sizeof(stbtt_vertex), c->userdata);
+   if (!v) {
+      c->grow = 0; // keep counting, so the caller sees it didn't fit
+      return 0;
+   }
+   STBTT_memcpy(v, c->pvertices, c->num_vertices * sizeof(stbtt_vertex));
+   if (c->on_heap)
+      STBTT_free(c->pvertices, c->userdata);
+   c->pvertices = v;
+   c->max_vertices = max_vertices;
+   c->on_heap = 1;
+   return 1;
+}
 
 static void stbtt__track_vertex(stbtt__csctx *c, stbtt_int32 x, stbtt_int32 y)
 {
@@ -1927,7 +4912,7 @@ static void stbtt__csctx_v(stbtt__csctx *c, stbtt_uint8 type, stbtt_int32 x, stb
          stbtt__track_vertex(c, cx, cy);
          stbtt__track_vertex(c, cx1, cy1);
       }
-   } else {
+   } else if (c->num_vertices < c->max_vertices || (c->grow && stbtt__csctx_grow(c))) {
       stbtt_setvertex(&c->pvertices[c->num_vertices], type, x, y, cx, cy);
       c->pvertices[c->num_vertices].cx1 = (stbtt_int16) cx1;
       c->pvertices[c->num_vertices].cy1 = (stbtt_int16) cy1;
@@ -1943,6 +4928,7 @@ static void stbtt__csctx_close_shape(stbtt__csctx *ctx)
 
 static void stbtt__csctx_rmove_to(stbtt__csctx *ctx, float dx, float dy)
 {
+   if (ctx->record) stbtt__cscache_record(ctx->record, STBTT__CS_MOVE, dx, dy, 0, 0, 0, 0);
    stbtt__csctx_close_shape(ctx);
    ctx->first_x = ctx->x = ctx->x + dx;
    ctx->first_y = ctx->y = ctx->y + dy;
@@ -1951,6 +4937,7 @@ static void stbtt__csctx_rmove_to(stbtt__csctx *ctx, float dx, float dy)
 
 static void stbtt__csctx_rline_to(stbtt__csctx *ctx, float dx, float dy)
 {
+   if (ctx->record) stbtt__cscache_record(ctx->record, STBTT__CS_LINE, dx, dy, 0, 0, 0, 0);
    ctx->x += dx;
    ctx->y += dy;
    stbtt__csctx_v(ctx, STBTT_vline, (int)ctx->x, (int)ctx->y, 0, 0, 0, 0);
@@ -1958,10 +4945,12 @@ static void stbtt__csctx_rline_to(stbtt__csctx *ctx, float dx, float dy)
 
 static void stbtt__csctx_rccurve_to(stbtt__csctx *ctx, float dx1, float dy1, float dx2, float dy2, float dx3, float dy3)
 {
-   float cx1 = ctx->x + dx1;
-   float cy1 = ctx->y + dy1;
-   float cx2 = cx1 + dx2;
-   float cy2 = cy1 + dy2;
+   float cx1, cy1, cx2, cy2;
+   if (ctx->record) stbtt__cscache_record(ctx->record, STBTT__CS_CURVE, dx1, dy1, dx2, dy2, dx3, dy3);
+   cx1 = ctx->x + dx1;
+   cy1 = ctx->y + dy1;
+   cx2 = cx1 + dx2;
+   cy2 = cy1 + dy2;
    ctx->x = cx2 + dx3;
    ctx->y = cy2 + dy3;
    stbtt__csctx_v(ctx, STBTT_vcubic, (int)ctx->x, (int)ctx->y, (int)cx1, (int)cy1, (int)cx2, (int)cy2);
@@ -1981,32 +4970,110 @@ static stbtt__buf stbtt__get_subr(stbtt__buf idx, int n)
    return stbtt__cff_index_get(idx, n);
 }
 
-static stbtt__buf stbtt__cid_get_glyph_subrs(const stbtt_fontinfo *info, int glyph_index)
+typedef struct stbtt__fdmap
 {
-   stbtt__buf fdselect = info->fdselect;
-   int nranges, start, end, v, fmt, fdselector = -1, i;
+   stbtt__buf subrs[257];             // local subrs of each font dict; empty past the last one
+   stbtt_uint16 *fd;                  // per glyph: its font dict, or 256 if FDSelect doesn't cover it (malformed)
+} stbtt__fdmap;
 
+// the font dict FDSelect assigns to glyph_index, or -1
+static int stbtt__fdselect_lookup(stbtt__buf fdselect, int glyph_index)
+{
+   int fmt;
    stbtt__buf_seek(&fdselect, 0);
    fmt = stbtt__buf_get8(&fdselect);
    if (fmt == 0) {
       // untested
-      stbtt__buf_skip(&fdselect, glyph_index);
-      fdselector = stbtt__buf_get8(&fdselect);
-   } else if (fmt == 3) {
-      nranges = stbtt__buf_get16(&fdselect);
-      start = stbtt__buf_get16(&fdselect);
-      for (i = 0; i < nranges; i++) {
-         v = stbtt__buf_get8(&fdselect);
-         end = stbtt__buf_get16(&fdselect);
-         if (glyph_index >= start && glyph_index < end) {
-            fdselector = v;
+      if (glyph_index < 0 || glyph_index >= fdselect.size - 1)
+         return -1;
+      return fdselect.data[1 + glyph_index];
+   } else if (fmt == 3 && fdselect.size >= 5) {
+      // the ranges are sorted, so binary search for the last one starting
+      // at or before glyph_index; each is a 2-byte first glyph and 1-byte
+      // font dict, and a 2-byte sentinel follows them
+      stbtt_uint8 *r = fdselect.data + 3;
+      int lo = 0, hi = stbtt__buf_get16(&fdselect), mid;
+      if (hi > (fdselect.size - 5) / 3)
+         hi = (fdselect.size - 5) / 3;
+      if (hi == 0 || glyph_index < ttUSHORT(r))
+         return -1;
+      while (hi - lo > 1) {
+         mid = (lo + hi) >> 1;
+         if (ttUSHORT(r + 3*mid) <= glyph_index)
+            lo = mid;
+         else
+            hi = mid;
+      }
+      if (glyph_index < ttUSHORT(r + 3*lo + 3))
+         return r[3*lo + 2];
+   }
+   return -1;
+}
+
+STBTT_DEF int stbtt_BuildFDSelectMap(stbtt_fontinfo *info)
+{
+   stbtt__fdmap *m;
+   stbtt__buf fontdicts;
+   int num_fds, i;
+
+   if (info->fdmap)
+      return 1;
+   if (!info->cff.size || !stbtt__cff_resolve(info) || !info->fdselect.size || info->numGlyphs <= 0)
+      return 0;
+
+   m = (stbtt__fdmap *) STBTT_malloc(sizeof(*m) + info->numGlyphs * sizeof(stbtt_uint16), info->userdata);
+   if (!m)
+      return 0;
+   m->fd = (stbtt_uint16 *) (m+1);
+   fontdicts = info->fontdicts;
+   num_fds = stbtt__cff_index_count(&fontdicts);
+   if (num_fds > 256)
+      num_fds = 256;
+   for (i=0; i < 257; ++i)
+      m->subrs[i] = i < num_fds ? stbtt__get_subrs(info->cff, stbtt__cff_index_get(info->fontdicts, i)) : stbtt__new_buf(NULL, 0);
+   for (i=0; i < info->numGlyphs; ++i) {
+      int fd = stbtt__fdselect_lookup(info->fdselect, i);
+      m->fd[i] = (stbtt_uint16) (fd >= 0 && fd < num_fds ? fd : 256);
+   }
+   info->fdmap = m;
+   return 1;
+}
+
+static stbtt__buf stbtt__cid_get_glyph_subrs(const stbtt_fontinfo *info, int glyph_index)
+{
+   stbtt__buf fontdicts = info->fontdicts;
+   int fdselector;
+   if (info->fdmap && glyph_index >= 0 && glyph_index < info->numGlyphs)
+      return info->fdmap->subrs[info->fdmap->fd[glyph_index]];
+   fdselector = stbtt__fdselect_lookup(info->fdselect, glyph_index);
+   if (fdselector < 0 || fdselector >= stbtt__cff_index_count(&fontdicts))
+      return stbtt__new_buf(NULL, 0);
+   return stbtt__get_subrs(info->cff, stbtt__cff_index_get(info->fontdicts, fdselector));
+}
+
+// replays a compiled charstring; it ends the way endchar does
+static int stbtt__run_compiled_charstring(const stbtt__cscache *cc, const stbtt__cs_entry *e, stbtt__csctx *c)
+{
+   const stbtt_uint8 *op = cc->ops + e->first_op, *end = op + e->num_ops;
+   const float *a = cc->args + e->first_arg;
+   for (; op < end; ++op) {
+      switch (*op) {
+         case STBTT__CS_MOVE:
+            stbtt__csctx_rmove_to(c, a[0], a[1]);
+            a += 2;
+            break;
+         case STBTT__CS_LINE:
+            stbtt__csctx_rline_to(c, a[0], a[1]);
+            a += 2;
+            break;
+         default:
+            stbtt__csctx_rccurve_to(c, a[0], a[1], a[2], a[3], a[4], a[5]);
+            a += 6;
             break;
-         }
-         start = end;
       }
    }
-   if (fdselector == -1) stbtt__new_buf(NULL, 0);
-   return stbtt__get_subrs(info->cff, stbtt__cff_index_get(info->fontdicts, fdselector));
+   stbtt__csctx_close_shape(c);
+   return 1;
 }
 
 static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, stbtt__csctx *c)
@@ -2014,51 +5081,94 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
    int in_header = 1, maskbits = 0, subr_stack_height = 0, sp = 0, v, i, b0;
    int has_subrs = 0, clear_stack;
    float s[48];
-   stbtt__buf subr_stack[10], subrs = info->subrs, b;
+   stbtt__buf subr_stack[10], subrs, b;
    float f;
 
 #define STBTT__CSERR(s) (0)
 
+   // with STBTT__COMPUTED_GOTO, each operator jumps straight to a label
+   // inside the switch; 'break' still leaves the switch as usual
+#ifdef STBTT__COMPUTED_GOTO
+#define STBTT__CSOP(n) case n: stbtt__op_##n:
+   static const void *dispatch[32] = {
+      &&stbtt__op_other, &&stbtt__op_0x01, &&stbtt__op_other, &&stbtt__op_0x03,
+      &&stbtt__op_0x04, &&stbtt__op_0x05, &&stbtt__op_0x06, &&stbtt__op_0x07,
+      &&stbtt__op_0x08, &&stbtt__op_other, &&stbtt__op_0x0A, &&stbtt__op_0x0B,
+      &&stbtt__op_0x0C, &&stbtt__op_other, &&stbtt__op_0x0E, &&stbtt__op_other,
+      &&stbtt__op_other, &&stbtt__op_other, &&stbtt__op_0x12, &&stbtt__op_0x13,
+      &&stbtt__op_0x14, &&stbtt__op_0x15, &&stbtt__op_0x16, &&stbtt__op_0x17,
+      &&stbtt__op_0x18, &&stbtt__op_0x19, &&stbtt__op_0x1A, &&stbtt__op_0x1B,
+      &&stbtt__op_other, &&stbtt__op_0x1D, &&stbtt__op_0x1E, &&stbtt__op_0x1F,
+   };
+#else
+#define STBTT__CSOP(n) case n:
+#endif
+
+   if (info->compiled && glyph_index >= 0 && glyph_index < info->numGlyphs && info->compiled->glyph_entry[glyph_index])
+      return stbtt__run_compiled_charstring(info->compiled, &info->compiled->entries[info->compiled->glyph_entry[glyph_index] - 1], c);
+
+   if (!stbtt__cff_resolve(info)) return STBTT__CSERR("bad CFF data");
+   subrs = info->subrs; // only valid once resolved
+
    // this currently ignores the initial width value, which isn't needed if we have hmtx
    b = stbtt__cff_index_get(info->charstrings, glyph_index);
    while (b.cursor < b.size) {
+      b0 = b.data[b.cursor++];
+
+      // most bytes are operands, so push those before dispatching
+      if (b0 >= 32) {
+         if (b0 <= 246)
+            f = (float) (b0 - 139);
+         else if (b0 <= 250)
+            f = (float) ((b0 - 247)*256 + stbtt__buf_get8(&b) + 108);
+         else if (b0 <= 254)
+            f = (float) (-(b0 - 251)*256 - stbtt__buf_get8(&b) - 108);
+         else
+            f = (float)(stbtt_int32)stbtt__buf_get32(&b) / 0x10000;
+         if (sp >= 48) return STBTT__CSERR("push stack overflow");
+         s[sp++] = f;
+         continue;
+      }
+
       i = 0;
       clear_stack = 1;
-      b0 = stbtt__buf_get8(&b);
+#ifdef STBTT__COMPUTED_GOTO
+      goto *dispatch[b0];
+#endif
       switch (b0) {
       // @TODO implement hinting
-      case 0x13: // hintmask
-      case 0x14: // cntrmask
+      STBTT__CSOP(0x13) // hintmask
+      STBTT__CSOP(0x14) // cntrmask
          if (in_header)
             maskbits += (sp / 2); // implicit "vstem"
          in_header = 0;
          stbtt__buf_skip(&b, (maskbits + 7) / 8);
          break;
 
-      case 0x01: // hstem
-      case 0x03: // vstem
-      case 0x12: // hstemhm
-      case 0x17: // vstemhm
+      STBTT__CSOP(0x01) // hstem
+      STBTT__CSOP(0x03) // vstem
+      STBTT__CSOP(0x12) // hstemhm
+      STBTT__CSOP(0x17) // vstemhm
          maskbits += (sp / 2);
          break;
 
-      case 0x15: // rmoveto
+      STBTT__CSOP(0x15) // rmoveto
          in_header = 0;
          if (sp < 2) return STBTT__CSERR("rmoveto stack");
          stbtt__csctx_rmove_to(c, s[sp-2], s[sp-1]);
          break;
-      case 0x04: // vmoveto
+      STBTT__CSOP(0x04) // vmoveto
          in_header = 0;
          if (sp < 1) return STBTT__CSERR("vmoveto stack");
          stbtt__csctx_rmove_to(c, 0, s[sp-1]);
          break;
-      case 0x16: // hmoveto
+      STBTT__CSOP(0x16) // hmoveto
          in_header = 0;
          if (sp < 1) return STBTT__CSERR("hmoveto stack");
          stbtt__csctx_rmove_to(c, s[sp-1], 0);
          break;
 
-      case 0x05: // rlineto
+      STBTT__CSOP(0x05) // rlineto
          if (sp < 2) return STBTT__CSERR("rlineto stack");
          for (; i + 1 < sp; i += 2)
             stbtt__csctx_rline_to(c, s[i], s[i+1]);
@@ -2067,10 +5177,10 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
       // hlineto/vlineto and vhcurveto/hvcurveto alternate horizontal and vertical
       // starting from a different place.
 
-      case 0x07: // vlineto
+      STBTT__CSOP(0x07) // vlineto
          if (sp < 1) return STBTT__CSERR("vlineto stack");
          goto vlineto;
-      case 0x06: // hlineto
+      STBTT__CSOP(0x06) // hlineto
          if (sp < 1) return STBTT__CSERR("hlineto stack");
          for (;;) {
             if (i >= sp) break;
@@ -2083,10 +5193,10 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
          }
          break;
 
-      case 0x1F: // hvcurveto
+      STBTT__CSOP(0x1F) // hvcurveto
          if (sp < 4) return STBTT__CSERR("hvcurveto stack");
          goto hvcurveto;
-      case 0x1E: // vhcurveto
+      STBTT__CSOP(0x1E) // vhcurveto
          if (sp < 4) return STBTT__CSERR("vhcurveto stack");
          for (;;) {
             if (i + 3 >= sp) break;
@@ -2099,13 +5209,13 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
          }
          break;
 
-      case 0x08: // rrcurveto
+      STBTT__CSOP(0x08) // rrcurveto
          if (sp < 6) return STBTT__CSERR("rcurveline stack");
          for (; i + 5 < sp; i += 6)
             stbtt__csctx_rccurve_to(c, s[i], s[i+1], s[i+2], s[i+3], s[i+4], s[i+5]);
          break;
 
-      case 0x18: // rcurveline
+      STBTT__CSOP(0x18) // rcurveline
          if (sp < 8) return STBTT__CSERR("rcurveline stack");
          for (; i + 5 < sp - 2; i += 6)
             stbtt__csctx_rccurve_to(c, s[i], s[i+1], s[i+2], s[i+3], s[i+4], s[i+5]);
@@ -2113,7 +5223,7 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
          stbtt__csctx_rline_to(c, s[i], s[i+1]);
          break;
 
-      case 0x19: // rlinecurve
+      STBTT__CSOP(0x19) // rlinecurve
          if (sp < 8) return STBTT__CSERR("rlinecurve stack");
          for (; i + 1 < sp - 6; i += 2)
             stbtt__csctx_rline_to(c, s[i], s[i+1]);
@@ -2121,8 +5231,8 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
          stbtt__csctx_rccurve_to(c, s[i], s[i+1], s[i+2], s[i+3], s[i+4], s[i+5]);
          break;
 
-      case 0x1A: // vvcurveto
-      case 0x1B: // hhcurveto
+      STBTT__CSOP(0x1A) // vvcurveto
+      STBTT__CSOP(0x1B) // hhcurveto
          if (sp < 4) return STBTT__CSERR("(vv|hh)curveto stack");
          f = 0.0;
          if (sp & 1) { f = s[i]; i++; }
@@ -2135,14 +5245,15 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
          }
          break;
 
-      case 0x0A: // callsubr
+      STBTT__CSOP(0x0A) // callsubr
          if (!has_subrs) {
             if (info->fdselect.size)
                subrs = stbtt__cid_get_glyph_subrs(info, glyph_index);
             has_subrs = 1;
          }
-         // FALLTHROUGH
-      case 0x1D: // callgsubr
+         goto callsubr;
+      STBTT__CSOP(0x1D) // callgsubr
+      callsubr:
          if (sp < 1) return STBTT__CSERR("call(g|)subr stack");
          v = (int) s[--sp];
          if (subr_stack_height >= 10) return STBTT__CSERR("recursion limit");
@@ -2153,17 +5264,17 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
          clear_stack = 0;
          break;
 
-      case 0x0B: // return
+      STBTT__CSOP(0x0B) // return
          if (subr_stack_height <= 0) return STBTT__CSERR("return outside subr");
          b = subr_stack[--subr_stack_height];
          clear_stack = 0;
          break;
 
-      case 0x0E: // endchar
+      STBTT__CSOP(0x0E) // endchar
          stbtt__csctx_close_shape(c);
          return 1;
 
-      case 0x0C: { // two-byte escape
+      STBTT__CSOP(0x0C) { // two-byte escape
          float dx1, dx2, dx3, dx4, dx5, dx6, dy1, dy2, dy3, dy4, dy5, dy6;
          float dx, dy;
          int b1 = stbtt__buf_get8(&b);
@@ -2246,16 +5357,14 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
       } break;
 
       default:
-         if (b0 != 255 && b0 != 28 && b0 < 32)
+#ifdef STBTT__COMPUTED_GOTO
+      stbtt__op_other:
+#endif
+         if (b0 != 28)
             return STBTT__CSERR("reserved operator");
 
-         // push immediate
-         if (b0 == 255) {
-            f = (float)(stbtt_int32)stbtt__buf_get32(&b) / 0x10000;
-         } else {
-            stbtt__buf_skip(&b, -1);
-            f = (float)(stbtt_int16)stbtt__cff_int(&b);
-         }
+         // push shortint
+         f = (float)(stbtt_int16)stbtt__buf_get16(&b);
          if (sp >= 48) return STBTT__CSERR("push stack overflow");
          s[sp++] = f;
          clear_stack = 0;
@@ -2265,26 +5374,108 @@ static int stbtt__run_charstring(const stbtt_fontinfo *info, int glyph_index, st
    }
    return STBTT__CSERR("no endchar");
 
+#undef STBTT__CSOP
 #undef STBTT__CSERR
 }
 
-static int stbtt__GetGlyphShapeT2(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
+static void stbtt__free_cscache(stbtt__cscache *cc, void *userdata)
 {
-   // runs the charstring twice, once to count and once to output (to avoid realloc)
-   stbtt__csctx count_ctx = STBTT__CSCTX_INIT(1);
-   stbtt__csctx output_ctx = STBTT__CSCTX_INIT(0);
-   if (stbtt__run_charstring(info, glyph_index, &count_ctx)) {
-      *pvertices = (stbtt_vertex*)STBTT_malloc(count_ctx.num_vertices*sizeof(stbtt_vertex), info->userdata);
-      output_ctx.pvertices = *pvertices;
-      if (stbtt__run_charstring(info, glyph_index, &output_ctx)) {
-         STBTT_assert(output_ctx.num_vertices == count_ctx.num_vertices);
-         return output_ctx.num_vertices;
+   STBTT_free(cc->glyph_entry, userdata);
+   STBTT_free(cc->entries, userdata);
+   STBTT_free(cc->ops, userdata);
+   STBTT_free(cc->args, userdata);
+   STBTT_free(cc, userdata);
+}
+
+STBTT_DEF int stbtt_CompileGlyphCharstrings(stbtt_fontinfo *info, const int *glyphs, int num_glyphs)
+{
+   stbtt__cscache *cc = info->compiled;
+   int i;
+
+   if (!info->cff.size || info->numGlyphs <= 0)
+      return 0;
+   if (!cc) {
+      cc = (stbtt__cscache *) STBTT_malloc(sizeof(*cc), info->userdata);
+      if (!cc)
+         return 0;
+      STBTT_memset(cc, 0, sizeof(*cc));
+      cc->userdata = info->userdata;
+      cc->glyph_entry = (int *) STBTT_malloc(info->numGlyphs * sizeof(int), info->userdata);
+      if (!cc->glyph_entry) {
+         STBTT_free(cc, info->userdata);
+         return 0;
       }
+      STBTT_memset(cc->glyph_entry, 0, info->numGlyphs * sizeof(int));
+      info->compiled = cc;
    }
-   *pvertices = NULL;
+
+   for (i=0; i < num_glyphs; ++i) {
+      int g = glyphs[i], first_op = cc->num_ops, first_arg = cc->num_args;
+      stbtt__csctx c = STBTT__CSCTX_INIT(1);
+      if (g < 0 || g >= info->numGlyphs || cc->glyph_entry[g])
+         continue;
+      if (!stbtt__cscache_reserve((void **) &cc->entries, &cc->max_entries, cc->num_entries, 1, sizeof(*cc->entries), info->userdata))
+         return 0;
+      c.record = cc;
+      if (!stbtt__run_charstring(info, g, &c) || cc->failed) {
+         // leave glyphs that fail to the interpreter
+         cc->num_ops = first_op;
+         cc->num_args = first_arg;
+         if (cc->failed) {
+            // out of memory; the cache is still consistent, so a later call can retry
+            cc->failed = 0;
+            return 0;
+         }
+         continue;
+      }
+      cc->entries[cc->num_entries].first_op = first_op;
+      cc->entries[cc->num_entries].num_ops = cc->num_ops - first_op;
+      cc->entries[cc->num_entries].first_arg = first_arg;
+      cc->glyph_entry[g] = ++cc->num_entries;
+   }
+   return 1;
+}
+
+// Runs the charstring once, emitting into buffer until it fills up and then
+// into a growing heap allocation. *pvertices is set to the one used.
+static int stbtt__GetGlyphShapeT2Buffered(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex *buffer, int buffer_size, stbtt_vertex **pvertices)
+{
+   stbtt__csctx c = STBTT__CSCTX_INIT(0);
+   c.pvertices = buffer;
+   c.max_vertices = buffer_size;
+   c.grow = 1;
+   c.userdata = info->userdata;
+   *pvertices = buffer;
+   if (stbtt__run_charstring(info, glyph_index, &c) && c.num_vertices <= c.max_vertices) {
+      *pvertices = c.pvertices;
+      return c.num_vertices;
+   }
+   if (c.on_heap)
+      STBTT_free(c.pvertices, info->userdata);
    return 0;
 }
 
+// vertices stbtt__GetGlyphShapeT2 decodes on the stack before moving to the heap
+#define STBTT__CSCTX_STACK  256
+
+static int stbtt__GetGlyphShapeT2(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
+{
+   // most glyphs fit on the stack, and only need copying to the heap
+   stbtt_vertex buffer[STBTT__CSCTX_STACK], *vertices;
+   int num_vertices = stbtt__GetGlyphShapeT2Buffered(info, glyph_index, buffer, STBTT__CSCTX_STACK, &vertices);
+   *pvertices = NULL;
+   if (num_vertices == 0)
+      return 0;
+   if (vertices == buffer) {
+      vertices = (stbtt_vertex *) STBTT_malloc(num_vertices * sizeof(stbtt_vertex), info->userdata);
+      if (!vertices)
+         return 0;
+      STBTT_memcpy(vertices, buffer, num_vertices * sizeof(stbtt_vertex));
+   }
+   *pvertices = vertices;
+   return num_vertices;
+}
+
 static int stbtt__GetGlyphInfoT2(const stbtt_fontinfo *info, int glyph_index, int *x0, int *y0, int *x1, int *y1)
 {
    stbtt__csctx c = STBTT__CSCTX_INIT(1);
@@ -2296,17 +5487,336 @@ static int stbtt__GetGlyphInfoT2(const stbtt_fontinfo *info, int glyph_index, in
    return r ? c.num_vertices : 0;
 }
 
+// compound glyphs add up their components' bounds; returns -1 if the
+// glyph nests too deep or has too many components, so that the whole
+// glyph fails rather than just the component
+static int stbtt__GetGlyphShapeBoundTT(const stbtt_fontinfo *info, int glyph_index, int depth, int *components)
+{
+   stbtt_int16 numberOfContours;
+   int g = stbtt__GetGlyfOffset(info, glyph_index), bound = 0, n;
+
+   if (depth > STBTT_MAX_COMPOUND_DEPTH) return -1;
+   if (g < 0) return 0;
+
+   numberOfContours = ttSHORT(info->data + g);
+   if (numberOfContours > 0)
+      return stbtt__simple_glyph_bound(info->data + g);
+   if (numberOfContours < 0) {
+      stbtt_uint8 *comp = info->data + g + 10;
+      stbtt_uint16 flags, gidx;
+      float mtx[6];
+      do {
+         comp = stbtt__compound_component(comp, &flags, &gidx, mtx);
+         if (++*components > STBTT__MAX_SHAPE_COMPONENTS)
+            return -1;
+         n = stbtt__GetGlyphShapeBoundTT(info, gidx, depth+1, components);
+         if (n < 0)
+            return -1;
+         bound += n;
+         if (bound > STBTT__MAX_SHAPE_VERTICES)
+            return -1;
+      } while (flags & (1<<5));
+   }
+   return bound;
+}
+
+// Sets *offsets to the rounded 'gvar' deltas of the offsets of a compound
+// glyph's num_components components, x then y, to be freed with
+// STBTT_free; NULL if the glyph has none. Returns 0 if out of memory. The
+// work buffer lives here rather than in each frame of the recursion below.
+static STBTT__NOINLINE int stbtt__gvar_component_offsets(const stbtt_fontinfo *info, int glyph_index, int num_components, int **offsets)
+{
+   float stack[STBTT__GVAR_WORK * STBTT__GVAR_STACK], *work = stack;
+   int n = num_components + 4, k, ok = 1;
+
+   *offsets = NULL;
+   if (n > STBTT__GVAR_STACK && !(work = (float *) STBTT_malloc(STBTT__GVAR_WORK * n * sizeof(float), info->userdata)))
+      return 0;
+   if (stbtt__gvar_deltas(info, glyph_index, n, NULL, NULL, 0, work)) {
+      *offsets = (int *) STBTT_malloc(2 * num_components * sizeof(int), info->userdata);
+      if (*offsets) {
+         for (k=0; k < num_components; ++k) {
+            (*offsets)[k] = STBTT_ifloor(work[k] + 0.5f);
+            (*offsets)[num_components+k] = STBTT_ifloor(work[n+k] + 0.5f);
+         }
+      } else {
+         ok = 0;
+      }
+   }
+   if (work != stack)
+      STBTT_free(work, info->userdata);
+   return ok;
+}
+
+// returns -1 if the glyph doesn't fit in max_vertices, or if it nests too
+// deep or has too many components
+static int stbtt__GetGlyphShapeIntoTT(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex *vertices, int max_vertices, int depth, int *components)
+{
+   stbtt_int16 numberOfContours;
+   int g = stbtt__GetGlyfOffset(info, glyph_index), num_vertices = 0;
+
+   if (depth > STBTT_MAX_COMPOUND_DEPTH) return -1;
+   if (g < 0) return 0;
+
+   numberOfContours = ttSHORT(info->data + g);
+   if (numberOfContours > 0) {
+      int m = stbtt__simple_glyph_bound(info->data + g);
+      if (m > max_vertices)
+         return -1;
+      return stbtt__simple_glyph_shape(info, glyph_index, info->data + g, vertices, m);
+   }
+   if (numberOfContours < 0) {
+      // decode each component straight after the previous one, then
+      // transform it in place
+      stbtt_uint8 *comp = info->data + g + 10;
+      stbtt_uint16 flags, gidx;
+      float mtx[6];
+      int num_components = 0, k = 0, *offsets = NULL;
+
+      if (stbtt__gvar_active(info)) {
+         // in a variable font, each component's offset has deltas like a point
+         do {
+            comp = stbtt__compound_component(comp, &flags, &gidx, mtx);
+            ++num_components;
+         } while (flags & (1<<5));
+         comp = info->data + g + 10;
+         if (!stbtt__gvar_component_offsets(info, glyph_index, num_components, &offsets))
+            return -1;
+      }
+      do {
+         int n;
+         comp = stbtt__compound_component(comp, &flags, &gidx, mtx);
+         if (offsets) {
+            mtx[4] += offsets[k];
+            mtx[5] += offsets[num_components+k];
+            ++k;
+         }
+         if (++*components > STBTT__MAX_SHAPE_COMPONENTS) {
+            num_vertices = -1;
+            break;
+         }
+         n = stbtt__GetGlyphShapeIntoTT(info, gidx, vertices + num_vertices, max_vertices - num_vertices, depth+1, components);
+         if (n < 0) {
+            num_vertices = -1;
+            break;
+         }
+         stbtt__transform_vertices(vertices + num_vertices, n, mtx);
+         num_vertices += n;
+      } while (flags & (1<<5));
+      if (offsets)
+         STBTT_free(offsets, info->userdata);
+   }
+   return num_vertices;
+}
+
+// compound glyphs are sized up front, so they go straight into a single
+// allocation however many components they have
+static int stbtt__GetGlyphShapeTT(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
+{
+   int components = 0, bound = stbtt__GetGlyphShapeBoundTT(info, glyph_index, 0, &components), num_vertices;
+   stbtt_vertex *vertices;
+
+   *pvertices = NULL;
+   if (bound <= 0)
+      return 0;
+
+   vertices = (stbtt_vertex *) STBTT_malloc(bound * sizeof(stbtt_vertex), info->userdata);
+   if (vertices == 0)
+      return 0;
+   components = 0;
+   num_vertices = stbtt__GetGlyphShapeIntoTT(info, glyph_index, vertices, bound, 0, &components);
+   if (num_vertices <= 0) {
+      STBTT_free(vertices, info->userdata);
+      return 0;
+   }
+   *pvertices = vertices;
+   return num_vertices;
+}
+
 STBTT_DEF int stbtt_GetGlyphShape(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
 {
+   int n;
+   if (info->outlines && (n = stbtt__outline_cache_get(info, glyph_index, NULL, 0, pvertices)) >= 0)
+      return n;
    if (!info->cff.size)
-      return stbtt__GetGlyphShapeTT(info, glyph_index, pvertices);
+      n = stbtt__GetGlyphShapeTT(info, glyph_index, pvertices);
    else
-      return stbtt__GetGlyphShapeT2(info, glyph_index, pvertices);
+      n = stbtt__GetGlyphShapeT2(info, glyph_index, pvertices);
+   if (info->outlines)
+      stbtt__outline_cache_put(info, glyph_index, *pvertices, n);
+   return n;
 }
 
-STBTT_DEF void stbtt_GetGlyphHMetrics(const stbtt_fontinfo *info, int glyph_index, int *advanceWidth, int *leftSideBearing)
+STBTT_DEF int stbtt_GetGlyphShapeBound(const stbtt_fontinfo *info, int glyph_index)
+{
+   if (!info->cff.size) {
+      int components = 0, bound = stbtt__GetGlyphShapeBoundTT(info, glyph_index, 0, &components);
+      return bound < 0 ? 0 : bound;
+   }
+   if (info->outlines && glyph_index >= 0 && glyph_index < info->numGlyphs) {
+      // the bound is exact for CFF, so a cached outline gives it
+      stbtt__outline_cache *c = info->outlines;
+      int n;
+      stbtt__outline_cache_lock(c);
+      n = c->glyph_entry[glyph_index] ? c->entries[c->glyph_entry[glyph_index] - 1].num_vertices : -1;
+      stbtt__outline_cache_unlock(c);
+      if (n >= 0)
+         return n;
+   }
+   return stbtt__GetGlyphInfoT2(info, glyph_index, NULL, NULL, NULL, NULL);
+}
+
+STBTT_DEF int stbtt_GetGlyphShapeInto(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex *vertices, int max_vertices)
+{
+   int n;
+   if (info->outlines && (n = stbtt__outline_cache_get(info, glyph_index, vertices, max_vertices, NULL)) >= 0)
+      return n;
+   if (!info->cff.size) {
+      int components = 0;
+      n = stbtt__GetGlyphShapeIntoTT(info, glyph_index, vertices, max_vertices, 0, &components);
+      if (n < 0)
+         return 0;
+   } else {
+      stbtt__csctx c = STBTT__CSCTX_INIT(0);
+      c.pvertices = vertices;
+      c.max_vertices = max_vertices;
+      if (!stbtt__run_charstring(info, glyph_index, &c) || c.num_vertices > max_vertices)
+         return 0;
+      n = c.num_vertices;
+   }
+   if (info->outlines)
+      stbtt__outline_cache_put(info, glyph_index, vertices, n);
+   return n;
+}
+
+// the delta 'HVAR' has for glyph_index through the DeltaSetIndexMap at
+// offset 'map', or with glyph ids indexing the store directly if it's 0
+static float stbtt__hvar_delta(const stbtt__var *var, stbtt_uint32 map, int glyph_index)
+{
+   stbtt_uint8 *hvar = var->hvar, *row;
+   stbtt_uint32 len = var->hvar_len, store = var->hvar_store, outer, inner, d, rows;
+   int i, words, regions, long_words, row_size;
+   float delta = 0;
+
+   if (map) {
+      stbtt_uint32 count, e, v = 0;
+      int header, size, format;
+      if (!stbtt__fits(map, 4, len))
+         return 0;
+      format = hvar[map];
+      header = format ? 6 : 4;
+      if (!stbtt__fits(map, header, len))
+         return 0;
+      count = format ? ttULONG(hvar + map + 2) : ttUSHORT(hvar + map + 2);
+      if (format > 1 || count == 0)
+         return 0;
+      e = (stbtt_uint32) glyph_index < count ? (stbtt_uint32) glyph_index : count - 1;
+      size = ((hvar[map+1] >> 4) & 3) + 1;
+      if (e >= (len - map - header) / size)
+         return 0;
+      for (i=0; i < size; ++i)
+         v = (v << 8) | hvar[map + header + e*size + i];
+      outer = v >> ((hvar[map+1] & 15) + 1);
+      inner = v & ((1 << ((hvar[map+1] & 15) + 1)) - 1);
+   } else {
+      outer = 0;
+      inner = glyph_index;
+   }
+
+   // row 'inner' of item variation data 'outer'
+   if (outer >= ttUSHORT(hvar + store + 6) || !stbtt__fits(store + 8 + 4*outer, 4, len))
+      return 0;
+   d = ttULONG(hvar + store + 8 + 4*outer);
+   if (d > len - store || !stbtt__fits(store + d, 6, len))
+      return 0;
+   d += store;
+   words = ttUSHORT(hvar + d + 2);
+   regions = ttUSHORT(hvar + d + 4);
+   long_words = words & 0x8000;
+   words &= 0x7fff;
+   if (inner >= ttUSHORT(hvar + d) || words > regions || !stbtt__fits(d + 6, 2*regions, len))
+      return 0;
+   row_size = long_words ? 4*words + 2*(regions - words) : 2*words + (regions - words);
+   rows = d + 6 + 2*regions;
+   if (row_size == 0 || inner >= (len - rows) / row_size)
+      return 0;
+   row = hvar + rows + inner * row_size;
+   for (i=0; i < regions; ++i) {
+      int r = ttUSHORT(hvar + d + 6 + 2*i), v;
+      if (i < words) {
+         v = long_words ? ttLONG(row) : ttSHORT(row);
+         row += long_words ? 4 : 2;
+      } else {
+         v = long_words ? ttSHORT(row) : (stbtt_int8) *row;
+         row += long_words ? 2 : 1;
+      }
+      if (r < var->num_regions)
+         delta += var->region_scalars[r] * v;
+   }
+   return delta;
+}
+
+// the number of points 'gvar' has deltas for in a glyph: its points, or
+// components if it's a compound glyph, and the 4 phantom points
+static int stbtt__gvar_num_points(const stbtt_fontinfo *info, int glyph_index)
+{
+   int g = stbtt__GetGlyfOffset(info, glyph_index), n = 0;
+   stbtt_int16 numberOfContours;
+   if (g < 0)
+      return 4;
+   numberOfContours = ttSHORT(info->data + g);
+   if (numberOfContours > 0)
+      n = 1 + ttUSHORT(info->data + g + 10 + numberOfContours*2 - 2);
+   if (numberOfContours < 0) {
+      stbtt_uint8 *comp = info->data + g + 10;
+      stbtt_uint16 flags, gidx;
+      float mtx[6];
+      do {
+         comp = stbtt__compound_component(comp, &flags, &gidx, mtx);
+         ++n;
+      } while (flags & (1<<5));
+   }
+   return n + 4;
+}
+
+// adds the deltas of the selected instance of a variable font to a glyph's
+// metrics; without 'HVAR' the advance comes from the phantom points
+static void stbtt__var_hmetrics(const stbtt_fontinfo *info, int glyph_index, int *advanceWidth, int *leftSideBearing)
+{
+   stbtt__var *var = info->var;
+   if (var->hvar) {
+      stbtt_uint32 lsb_map = ttULONG(var->hvar + 12);
+      if (advanceWidth)
+         *advanceWidth += STBTT_ifloor(stbtt__hvar_delta(var, ttULONG(var->hvar + 8), glyph_index) + 0.5f);
+      if (leftSideBearing && lsb_map)
+         *leftSideBearing += STBTT_ifloor(stbtt__hvar_delta(var, lsb_map, glyph_index) + 0.5f);
+   } else if (var->gvar && advanceWidth) {
+      float stack[STBTT__GVAR_WORK * STBTT__GVAR_STACK], *work = stack;
+      int n = stbtt__gvar_num_points(info, glyph_index);
+      if (n > STBTT__GVAR_STACK && !(work = (float *) STBTT_malloc(STBTT__GVAR_WORK * n * sizeof(float), info->userdata)))
+         return;
+      // phantom points 0 and 1 are the glyph's origin and advance
+      if (stbtt__gvar_deltas(info, glyph_index, n, NULL, NULL, 0, work))
+         *advanceWidth += STBTT_ifloor(work[n-3] + 0.5f) - STBTT_ifloor(work[n-4] + 0.5f);
+      if (work != stack)
+         STBTT_free(work, info->userdata);
+   }
+}
+
+// the metrics of the font's default instance, from 'hmtx'
+static void stbtt__GetGlyphHMetricsDefault(const stbtt_fontinfo *info, int glyph_index, int *advanceWidth, int *leftSideBearing)
 {
    stbtt_uint16 numOfLongHorMetrics = ttUSHORT(info->data+info->hhea + 34);
+   if (!info->validated) {
+      // make sure the reads are inside the buffer
+      stbtt_uint32 g = (stbtt_uint32) glyph_index;
+      stbtt_uint32 end = g < numOfLongHorMetrics ? 4*g + 4 : 4*numOfLongHorMetrics + 2*(g - numOfLongHorMetrics) + 2;
+      if (glyph_index < 0 || numOfLongHorMetrics == 0 || !stbtt__fits(info->hmtx, end, info->dsize)) {
+         if (advanceWidth)     *advanceWidth    = 0;
+         if (leftSideBearing)  *leftSideBearing = 0;
+         return;
+      }
+   }
    if (glyph_index < numOfLongHorMetrics) {
       if (advanceWidth)     *advanceWidth    = ttSHORT(info->data + info->hmtx + 4*glyph_index);
       if (leftSideBearing)  *leftSideBearing = ttSHORT(info->data + info->hmtx + 4*glyph_index + 2);
@@ -2316,6 +5826,49 @@ STBTT_DEF void stbtt_GetGlyphHMetrics(const stbtt_fontinfo *info, int glyph_inde
    }
 }
 
+static void stbtt__GetGlyphHMetricsUncached(const stbtt_fontinfo *info, int glyph_index, int *advanceWidth, int *leftSideBearing)
+{
+   stbtt__GetGlyphHMetricsDefault(info, glyph_index, advanceWidth, leftSideBearing);
+   if (info->var && info->var->active)
+      stbtt__var_hmetrics(info, glyph_index, advanceWidth, leftSideBearing);
+}
+
+STBTT_DEF int stbtt_BuildHMetricsTable(stbtt_fontinfo *info)
+{
+   stbtt_int16 *m;
+   int g;
+   if (info->hmetrics)
+      return 1;
+   if (info->numGlyphs <= 0)
+      return 0;
+   m = (stbtt_int16 *) STBTT_malloc(info->numGlyphs * 2 * sizeof(stbtt_int16), info->userdata);
+   if (!m)
+      return 0;
+   for (g=0; g < info->numGlyphs; ++g) {
+      int advance, lsb;
+      stbtt__GetGlyphHMetricsUncached(info, g, &advance, &lsb);
+      if (advance != (stbtt_int16) advance || lsb != (stbtt_int16) lsb) {
+         // a variable font instance that doesn't fit
+         STBTT_free(m, info->userdata);
+         return 0;
+      }
+      m[2*g] = (stbtt_int16) advance;
+      m[2*g+1] = (stbtt_int16) lsb;
+   }
+   info->hmetrics = m;
+   return 1;
+}
+
+STBTT_DEF void stbtt_GetGlyphHMetrics(const stbtt_fontinfo *info, int glyph_index, int *advanceWidth, int *leftSideBearing)
+{
+   if (info->hmetrics && (stbtt_uint32) glyph_index < (stbtt_uint32) info->numGlyphs) {
+      if (advanceWidth)     *advanceWidth    = info->hmetrics[2*glyph_index];
+      if (leftSideBearing)  *leftSideBearing = info->hmetrics[2*glyph_index+1];
+      return;
+   }
+   stbtt__GetGlyphHMetricsUncached(info, glyph_index, advanceWidth, leftSideBearing);
+}
+
 STBTT_DEF int  stbtt_GetKerningTableLength(const stbtt_fontinfo *info)
 {
    stbtt_uint8 *data = info->data + info->kern;
@@ -2492,10 +6045,255 @@ static stbtt_int32  stbtt__GetGlyphClass(stbtt_uint8 *classDefTable, int glyph)
    return 0;
 }
 
+// the x advance of the ValueRecord at v, 0 if its format has none
+static stbtt_int32 stbtt__value_x_advance(stbtt_uint8 *v, stbtt_uint32 format)
+{
+   if (!(format & 4))
+      return 0;
+   return ttSHORT(v + stbtt__value_record_size(format & 3));
+}
+
+// the placement and advance of the ValueRecord at v; the device table
+// offsets that may follow them are skipped
+static void stbtt__value_decode(stbtt_uint8 *v, stbtt_uint32 format, stbtt_glyphpos *pos)
+{
+   pos->x_placement = pos->y_placement = pos->x_advance = pos->y_advance = 0;
+   if (format & 1) { pos->x_placement = ttSHORT(v); v += 2; }
+   if (format & 2) { pos->y_placement = ttSHORT(v); v += 2; }
+   if (format & 4) { pos->x_advance   = ttSHORT(v); v += 2; }
+   if (format & 8) { pos->y_advance   = ttSHORT(v); }
+}
+
+// expanded 'GPOS' coverage and class tables, see stbtt_BuildGPOSClassTables
+
+typedef struct
+{
+   stbtt_uint8 *table;                // the PairPos subtable
+   stbtt_uint32 values;               // size of the two ValueRecords of a pair
+   stbtt_uint16 *coverage;            // coverage index of each glyph, 0xffff if not covered
+   stbtt_uint16 *class1, *class2;     // format 2: class of each glyph, 0xffff if unsupported
+} stbtt__pairpos;
+
+typedef struct stbtt__gposclasses
+{
+   stbtt__pairpos *subtables;         // of all pair adjustment lookups, in lookup order
+   int num_subtables;
+   stbtt_uint16 **arrays;             // the expanded tables, each shared by all subtables that point at it
+   stbtt_uint8 **sources;             // the coverage or class tables they came from
+   int num_arrays;
+} stbtt__gposclasses;
+
+static void stbtt__free_gposclasses(stbtt__gposclasses *c, void *userdata)
+{
+   int k;
+   for (k=0; k < c->num_arrays; ++k)
+      STBTT_free(c->arrays[k], userdata);
+   STBTT_free(c, userdata);
+}
+
+// the expanded form of the coverage table (or class table, if is_class) at
+// t, made the first time a subtable points at it; NULL if out of memory
+static stbtt_uint16 *stbtt__gpos_expand(const stbtt_fontinfo *info, stbtt__gposclasses *c, stbtt_uint8 *t, int is_class)
+{
+   stbtt_uint16 *a;
+   int k, g;
+   for (k=0; k < c->num_arrays; ++k)
+      if (c->sources[k] == t && c->arrays[k][info->numGlyphs] == is_class)
+         return c->arrays[k];
+   a = (stbtt_uint16 *) STBTT_malloc((info->numGlyphs + 1) * sizeof(stbtt_uint16), info->userdata);
+   if (!a)
+      return NULL;
+   for (g=0; g < info->numGlyphs; ++g) {
+      stbtt_int32 v = is_class ? stbtt__GetGlyphClass(t, g) : stbtt__GetCoverageIndex(t, g);
+      a[g] = (stbtt_uint16) (v < 0 ? 0xffff : v > 0xfffe ? 0xfffe : v);
+   }
+   a[info->numGlyphs] = (stbtt_uint16) is_class; // tells the two kinds apart
+   c->sources[c->num_arrays] = t;
+   c->arrays[c->num_arrays++] = a;
+   return a;
+}
+
+STBTT_DEF int stbtt_BuildGPOSClassTables(stbtt_fontinfo *info)
+{
+   stbtt__gposclasses *c;
+   stbtt_uint8 *data = info->data + info->gpos, *list = NULL;
+   int i, j, count = 0, s = 0;
+
+   if (info->gposclasses)
+      return 1;
+   // the tables are read without bounds checks
+   if (!info->gpos || info->numGlyphs <= 0 || !stbtt__validate_gpos(info))
+      return 0;
+
+   if (ttUSHORT(data+0) == 1 && ttUSHORT(data+2) == 0) {
+      list = data + ttUSHORT(data+8);
+      for (i=0; i < ttUSHORT(list); ++i) {
+         stbtt_uint8 *lookup = list + ttUSHORT(list + 2 + 2*i);
+         if (ttUSHORT(lookup) == 2)
+            count += ttUSHORT(lookup + 4);
+      }
+   }
+   c = (stbtt__gposclasses *) STBTT_malloc(sizeof(*c) + count * (sizeof(stbtt__pairpos) + 3 * sizeof(stbtt_uint16 *) + 3 * sizeof(stbtt_uint8 *)), info->userdata);
+   if (!c)
+      return 0;
+   c->subtables = (stbtt__pairpos *) (c + 1);
+   c->arrays = (stbtt_uint16 **) (c->subtables + count);
+   c->sources = (stbtt_uint8 **) (c->arrays + 3*count);
+   c->num_subtables = count;
+   c->num_arrays = 0;
+
+   for (i=0; s < count; ++i) {
+      stbtt_uint8 *lookup = list + ttUSHORT(list + 2 + 2*i);
+      if (ttUSHORT(lookup) != 2)
+         continue;
+      for (j=0; j < ttUSHORT(lookup + 4); ++j, ++s) {
+         stbtt__pairpos *p = &c->subtables[s];
+         p->table = lookup + ttUSHORT(lookup + 6 + 2*j);
+         p->values = stbtt__value_record_size(ttUSHORT(p->table + 4)) + stbtt__value_record_size(ttUSHORT(p->table + 6));
+         p->class1 = p->class2 = NULL;
+         p->coverage = stbtt__gpos_expand(info, c, p->table + ttUSHORT(p->table + 2), 0);
+         if (p->coverage && ttUSHORT(p->table) == 2) {
+            p->class1 = stbtt__gpos_expand(info, c, p->table + ttUSHORT(p->table + 8), 1);
+            p->class2 = stbtt__gpos_expand(info, c, p->table + ttUSHORT(p->table + 10), 1);
+         }
+         if (!p->coverage || (ttUSHORT(p->table) == 2 && (!p->class1 || !p->class2))) {
+            stbtt__free_gposclasses(c, info->userdata);
+            return 0;
+         }
+      }
+   }
+
+   info->gposclasses = c;
+   return 1;
+}
+
+// stbtt__GetGlyphGPOSInfoValues with the expanded tables
+static stbtt_uint8 *stbtt__GetGlyphGPOSClassValues(const stbtt__gposclasses *c, int glyph1, int glyph2, stbtt_uint8 **subtable)
+{
+   int s;
+   for (s=0; s < c->num_subtables; ++s) {
+      const stbtt__pairpos *p = &c->subtables[s];
+      stbtt_uint8 *table = p->table;
+      stbtt_int32 coverageIndex = p->coverage[glyph1];
+      if (coverageIndex == 0xffff) continue;
+      *subtable = table;
+
+      switch (ttUSHORT(table)) {
+         case 1: {
+            stbtt_uint8 *pairValueTable;
+            stbtt_int32 l, r, m;
+            if (coverageIndex >= ttUSHORT(table + 8)) return NULL;
+            pairValueTable = table + ttUSHORT(table + 10 + 2 * coverageIndex);
+            l = 0;
+            r = ttUSHORT(pairValueTable) - 1;
+            while (l <= r) {
+               stbtt_uint8 *pairValue;
+               m = (l + r) >> 1;
+               pairValue = pairValueTable + 2 + (2 + p->values) * m;
+               if (glyph2 < ttUSHORT(pairValue))
+                  r = m - 1;
+               else if (glyph2 > ttUSHORT(pairValue))
+                  l = m + 1;
+               else
+                  return pairValue + 2;
+            }
+            break;
+         }
+
+         case 2: {
+            stbtt_uint32 glyph1class = p->class1[glyph1], glyph2class = p->class2[glyph2];
+            stbtt_uint32 class2Count = ttUSHORT(table + 14);
+            if (glyph1class >= ttUSHORT(table + 12) || glyph2class >= class2Count) return NULL;
+            return table + 16 + p->values * (glyph1class * class2Count + glyph2class);
+         }
+
+         default:
+            return NULL; // Unsupported position format
+      }
+   }
+   return NULL;
+}
+
 // Define to STBTT_assert(x) if you want to break on unimplemented formats.
 #define STBTT_GPOS_TODO_assert(x)
 
-static stbtt_int32 stbtt__GetGlyphGPOSInfoAdvance(const stbtt_fontinfo *info, int glyph1, int glyph2)
+// The ValueRecords (the first glyph's, followed by the second's) of a pair
+// whose left glyph has index coverageIndex in the coverage of the PairPos
+// subtable at table, or NULL if there are none. Sets *done to 0 if the pair
+// isn't in the subtable and the next one should be looked at.
+static stbtt_uint8 *stbtt__GetPairPosValues(stbtt_uint8 *table, stbtt_int32 coverageIndex, int glyph1, int glyph2, int *done)
+{
+   stbtt_uint16 posFormat = ttUSHORT(table);
+   stbtt_uint16 valueFormat1 = ttUSHORT(table + 4);
+   stbtt_uint16 valueFormat2 = ttUSHORT(table + 6);
+   stbtt_int32 valueRecordPairSizeInBytes = stbtt__value_record_size(valueFormat1) + stbtt__value_record_size(valueFormat2);
+   *done = 1;
+   switch (posFormat) {
+      case 1: {
+         stbtt_int32 l, r, m;
+         int straw, needle;
+         stbtt_uint16 pairSetCount = ttUSHORT(table + 8);
+         stbtt_uint16 pairPosOffset;
+         stbtt_uint8 *pairValueTable;
+         stbtt_uint16 pairValueCount;
+         stbtt_uint8 *pairValueArray;
+
+         if (coverageIndex >= pairSetCount) return NULL;
+
+         pairPosOffset = ttUSHORT(table + 10 + 2 * coverageIndex);
+         pairValueTable = table + pairPosOffset;
+         pairValueCount = ttUSHORT(pairValueTable);
+         pairValueArray = pairValueTable + 2;
+
+         needle=glyph2;
+         r=pairValueCount-1;
+         l=0;
+
+         // Binary search.
+         while (l <= r) {
+            stbtt_uint16 secondGlyph;
+            stbtt_uint8 *pairValue;
+            m = (l + r) >> 1;
+            pairValue = pairValueArray + (2 + valueRecordPairSizeInBytes) * m;
+            secondGlyph = ttUSHORT(pairValue);
+            straw = secondGlyph;
+            if (needle < straw)
+               r = m - 1;
+            else if (needle > straw)
+               l = m + 1;
+            else
+               return pairValue + 2;
+         }
+         *done = 0;
+         return NULL;
+      }
+
+      case 2: {
+         stbtt_uint16 classDef1Offset = ttUSHORT(table + 8);
+         stbtt_uint16 classDef2Offset = ttUSHORT(table + 10);
+         int glyph1class = stbtt__GetGlyphClass(table + classDef1Offset, glyph1);
+         int glyph2class = stbtt__GetGlyphClass(table + classDef2Offset, glyph2);
+
+         stbtt_uint16 class1Count = ttUSHORT(table + 12);
+         stbtt_uint16 class2Count = ttUSHORT(table + 14);
+         stbtt_uint8 *class1Records, *class2Records;
+
+         if (glyph1class < 0 || glyph1class >= class1Count) return NULL; // malformed
+         if (glyph2class < 0 || glyph2class >= class2Count) return NULL; // malformed
+
+         class1Records = table + 16;
+         class2Records = class1Records + valueRecordPairSizeInBytes * (glyph1class * class2Count);
+         return class2Records + valueRecordPairSizeInBytes * glyph2class;
+      }
+
+      default:
+         return NULL; // Unsupported position format
+   }
+}
+
+// the ValueRecords of the pair adjustment of glyph1 and glyph2 (see
+// stbtt__GetPairPosValues) and the subtable they're in
+static stbtt_uint8 *stbtt__GetGlyphGPOSInfoValues(const stbtt_fontinfo *info, int glyph1, int glyph2, stbtt_uint8 **subtable)
 {
    stbtt_uint16 lookupListOffset;
    stbtt_uint8 *lookupList;
@@ -2503,12 +6301,14 @@ static stbtt_int32 stbtt__GetGlyphGPOSInfoAdvance(const stbtt_fontinfo *info, in
    stbtt_uint8 *data;
    stbtt_int32 i, sti;
 
-   if (!info->gpos) return 0;
+   if (!info->gpos) return NULL;
+   if (info->gposclasses && (stbtt_uint32) glyph1 < (stbtt_uint32) info->numGlyphs && (stbtt_uint32) glyph2 < (stbtt_uint32) info->numGlyphs)
+      return stbtt__GetGlyphGPOSClassValues(info->gposclasses, glyph1, glyph2, subtable);
 
    data = info->data + info->gpos;
 
-   if (ttUSHORT(data+0) != 1) return 0; // Major version 1
-   if (ttUSHORT(data+2) != 0) return 0; // Minor version 0
+   if (ttUSHORT(data+0) != 1) return NULL; // Major version 1
+   if (ttUSHORT(data+2) != 0) return NULL; // Minor version 0
 
    lookupListOffset = ttUSHORT(data+8);
    lookupList = data + lookupListOffset;
@@ -2527,85 +6327,403 @@ static stbtt_int32 stbtt__GetGlyphGPOSInfoAdvance(const stbtt_fontinfo *info, in
       for (sti=0; sti<subTableCount; sti++) {
          stbtt_uint16 subtableOffset = ttUSHORT(subTableOffsets + 2 * sti);
          stbtt_uint8 *table = lookupTable + subtableOffset;
-         stbtt_uint16 posFormat = ttUSHORT(table);
          stbtt_uint16 coverageOffset = ttUSHORT(table + 2);
          stbtt_int32 coverageIndex = stbtt__GetCoverageIndex(table + coverageOffset, glyph1);
+         stbtt_uint8 *values;
+         int done;
          if (coverageIndex == -1) continue;
 
-         switch (posFormat) {
-            case 1: {
-               stbtt_int32 l, r, m;
-               int straw, needle;
-               stbtt_uint16 valueFormat1 = ttUSHORT(table + 4);
-               stbtt_uint16 valueFormat2 = ttUSHORT(table + 6);
-               if (valueFormat1 == 4 && valueFormat2 == 0) { // Support more formats?
-                  stbtt_int32 valueRecordPairSizeInBytes = 2;
-                  stbtt_uint16 pairSetCount = ttUSHORT(table + 8);
-                  stbtt_uint16 pairPosOffset = ttUSHORT(table + 10 + 2 * coverageIndex);
-                  stbtt_uint8 *pairValueTable = table + pairPosOffset;
-                  stbtt_uint16 pairValueCount = ttUSHORT(pairValueTable);
-                  stbtt_uint8 *pairValueArray = pairValueTable + 2;
-
-                  if (coverageIndex >= pairSetCount) return 0;
-
-                  needle=glyph2;
-                  r=pairValueCount-1;
-                  l=0;
-
-                  // Binary search.
-                  while (l <= r) {
-                     stbtt_uint16 secondGlyph;
-                     stbtt_uint8 *pairValue;
-                     m = (l + r) >> 1;
-                     pairValue = pairValueArray + (2 + valueRecordPairSizeInBytes) * m;
-                     secondGlyph = ttUSHORT(pairValue);
-                     straw = secondGlyph;
-                     if (needle < straw)
-                        r = m - 1;
-                     else if (needle > straw)
-                        l = m + 1;
-                     else {
-                        stbtt_int16 xAdvance = ttSHORT(pairValue + 2);
-                        return xAdvance;
-                     }
-                  }
-               } else
-                  return 0;
-               break;
+         *subtable = table;
+         values = stbtt__GetPairPosValues(table, coverageIndex, glyph1, glyph2, &done);
+         if (done)
+            return values;
+      }
+   }
+
+   return NULL;
+}
+
+static stbtt_int32 stbtt__GetGlyphGPOSInfoAdvance(const stbtt_fontinfo *info, int glyph1, int glyph2)
+{
+   stbtt_uint8 *table, *values = stbtt__GetGlyphGPOSInfoValues(info, glyph1, glyph2, &table);
+   return values ? stbtt__value_x_advance(values, ttUSHORT(table + 4)) : 0;
+}
+// compiled kerning, see stbtt_BuildKerningTable
+
+typedef struct
+{
+   stbtt_uint16 *cls;                 // class of each glyph as the right glyph
+   stbtt_int16 *matrix;               // a row of class2_count adjustments per left class
+   stbtt_glyphpos *pos;               // NULL, or both glyphs' adjustments for each entry of matrix
+   stbtt_uint32 class2_count;
+} stbtt__kernclasses;
+
+typedef struct
+{
+   stbtt_uint32 start;                // its pairs are right/value[start .. start of the next glyph)
+   stbtt_int32 classes, row;          // if classes >= 0, pairs not listed come from this row of it
+} stbtt__kernleft;
+
+typedef struct stbtt__kerntable
+{
+   stbtt__kernleft *left;             // numGlyphs+1 entries
+   stbtt_uint16 *right;               // sorted for each left glyph
+   stbtt_int16 *value;
+   stbtt_glyphpos *pos;               // NULL if no pair adjusts more than value, else two per entry of right
+   stbtt__kernclasses *classes;
+   int num_classes;
+} stbtt__kerntable;
+
+typedef struct
+{
+   const stbtt_fontinfo *info;
+   stbtt__kerntable *t;
+   stbtt_uint32 *mark;                // per left glyph: 1 + the last subtable that covered it, or STBTT__KERN_DONE
+   int fill;                          // second pass: store the pairs instead of counting them
+   int full;                          // some pair adjusts more than the first glyph's x advance
+} stbtt__kern_builder;
+
+#define STBTT__KERN_DONE  0xffffffff
+
+// where the uncompiled lookups' binary search finds key in an array of count
+// entries of stride bytes that start with a 16-bit key (32-bit if wide), so
+// entries of badly sorted arrays it can't find are left out; -1 if nowhere
+static int stbtt__kern_search(stbtt_uint8 *array, int count, int stride, stbtt_uint32 key, int wide)
+{
+   int l = 0, r = count - 1, m;
+   while (l <= r) {
+      stbtt_uint32 straw;
+      m = (l + r) >> 1;
+      straw = wide ? ttULONG(array + stride*m) : ttUSHORT(array + stride*m);
+      if (key < straw)
+         r = m - 1;
+      else if (key > straw)
+         l = m + 1;
+      else
+         return m;
+   }
+   return -1;
+}
+
+// a pair of left glyph g: the right glyph followed by ValueRecords of
+// formats vf1 and vf2
+static void stbtt__kern_add(stbtt__kern_builder *b, int g, stbtt_uint8 *pair, stbtt_uint32 vf1, stbtt_uint32 vf2)
+{
+   stbtt__kerntable *t = b->t;
+   if (!b->fill)
+      ++t->left[g+1].start;
+   else {
+      stbtt_uint32 k = t->left[g].start++;
+      t->right[k] = ttUSHORT(pair);
+      t->value[k] = (stbtt_int16) stbtt__value_x_advance(pair + 2, vf1);
+      if (t->pos) {
+         stbtt__value_decode(pair + 2, vf1, &t->pos[2*k]);
+         stbtt__value_decode(pair + 2 + stbtt__value_record_size(vf1), vf2, &t->pos[2*k+1]);
+      }
+   }
+}
+
+// the class-based subtable at table is the last one that left glyph g looks at
+static void stbtt__kern_classes(stbtt__kern_builder *b, int g, stbtt_uint8 *table, int *classes)
+{
+   stbtt__kerntable *t = b->t;
+   stbtt__kernclasses *c;
+   stbtt_uint32 class1_count = ttUSHORT(table + 12), class2_count = ttUSHORT(table + 14), i, n = b->info->numGlyphs;
+   stbtt_uint32 vf1 = ttUSHORT(table + 4), vf2 = ttUSHORT(table + 6), size1 = stbtt__value_record_size(vf1);
+   stbtt_uint32 size = size1 + stbtt__value_record_size(vf2), cells = class1_count * class2_count;
+   stbtt_int32 class1 = stbtt__GetGlyphClass(table + ttUSHORT(table + 8), g);
+
+   b->mark[g] = STBTT__KERN_DONE;
+   if (class1 < 0 || (stbtt_uint32) class1 >= class1_count)
+      return; // every pair kerns by 0
+   if (*classes < 0) {
+      // the first glyph that uses the subtable expands its right classes and copies its matrix
+      *classes = t->num_classes++;
+      if (b->fill) {
+         c = &t->classes[*classes];
+         c->class2_count = class2_count;
+         c->cls = (stbtt_uint16 *) STBTT_malloc(n * sizeof(stbtt_uint16) + cells * (sizeof(stbtt_int16) + (b->full ? 2 * sizeof(stbtt_glyphpos) : 0)), b->info->userdata);
+         if (!c->cls)
+            return;
+         c->matrix = (stbtt_int16 *) (c->cls + n);
+         c->pos = b->full ? (stbtt_glyphpos *) (c->matrix + cells) : NULL;
+         for (i=0; i < n; ++i) {
+            stbtt_int32 class2 = stbtt__GetGlyphClass(table + ttUSHORT(table + 10), i);
+            c->cls[i] = (stbtt_uint16) (class2 < 0 ? 0xffff : class2);
+         }
+         for (i=0; i < cells; ++i) {
+            stbtt_uint8 *v = table + 16 + size*i;
+            c->matrix[i] = (stbtt_int16) stbtt__value_x_advance(v, vf1);
+            if (c->pos) {
+               stbtt__value_decode(v, vf1, &c->pos[2*i]);
+               stbtt__value_decode(v + size1, vf2, &c->pos[2*i+1]);
             }
+         }
+      }
+   }
+   if (b->fill) {
+      t->left[g].classes = *classes;
+      t->left[g].row = class1 * class2_count;
+   }
+}
 
-            case 2: {
-               stbtt_uint16 valueFormat1 = ttUSHORT(table + 4);
-               stbtt_uint16 valueFormat2 = ttUSHORT(table + 6);
-               if (valueFormat1 == 4 && valueFormat2 == 0) { // Support more formats?
-                  stbtt_uint16 classDef1Offset = ttUSHORT(table + 8);
-                  stbtt_uint16 classDef2Offset = ttUSHORT(table + 10);
-                  int glyph1class = stbtt__GetGlyphClass(table + classDef1Offset, glyph1);
-                  int glyph2class = stbtt__GetGlyphClass(table + classDef2Offset, glyph2);
-
-                  stbtt_uint16 class1Count = ttUSHORT(table + 12);
-                  stbtt_uint16 class2Count = ttUSHORT(table + 14);
-                  stbtt_uint8 *class1Records, *class2Records;
-                  stbtt_int16 xAdvance;
-
-                  if (glyph1class < 0 || glyph1class >= class1Count) return 0; // malformed
-                  if (glyph2class < 0 || glyph2class >= class2Count) return 0; // malformed
-
-                  class1Records = table + 16;
-                  class2Records = class1Records + 2 * (glyph1class * class2Count);
-                  xAdvance = ttSHORT(class2Records + 2 * glyph2class);
-                  return xAdvance;
-               } else
-                  return 0;
-               break;
+// glyph g is covered by subtable number sub, at table, with coverage index
+// index; does what stbtt__GetGlyphGPOSInfoAdvance would do with it
+static void stbtt__kern_pairpos(stbtt__kern_builder *b, stbtt_uint32 sub, stbtt_uint8 *table, int g, int index, int *classes)
+{
+   stbtt_uint16 format = ttUSHORT(table), vf1 = ttUSHORT(table + 4), vf2 = ttUSHORT(table + 6);
+   int stride = 2 + stbtt__value_record_size(vf1) + stbtt__value_record_size(vf2);
+   if (g >= b->info->numGlyphs || b->mark[g] == STBTT__KERN_DONE || b->mark[g] == sub+1)
+      return;
+   if (stbtt__GetCoverageIndex(table + ttUSHORT(table + 2), g) != index)
+      return; // not found there by the uncompiled lookup
+   b->mark[g] = sub+1;
+   if ((format == 1 || format == 2) && (vf1 != 4 || vf2 != 0))
+      b->full = 1;
+   if (format == 1 && index < ttUSHORT(table + 8)) {
+      stbtt_uint8 *set = table + ttUSHORT(table + 10 + 2*index);
+      int i, count = ttUSHORT(set);
+      for (i=0; i < count; ++i)
+         if (stbtt__kern_search(set + 2, count, stride, ttUSHORT(set + 2 + stride*i), 0) == i)
+            stbtt__kern_add(b, g, set + 2 + stride*i, vf1, vf2);
+   } else if (format == 2)
+      stbtt__kern_classes(b, g, table, classes);
+   else
+      b->mark[g] = STBTT__KERN_DONE; // unsupported, so every pair kerns by 0
+}
+
+// one pass over the pairs of the 'GPOS' table (which must be valid) or the
+// 'kern' table, in the order the uncompiled lookups see them
+static void stbtt__kern_walk(stbtt__kern_builder *b)
+{
+   const stbtt_fontinfo *info = b->info;
+   stbtt_uint8 *data;
+   stbtt_uint32 i, j, k, sub = 0;
+
+   if (info->gpos) {
+      stbtt_uint8 *list;
+      data = info->data + info->gpos;
+      if (ttUSHORT(data+0) != 1 || ttUSHORT(data+2) != 0)
+         return;
+      list = data + ttUSHORT(data+8);
+      for (i=0; i < ttUSHORT(list); ++i) {
+         stbtt_uint8 *lookup = list + ttUSHORT(list + 2 + 2*i);
+         if (ttUSHORT(lookup) != 2)
+            continue;
+         for (j=0; j < ttUSHORT(lookup + 4); ++j, ++sub) {
+            stbtt_uint8 *table = lookup + ttUSHORT(lookup + 6 + 2*j), *coverage = table + ttUSHORT(table + 2);
+            stbtt_uint32 count = ttUSHORT(coverage + 2);
+            int classes = -1;
+            if (ttUSHORT(coverage) == 1) {
+               for (k=0; k < count; ++k)
+                  stbtt__kern_pairpos(b, sub, table, ttUSHORT(coverage + 4 + 2*k), k, &classes);
+            } else if (ttUSHORT(coverage) == 2) {
+               for (k=0; k < count; ++k) {
+                  stbtt_uint8 *r = coverage + 4 + 6*k;
+                  stbtt_uint32 g, first = ttUSHORT(r), last = ttUSHORT(r+2);
+                  for (g=first; g <= last; ++g)
+                     stbtt__kern_pairpos(b, sub, table, g, ttUSHORT(r+4) + g - first, &classes);
+               }
             }
+         }
+      }
+   } else if (info->kern) {
+      // we only look at the first table. it must be 'horizontal' and format 0.
+      data = info->data + info->kern;
+      if (ttUSHORT(data+2) < 1 || ttUSHORT(data+8) != 1)
+         return;
+      for (k=0; k < ttUSHORT(data+10); ++k) {
+         stbtt_uint32 g = ttUSHORT(data+18+6*k);
+         if (g < (stbtt_uint32) info->numGlyphs && stbtt__kern_search(data+18, ttUSHORT(data+10), 6, ttULONG(data+18+6*k), 1) == (int) k)
+            stbtt__kern_add(b, g, data+20+6*k, 4, 0); // an x advance, as a ValueRecord
+      }
+   }
+}
 
-            default:
-               return 0; // Unsupported position format
+// sorts n pairs by right glyph, keeping pairs with the same right glyph in
+// order, using tr/tv/tp as scratch space; pos and tp may be NULL
+static void stbtt__kern_sort(stbtt_uint16 *right, stbtt_int16 *value, stbtt_glyphpos *pos, int n, stbtt_uint16 *tr, stbtt_int16 *tv, stbtt_glyphpos *tp)
+{
+   int width, i, a, b, lo, mid, hi;
+   for (i=1; i < n && right[i-1] <= right[i]; ++i)
+      ;
+   if (i >= n)
+      return; // already sorted, as each subtable's pairs are
+   for (width=1; width < n; width *= 2) {
+      for (lo=0; lo < n; lo += 2*width) {
+         mid = lo + width < n ? lo + width : n;
+         hi = lo + 2*width < n ? lo + 2*width : n;
+         for (a=lo, b=mid, i=lo; i < hi; ++i) {
+            int from = a < mid && (b >= hi || right[a] <= right[b]) ? a++ : b++;
+            tr[i] = right[from];
+            tv[i] = value[from];
+            if (pos) {
+               tp[2*i] = pos[2*from];
+               tp[2*i+1] = pos[2*from+1];
+            }
          }
       }
+      STBTT_memcpy(right, tr, n * sizeof(*right));
+      STBTT_memcpy(value, tv, n * sizeof(*value));
+      if (pos)
+         STBTT_memcpy(pos, tp, 2 * n * sizeof(*pos));
+   }
+}
+
+static void stbtt__free_kerntable(stbtt__kerntable *t, void *userdata)
+{
+   int k;
+   for (k=0; k < t->num_classes; ++k)
+      STBTT_free(t->classes[k].cls, userdata);
+   STBTT_free(t->classes, userdata);
+   STBTT_free(t->right, userdata);
+   STBTT_free(t->pos, userdata);
+   STBTT_free(t, userdata);
+}
+
+STBTT_DEF int stbtt_BuildKerningTable(stbtt_fontinfo *info)
+{
+   stbtt__kern_builder b;
+   stbtt__kerntable *t;
+   stbtt_uint32 total, most = 0, w, g, n = info->numGlyphs;
+   int k, num_classes;
+
+   if (info->kerning)
+      return 1;
+   if (info->numGlyphs <= 0)
+      return 0;
+   // the compiler reads the tables without bounds checks
+   if (info->gpos ? !stbtt__validate_gpos(info) : !stbtt__validate_kern(info))
+      return 0;
+
+   t = (stbtt__kerntable *) STBTT_malloc(sizeof(*t) + (n+1) * sizeof(stbtt__kernleft), info->userdata);
+   b.mark = (stbtt_uint32 *) STBTT_malloc(n * sizeof(stbtt_uint32), info->userdata);
+   if (!t || !b.mark) {
+      if (t) STBTT_free(t, info->userdata);
+      if (b.mark) STBTT_free(b.mark, info->userdata);
+      return 0;
+   }
+   STBTT_memset(t, 0, sizeof(*t) + (n+1) * sizeof(stbtt__kernleft));
+   STBTT_memset(b.mark, 0, n * sizeof(stbtt_uint32));
+   t->left = (stbtt__kernleft *) (t + 1);
+   b.info = info;
+   b.t = t;
+   b.full = 0;
+
+   // count the pairs of each left glyph and the class-based subtables used,
+   // then turn the counts into offsets
+   b.fill = 0;
+   stbtt__kern_walk(&b);
+   for (g=0; g < n; ++g) {
+      if (t->left[g+1].start > most)
+         most = t->left[g+1].start;
+      t->left[g+1].start += t->left[g].start;
+      t->left[g].classes = -1;
+   }
+   total = t->left[n].start;
+   num_classes = t->num_classes;
+
+   t->right = (stbtt_uint16 *) STBTT_malloc((total + most) * (sizeof(stbtt_uint16) + sizeof(stbtt_int16)) + 1, info->userdata);
+   t->classes = (stbtt__kernclasses *) STBTT_malloc(num_classes * sizeof(stbtt__kernclasses) + 1, info->userdata);
+   if (b.full)
+      t->pos = (stbtt_glyphpos *) STBTT_malloc((total + most) * 2 * sizeof(stbtt_glyphpos) + 1, info->userdata);
+   t->num_classes = 0;
+   if (!t->right || !t->classes || (b.full && !t->pos)) {
+      STBTT_free(b.mark, info->userdata);
+      stbtt__free_kerntable(t, info->userdata);
+      return 0;
+   }
+   t->value = (stbtt_int16 *) (t->right + total + most);
+
+   // filling in advances left[g].start to the end of glyph g's pairs
+   b.fill = 1;
+   STBTT_memset(b.mark, 0, n * sizeof(stbtt_uint32));
+   stbtt__kern_walk(&b);
+   STBTT_free(b.mark, info->userdata);
+   for (k=0; k < t->num_classes; ++k)
+      if (!t->classes[k].cls) {
+         stbtt__free_kerntable(t, info->userdata);
+         return 0;
+      }
+
+   // sort each glyph's pairs, keeping the first of any with the same right glyph
+   for (g=n; g > 0; --g)
+      t->left[g].start = t->left[g-1].start;
+   t->left[0].start = 0;
+   for (g=0, w=0; g < n; ++g) {
+      stbtt_uint32 s = t->left[g].start, e = t->left[g+1].start, i;
+      stbtt__kern_sort(t->right + s, t->value + s, t->pos ? t->pos + 2*s : NULL, e - s, t->right + total, t->value + total, t->pos ? t->pos + 2*total : NULL);
+      t->left[g].start = w;
+      for (i=s; i < e; ++i)
+         if (i == s || t->right[i] != t->right[i-1]) {
+            if (t->pos) {
+               t->pos[2*w] = t->pos[2*i];
+               t->pos[2*w+1] = t->pos[2*i+1];
+            }
+            t->right[w] = t->right[i];
+            t->value[w++] = t->value[i];
+         }
+   }
+   t->left[n].start = w;
+
+   info->kerning = t;
+   return 1;
+}
+
+static int stbtt__GetGlyphKernTableAdvance(const stbtt__kerntable *t, int glyph1, int glyph2)
+{
+   const stbtt__kernleft *k = &t->left[glyph1];
+   stbtt_int32 l = k[0].start, r = k[1].start - 1, m;
+   while (l <= r) {
+      m = (l + r) >> 1;
+      if (glyph2 < t->right[m])
+         r = m - 1;
+      else if (glyph2 > t->right[m])
+         l = m + 1;
+      else
+         return t->value[m];
+   }
+   if (k->classes >= 0) {
+      const stbtt__kernclasses *c = &t->classes[k->classes];
+      stbtt_uint32 class2 = c->cls[glyph2];
+      if (class2 < c->class2_count)
+         return c->matrix[k->row + class2];
    }
+   return 0;
+}
 
+// stbtt__GetGlyphKernTableAdvance for stbtt_GetGlyphPairPositioning
+static int stbtt__GetGlyphKernTablePositioning(const stbtt__kerntable *t, int glyph1, int glyph2, stbtt_glyphpos *first, stbtt_glyphpos *second)
+{
+   const stbtt__kernleft *k = &t->left[glyph1];
+   stbtt_int32 l = k[0].start, r = k[1].start - 1, m;
+   while (l <= r) {
+      m = (l + r) >> 1;
+      if (glyph2 < t->right[m])
+         r = m - 1;
+      else if (glyph2 > t->right[m])
+         l = m + 1;
+      else {
+         if (t->pos) {
+            *first = t->pos[2*m];
+            *second = t->pos[2*m+1];
+         } else
+            first->x_advance = t->value[m];
+         return 1;
+      }
+   }
+   if (k->classes >= 0) {
+      const stbtt__kernclasses *c = &t->classes[k->classes];
+      stbtt_uint32 class2 = c->cls[glyph2];
+      if (class2 < c->class2_count) {
+         if (c->pos) {
+            *first = c->pos[2*(k->row + class2)];
+            *second = c->pos[2*(k->row + class2)+1];
+         } else
+            first->x_advance = c->matrix[k->row + class2];
+         return 1;
+      }
+   }
    return 0;
 }
 
@@ -2613,6 +6731,8 @@ STBTT_DEF int  stbtt_GetGlyphKernAdvance(const stbtt_fontinfo *info, int g1, int
 {
    int xAdvance = 0;
 
+   if (info->kerning && (stbtt_uint32) g1 < (stbtt_uint32) info->numGlyphs && (stbtt_uint32) g2 < (stbtt_uint32) info->numGlyphs)
+      return stbtt__GetGlyphKernTableAdvance(info->kerning, g1, g2);
    if (info->gpos)
       xAdvance += stbtt__GetGlyphGPOSInfoAdvance(info, g1, g2);
    else if (info->kern)
@@ -2621,6 +6741,136 @@ STBTT_DEF int  stbtt_GetGlyphKernAdvance(const stbtt_fontinfo *info, int g1, int
    return xAdvance;
 }
 
+STBTT_DEF int stbtt_GetGlyphPairPositioning(const stbtt_fontinfo *info, int glyph1, int glyph2, stbtt_glyphpos *first, stbtt_glyphpos *second)
+{
+   stbtt_glyphpos unused1, unused2;
+   if (!first) first = &unused1;
+   if (!second) second = &unused2;
+   STBTT_memset(first, 0, sizeof(*first));
+   STBTT_memset(second, 0, sizeof(*second));
+
+   if (info->kerning && (stbtt_uint32) glyph1 < (stbtt_uint32) info->numGlyphs && (stbtt_uint32) glyph2 < (stbtt_uint32) info->numGlyphs)
+      return stbtt__GetGlyphKernTablePositioning(info->kerning, glyph1, glyph2, first, second);
+   if (info->gpos) {
+      stbtt_uint8 *table, *values = stbtt__GetGlyphGPOSInfoValues(info, glyph1, glyph2, &table);
+      if (!values)
+         return 0;
+      stbtt__value_decode(values, ttUSHORT(table + 4), first);
+      stbtt__value_decode(values + stbtt__value_record_size(ttUSHORT(table + 4)), ttUSHORT(table + 6), second);
+      return 1;
+   } else if (info->kern) {
+      stbtt_uint8 *data = info->data + info->kern;
+      int m;
+      // we only look at the first table. it must be 'horizontal' and format 0.
+      if (ttUSHORT(data+2) < 1 || ttUSHORT(data+8) != 1)
+         return 0;
+      m = stbtt__kern_search(data+18, ttUSHORT(data+10), 6, glyph1 << 16 | glyph2, 1);
+      if (m < 0)
+         return 0;
+      first->x_advance = ttSHORT(data+22+6*m);
+      return 1;
+   }
+   return 0;
+}
+
+// pair adjustment subtables for stbtt__GetGlyphGPOSRunAdvances are parsed
+// on the stack up to this many
+#define STBTT__GPOS_RUN_STACK  64
+
+// stbtt__GetGlyphGPOSInfoAdvance for each pair of a run, with the header and
+// lookup list parsed once
+static void stbtt__GetGlyphGPOSRunAdvances(const stbtt_fontinfo *info, const int *glyphs, int num_glyphs, int *kerning)
+{
+   stbtt_uint8 *stack[2 * STBTT__GPOS_RUN_STACK], **sub = stack; // subtable and coverage table pairs
+   stbtt_uint8 *data = info->data + info->gpos, *list;
+   int count = 0, i, j, s, first = 0, last = -1;
+   stbtt_int32 first_index = -1;
+
+   if (ttUSHORT(data+0) != 1 || ttUSHORT(data+2) != 0) {
+      STBTT_memset(kerning, 0, (num_glyphs - 1) * sizeof(int));
+      return;
+   }
+   list = data + ttUSHORT(data+8);
+   for (i=0; i < ttUSHORT(list); ++i) {
+      stbtt_uint8 *lookup = list + ttUSHORT(list + 2 + 2*i);
+      if (ttUSHORT(lookup) == 2)
+         count += ttUSHORT(lookup + 4);
+   }
+   if (count > STBTT__GPOS_RUN_STACK) {
+      sub = (stbtt_uint8 **) STBTT_malloc(2 * count * sizeof(stbtt_uint8 *), info->userdata);
+      if (!sub) {
+         for (i=0; i+1 < num_glyphs; ++i)
+            kerning[i] = stbtt__GetGlyphGPOSInfoAdvance(info, glyphs[i], glyphs[i+1]);
+         return;
+      }
+   }
+   for (i=0, s=0; s < count; ++i) {
+      stbtt_uint8 *lookup = list + ttUSHORT(list + 2 + 2*i);
+      if (ttUSHORT(lookup) != 2)
+         continue;
+      for (j=0; j < ttUSHORT(lookup + 4); ++j, ++s) {
+         sub[2*s] = lookup + ttUSHORT(lookup + 6 + 2*j);
+         sub[2*s+1] = sub[2*s] + ttUSHORT(sub[2*s] + 2);
+      }
+   }
+
+   for (i=0; i+1 < num_glyphs; ++i) {
+      int g1 = glyphs[i], g2 = glyphs[i+1], done = 0;
+      stbtt_int32 index;
+      if (g1 != last) {
+         // the first subtable that covers the left glyph, which is kept
+         // while the same glyph is on the left, as in a run of spaces
+         for (first=0; first < count; ++first)
+            if ((first_index = stbtt__GetCoverageIndex(sub[2*first+1], g1)) != -1)
+               break;
+         last = g1;
+      }
+      kerning[i] = 0;
+      for (s=first, index=first_index; s < count && !done; ++s) {
+         if (s != first)
+            index = stbtt__GetCoverageIndex(sub[2*s+1], g1);
+         if (index != -1) {
+            stbtt_uint8 *values = stbtt__GetPairPosValues(sub[2*s], index, g1, g2, &done);
+            if (values)
+               kerning[i] = stbtt__value_x_advance(values, ttUSHORT(sub[2*s] + 4));
+         }
+      }
+   }
+   if (sub != stack)
+      STBTT_free(sub, info->userdata);
+}
+
+STBTT_DEF void stbtt_GetGlyphRunKernAdvances(const stbtt_fontinfo *info, const int *glyphs, int num_glyphs, int *kerning)
+{
+   int i;
+   if (num_glyphs < 2)
+      return;
+   if (info->kerning) {
+      stbtt_uint32 n = (stbtt_uint32) info->numGlyphs;
+      for (i=0; i+1 < num_glyphs; ++i)
+         kerning[i] = (stbtt_uint32) glyphs[i] < n && (stbtt_uint32) glyphs[i+1] < n
+                    ? stbtt__GetGlyphKernTableAdvance(info->kerning, glyphs[i], glyphs[i+1])
+                    : stbtt_GetGlyphKernAdvance(info, glyphs[i], glyphs[i+1]);
+   } else if (info->gpos) {
+      if (info->gposclasses) {
+         for (i=0; i+1 < num_glyphs; ++i)
+            kerning[i] = stbtt__GetGlyphGPOSInfoAdvance(info, glyphs[i], glyphs[i+1]);
+      } else
+         stbtt__GetGlyphGPOSRunAdvances(info, glyphs, num_glyphs, kerning);
+   } else {
+      stbtt_uint8 *data = info->data + info->kern;
+      // we only look at the first table. it must be 'horizontal' and format 0.
+      if (!info->kern || ttUSHORT(data+2) < 1 || ttUSHORT(data+8) != 1) {
+         STBTT_memset(kerning, 0, (num_glyphs - 1) * sizeof(int));
+         return;
+      }
+      for (i=0; i+1 < num_glyphs; ++i) {
+         int m = stbtt__kern_search(data+18, ttUSHORT(data+10), 6, glyphs[i] << 16 | glyphs[i+1], 1);
+         kerning[i] = m < 0 ? 0 : ttSHORT(data+22+6*m);
+      }
+   }
+}
+
 STBTT_DEF int  stbtt_GetCodepointKernAdvance(const stbtt_fontinfo *info, int ch1, int ch2)
 {
    if (!info->kern && !info->gpos) // if no kerning table, don't waste time looking up both codepoint->glyphs
@@ -2642,7 +6892,7 @@ STBTT_DEF void stbtt_GetFontVMetrics(const stbtt_fontinfo *info, int *ascent, in
 
 STBTT_DEF int  stbtt_GetFontVMetricsOS2(const stbtt_fontinfo *info, int *typoAscent, int *typoDescent, int *typoLineGap)
 {
-   int tab = stbtt__find_table(info->data, info->fontstart, "OS/2");
+   int tab = stbtt__get_table(info, "OS/2", NULL);
    if (!tab)
       return 0;
    if (typoAscent ) *typoAscent  = ttSHORT(info->data+tab + 68);
@@ -2671,6 +6921,81 @@ STBTT_DEF float stbtt_ScaleForMappingEmToPixels(const stbtt_fontinfo *info, floa
    return pixels / unitsPerEm;
 }
 
+// sized fonts
+
+typedef struct stbtt__sized_kern
+{
+   stbtt_uint32 pair;                 // glyph1 << 16 | glyph2, or 0xffffffff if unused
+   float value;
+} stbtt__sized_kern;
+
+STBTT_DEF int stbtt_InitSizedFont(stbtt_sized_font *sf, const stbtt_fontinfo *info, float size)
+{
+   int ascent, descent, lineGap, i, n = info->numGlyphs > 0 ? info->numGlyphs : 0;
+
+   sf->info = info;
+   sf->scale = size > 0 ? stbtt_ScaleForPixelHeight(info, size) : stbtt_ScaleForMappingEmToPixels(info, -size);
+   stbtt_GetFontVMetrics(info, &ascent, &descent, &lineGap);
+   sf->ascent   = (float) ascent  * sf->scale;
+   sf->descent  = (float) descent * sf->scale;
+   sf->line_gap = (float) lineGap * sf->scale;
+
+   sf->advance = (float *) STBTT_malloc(n * sizeof(float) + (n + 7) / 8 + 1, info->userdata);
+   sf->kern = (stbtt__sized_kern *) STBTT_malloc(STBTT_SIZED_KERN_CACHE * sizeof(stbtt__sized_kern), info->userdata);
+   if (!sf->advance || !sf->kern) {
+      stbtt_FreeSizedFont(sf);
+      return 0;
+   }
+   sf->has_advance = (unsigned char *) (sf->advance + n);
+   STBTT_memset(sf->has_advance, 0, (n + 7) / 8);
+   for (i=0; i < STBTT_SIZED_KERN_CACHE; ++i)
+      sf->kern[i].pair = 0xffffffff;
+   return 1;
+}
+
+STBTT_DEF void stbtt_FreeSizedFont(stbtt_sized_font *sf)
+{
+   if (sf->advance) STBTT_free(sf->advance, sf->info->userdata);
+   if (sf->kern) STBTT_free(sf->kern, sf->info->userdata);
+   sf->advance = NULL;
+   sf->has_advance = NULL;
+   sf->kern = NULL;
+}
+
+STBTT_DEF float stbtt_GetSizedGlyphAdvance(stbtt_sized_font *sf, int glyph_index)
+{
+   int advance;
+   if ((stbtt_uint32) glyph_index >= (stbtt_uint32) sf->info->numGlyphs) {
+      stbtt_GetGlyphHMetrics(sf->info, glyph_index, &advance, NULL);
+      return (float) advance * sf->scale;
+   }
+   if (!(sf->has_advance[glyph_index >> 3] & (1 << (glyph_index & 7)))) {
+      stbtt_GetGlyphHMetrics(sf->info, glyph_index, &advance, NULL);
+      sf->advance[glyph_index] = (float) advance * sf->scale;
+      sf->has_advance[glyph_index >> 3] |= (unsigned char) (1 << (glyph_index & 7));
+   }
+   return sf->advance[glyph_index];
+}
+
+STBTT_DEF float stbtt_GetSizedGlyphKernAdvance(stbtt_sized_font *sf, int glyph1, int glyph2)
+{
+   const stbtt_fontinfo *info = sf->info;
+   stbtt__sized_kern *e;
+   stbtt_uint32 pair;
+
+   if (!info->kern && !info->gpos)
+      return 0;
+   if ((stbtt_uint32) glyph1 >= (stbtt_uint32) info->numGlyphs || (stbtt_uint32) glyph2 >= (stbtt_uint32) info->numGlyphs)
+      return (float) stbtt_GetGlyphKernAdvance(info, glyph1, glyph2) * sf->scale;
+   pair = (stbtt_uint32) glyph1 << 16 | (stbtt_uint32) glyph2;
+   e = &sf->kern[((pair ^ (pair >> 15)) * 0x9e3779b1u) >> 16 & (STBTT_SIZED_KERN_CACHE-1)];
+   if (e->pair != pair) {
+      e->value = (float) stbtt_GetGlyphKernAdvance(info, glyph1, glyph2) * sf->scale;
+      e->pair = pair;
+   }
+   return e->value;
+}
+
 STBTT_DEF void stbtt_FreeShape(const stbtt_fontinfo *info, stbtt_vertex *v)
 {
    STBTT_free(v, info->userdata);
@@ -3712,22 +8037,58 @@ STBTT_DEF void stbtt_FreeBitmap(unsigned char *bitmap, void *userdata)
    STBTT_free(bitmap, userdata);
 }
 
+// the bitmap functions decode outlines into a buffer on the stack, unless
+// the glyph needs more vertices than this
+#ifndef STBTT_SHAPE_SCRATCH
+#define STBTT_SHAPE_SCRATCH 512
+#endif
+
+static int stbtt__GetGlyphShapeScratch(const stbtt_fontinfo *info, int glyph, stbtt_vertex *scratch, stbtt_vertex **pvertices)
+{
+   int bound;
+   if (info->outlines && (bound = stbtt__outline_cache_get(info, glyph, scratch, STBTT_SHAPE_SCRATCH, pvertices)) >= 0)
+      return bound;
+   if (info->cff.size) {
+      // sizing a CFF glyph means running its charstring, so don't
+      bound = stbtt__GetGlyphShapeT2Buffered(info, glyph, scratch, STBTT_SHAPE_SCRATCH, pvertices);
+      if (info->outlines)
+         stbtt__outline_cache_put(info, glyph, *pvertices, bound);
+      return bound;
+   }
+   bound = stbtt_GetGlyphShapeBound(info, glyph);
+   *pvertices = scratch;
+   if (bound > STBTT_SHAPE_SCRATCH) {
+      *pvertices = (stbtt_vertex *) STBTT_malloc(bound * sizeof(stbtt_vertex), info->userdata);
+      if (!*pvertices) {
+         *pvertices = scratch;
+         return 0;
+      }
+   }
+   return stbtt_GetGlyphShapeInto(info, glyph, *pvertices, bound);
+}
+
+static void stbtt__FreeShapeScratch(const stbtt_fontinfo *info, stbtt_vertex *vertices, stbtt_vertex *scratch)
+{
+   if (vertices != scratch)
+      STBTT_free(vertices, info->userdata);
+}
+
 STBTT_DEF unsigned char *stbtt_GetGlyphBitmapSubpixel(const stbtt_fontinfo *info, float scale_x, float scale_y, float shift_x, float shift_y, int glyph, int *width, int *height, int *xoff, int *yoff)
 {
    int ix0,iy0,ix1,iy1;
    stbtt__bitmap gbm;
-   stbtt_vertex *vertices;
-   int num_verts = stbtt_GetGlyphShape(info, glyph, &vertices);
+   stbtt_vertex scratch[STBTT_SHAPE_SCRATCH], *vertices;
+   int num_verts;
 
    if (scale_x == 0) scale_x = scale_y;
    if (scale_y == 0) {
-      if (scale_x == 0) {
-         STBTT_free(vertices, info->userdata);
+      if (scale_x == 0)
          return NULL;
-      }
       scale_y = scale_x;
    }
 
+   num_verts = stbtt__GetGlyphShapeScratch(info, glyph, scratch, &vertices);
+
    stbtt_GetGlyphBitmapBoxSubpixel(info, glyph, scale_x, scale_y, shift_x, shift_y, &ix0,&iy0,&ix1,&iy1);
 
    // now we get the size
@@ -3748,7 +8109,7 @@ STBTT_DEF unsigned char *stbtt_GetGlyphBitmapSubpixel(const stbtt_fontinfo *info
          stbtt_Rasterize(&gbm, 0.35f, vertices, num_verts, scale_x, scale_y, shift_x, shift_y, ix0, iy0, 1, info->userdata);
       }
    }
-   STBTT_free(vertices, info->userdata);
+   stbtt__FreeShapeScratch(info, vertices, scratch);
    return gbm.pixels;
 }
 
@@ -3760,8 +8121,8 @@ STBTT_DEF unsigned char *stbtt_GetGlyphBitmap(const stbtt_fontinfo *info, float
 STBTT_DEF void stbtt_MakeGlyphBitmapSubpixel(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int glyph)
 {
    int ix0,iy0;
-   stbtt_vertex *vertices;
-   int num_verts = stbtt_GetGlyphShape(info, glyph, &vertices);
+   stbtt_vertex scratch[STBTT_SHAPE_SCRATCH], *vertices;
+   int num_verts = stbtt__GetGlyphShapeScratch(info, glyph, scratch, &vertices);
    stbtt__bitmap gbm;
 
    stbtt_GetGlyphBitmapBoxSubpixel(info, glyph, scale_x, scale_y, shift_x, shift_y, &ix0,&iy0,0,0);
@@ -3773,7 +8134,7 @@ STBTT_DEF void stbtt_MakeGlyphBitmapSubpixel(const stbtt_fontinfo *info, unsigne
    if (gbm.w && gbm.h)
       stbtt_Rasterize(&gbm, 0.35f, vertices, num_verts, scale_x, scale_y, shift_x, shift_y, ix0,iy0, 1, info->userdata);
 
-   STBTT_free(vertices, info->userdata);
+   stbtt__FreeShapeScratch(info, vertices, scratch);
 }
 
 STBTT_DEF void stbtt_MakeGlyphBitmap(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, int glyph)
@@ -4326,6 +8687,10 @@ STBTT_DEF int stbtt_PackFontRanges(stbtt_pack_context *spc, const unsigned char
 
    info.userdata = spc->user_allocator_context;
    stbtt_InitFont(&info, fontdata, dsize, stbtt_GetFontOffsetForIndex(fontdata,font_index));
+   // every glyph's box is needed several times, and each one runs the
+   // charstring for CFF fonts
+   if (info.cff.size)
+      stbtt_BuildGlyphBoxTable(&info);
 
    n = stbtt_PackFontRangesGatherRects(spc, &info, ranges, num_ranges, rects);
 
@@ -4333,6 +8698,7 @@ STBTT_DEF int stbtt_PackFontRanges(stbtt_pack_context *spc, const unsigned char
 
    return_value = stbtt_PackFontRangesRenderIntoRects(spc, &info, ranges, num_ranges, rects);
 
+   stbtt_FreeFontCaches(&info);
    STBTT_free(rects, spc->user_allocator_context);
    return return_value;
 }
@@ -4351,10 +8717,18 @@ STBTT_DEF int stbtt_PackFontRange(stbtt_pack_context *spc, const unsigned char *
 
 STBTT_DEF void stbtt_GetScaledFontVMetrics(const unsigned char *fontdata, long dsize, int index, float size, float *ascent, float *descent, float *lineGap)
 {
-   int i_ascent, i_descent, i_lineGap;
+   int i_ascent, i_descent, i_lineGap, offset = stbtt_GetFontOffsetForIndex(fontdata, index);
    float scale;
    stbtt_fontinfo info;
-   stbtt_InitFont(&info, fontdata, dsize, stbtt_GetFontOffsetForIndex(fontdata, index));
+   // only 'head' and 'hhea' are read, so the rest of the font isn't set up
+   *ascent = *descent = *lineGap = 0;
+   info.data = (unsigned char *) fontdata;
+   if (offset < 0 || !stbtt__fits(offset, 12, dsize) || !stbtt__fits(offset + 12, 16 * ttUSHORT(info.data + offset + 4), dsize))
+      return;
+   info.head = stbtt__find_table(info.data, offset, "head");
+   info.hhea = stbtt__find_table(info.data, offset, "hhea");
+   if (!info.head || !info.hhea || !stbtt__fits(info.head, 20, dsize) || !stbtt__fits(info.hhea, 10, dsize))
+      return;
    scale = size > 0 ? stbtt_ScaleForPixelHeight(&info, size) : stbtt_ScaleForMappingEmToPixels(&info, -size);
    stbtt_GetFontVMetrics(&info, &i_ascent, &i_descent, &i_lineGap);
    *ascent  = (float) i_ascent  * scale;
@@ -4608,8 +8982,8 @@ STBTT_DEF unsigned char * stbtt_GetGlyphSDF(const stbtt_fontinfo *info, float sc
    {
       int x,y,i,j;
       float *precompute;
-      stbtt_vertex *verts;
-      int num_verts = stbtt_GetGlyphShape(info, glyph, &verts);
+      stbtt_vertex scratch[STBTT_SHAPE_SCRATCH], *verts;
+      int num_verts = stbtt__GetGlyphShapeScratch(info, glyph, scratch, &verts);
       data = (unsigned char *) STBTT_malloc(w * h, info->userdata);
       precompute = (float *) STBTT_malloc(num_verts * sizeof(float), info->userdata);
 
@@ -4754,7 +9128,7 @@ STBTT_DEF unsigned char * stbtt_GetGlyphSDF(const stbtt_fontinfo *info, float sc
          }
       }
       STBTT_free(precompute, info->userdata);
-      STBTT_free(verts, info->userdata);
+      stbtt__FreeShapeScratch(info, verts, scratch);
    }
    return data;
 }
@@ -4825,8 +9199,7 @@ STBTT_DEF const char *stbtt_GetFontNameString(const stbtt_fontinfo *font, int *l
 {
    stbtt_int32 i,count,stringOffset;
    stbtt_uint8 *fc = font->data;
-   stbtt_uint32 offset = font->fontstart;
-   stbtt_uint32 nm = stbtt__find_table(fc, offset, "name");
+   stbtt_uint32 nm = stbtt__get_table(font, "name", NULL);
    if (!nm) return NULL;
 
    count = ttUSHORT(fc+nm+2);
@@ -4892,16 +9265,24 @@ static int stbtt__matchpair(stbtt_uint8 *fc, stbtt_uint32 nm, stbtt_uint8 *name,
 static int stbtt__matches(stbtt_uint8 *fc, stbtt_uint32 offset, stbtt_uint8 *name, stbtt_int32 flags)
 {
    stbtt_int32 nlen = (stbtt_int32) STBTT_strlen((char *) name);
-   stbtt_uint32 nm,hd;
+   stbtt_uint32 nm=0,hd=0;
+   stbtt_int32 i, num_tables;
    if (!stbtt__isfont(fc+offset)) return 0;
 
+   // there's no buffer size to index the directory against, and we only
+   // want two tables, so pick both up in a single pass
+   num_tables = ttUSHORT(fc+offset+4);
+   for (i=0; i < num_tables && !(nm && hd); ++i) {
+      stbtt_uint8 *rec = fc + offset + 12 + 16*i;
+      if (stbtt_tag(rec, "head")) hd = ttULONG(rec+8);
+      else if (stbtt_tag(rec, "name")) nm = ttULONG(rec+8);
+   }
+
    // check italics/bold/underline flags in macStyle...
    if (flags) {
-      hd = stbtt__find_table(fc, offset, "head");
       if ((ttUSHORT(fc+hd+44) & 7) != (flags & 7)) return 0;
    }
 
-   nm = stbtt__find_table(fc, offset, "name");
    if (!nm) return 0;
 
    if (flags) {
@@ -4953,8 +9334,154 @@ STBTT_DEF int stbtt_GetNumberOfFonts(const unsigned char *data)
 
 STBTT_DEF int stbtt_InitFont(stbtt_fontinfo *info, const unsigned char *data, long dsize, int offset)
 {
-   return stbtt_InitFont_internal(info, (unsigned char *) data, dsize, offset);
+   return stbtt_InitFont_internal(info, (unsigned char *) data, dsize, offset, 0);
+}
+
+STBTT_DEF int stbtt_InitFontEx(stbtt_fontinfo *info, const unsigned char *data, long dsize, int offset, int flags)
+{
+   return stbtt_InitFont_internal(info, (unsigned char *) data, dsize, offset, flags);
+}
+
+#ifdef STBTT_MMAP
+#if defined(_WIN32)
+
+STBTT_DEF int stbtt_OpenFontMapping(stbtt_fontmapping *map, const char *filename)
+{
+   HANDLE file, mapping;
+   LARGE_INTEGER size;
+   void *view = NULL;
+
+   map->data = NULL;
+   map->size = 0;
+   map->handle = NULL;
+
+   file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+   if (file == INVALID_HANDLE_VALUE)
+      return 0;
+   if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || size.QuadPart > 0x7fffffff) {
+      CloseHandle(file);
+      return 0;
+   }
+   mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+   CloseHandle(file); // the mapping keeps the file open
+   if (mapping == NULL)
+      return 0;
+   view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   if (view == NULL) {
+      CloseHandle(mapping);
+      return 0;
+   }
+   map->data = (unsigned char *) view;
+   map->size = (long) size.QuadPart;
+   map->handle = (void *) mapping;
+   return 1;
+}
+
+STBTT_DEF void stbtt_CloseFontMapping(stbtt_fontmapping *map)
+{
+   if (map->data)
+      UnmapViewOfFile(map->data);
+   if (map->handle)
+      CloseHandle((HANDLE) map->handle);
+   map->data = NULL;
+   map->size = 0;
+   map->handle = NULL;
+}
+
+static void stbtt__map_hint(stbtt_fontmapping *map, const stbtt_fontinfo *info, const char *tag, int willneed)
+{
+   // no portable per-range advice; FILE_FLAG_RANDOM_ACCESS above covers the common case
+   STBTT__NOTUSED(map);
+   STBTT__NOTUSED(info);
+   STBTT__NOTUSED(tag);
+   STBTT__NOTUSED(willneed);
+}
+
+#else
+
+STBTT_DEF int stbtt_OpenFontMapping(stbtt_fontmapping *map, const char *filename)
+{
+   struct stat st;
+   void *p;
+   int fd;
+
+   map->data = NULL;
+   map->size = 0;
+   map->handle = NULL;
+
+   fd = open(filename, O_RDONLY);
+   if (fd < 0)
+      return 0;
+   if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > 0x7fffffff) {
+      close(fd);
+      return 0;
+   }
+   p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd); // the mapping keeps the file open
+   if (p == MAP_FAILED)
+      return 0;
+   map->data = (unsigned char *) p;
+   map->size = (long) st.st_size;
+   return 1;
+}
+
+STBTT_DEF void stbtt_CloseFontMapping(stbtt_fontmapping *map)
+{
+   if (map->data)
+      munmap(map->data, (size_t) map->size);
+   map->data = NULL;
+   map->size = 0;
+   map->handle = NULL;
+}
+
+static void stbtt__map_hint(stbtt_fontmapping *map, const stbtt_fontinfo *info, const char *tag, int willneed)
+{
+#ifdef POSIX_MADV_WILLNEED
+   stbtt_uint32 length, offset = stbtt__get_table(info, tag, &length);
+   long page = sysconf(_SC_PAGESIZE);
+   long start, end;
+
+   if (!offset || !length || page <= 0)
+      return;
+   start = (long) offset & ~(page-1);
+   end = (long) offset + (long) length;
+   if (end > map->size || end < (long) offset)
+      end = map->size;
+   if (end > start)
+      posix_madvise(map->data + start, (size_t) (end - start), willneed ? POSIX_MADV_WILLNEED : POSIX_MADV_RANDOM);
+#else
+   // posix_madvise() is only declared with _POSIX_C_SOURCE >= 200112L
+   STBTT__NOTUSED(map);
+   STBTT__NOTUSED(info);
+   STBTT__NOTUSED(tag);
+   STBTT__NOTUSED(willneed);
+#endif
+}
+
+#endif
+
+STBTT_DEF int stbtt_InitFontFromFile(stbtt_fontinfo *info, stbtt_fontmapping *map, const char *filename, int index)
+{
+   int offset;
+
+   if (!stbtt_OpenFontMapping(map, filename))
+      return 0;
+   offset = map->size >= 12 ? stbtt_GetFontOffsetForIndex(map->data, index) : -1;
+   if (offset < 0 || !stbtt_InitFont(info, map->data, map->size, offset)) {
+      stbtt_CloseFontMapping(map);
+      return 0;
+   }
+
+   // outlines are touched a glyph at a time, in no particular order
+   stbtt__map_hint(map, info, "glyf", 0);
+   stbtt__map_hint(map, info, "CFF ", 0);
+   // these are needed for nearly every character laid out
+   stbtt__map_hint(map, info, "cmap", 1);
+   stbtt__map_hint(map, info, "hhea", 1);
+   stbtt__map_hint(map, info, "hmtx", 1);
+   return 1;
 }
+#endif // STBTT_MMAP
 
 STBTT_DEF int stbtt_FindMatchingFont(const unsigned char *fontdata, const char *name, int flags)
 {
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <stdlib.h>
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+
+/* Succeeds if stbtt_ValidateFont rejects the font */
+int main(int argc, const char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s font-file\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fontFile = fopen(argv[1], "rb");
+    if (!fontFile) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(fontFile, 0, SEEK_END);
+    long size = ftell(fontFile); /* how long is the file ? */
+    fseek(fontFile, 0, SEEK_SET); /* reset */
+
+    unsigned char *fontBuffer = calloc(size, sizeof(unsigned char));
+    fread(fontBuffer, size, 1, fontFile);
+    fclose(fontFile);
+
+    stbtt_fontinfo info;
+    int valid = stbtt_InitFontEx(&info, fontBuffer, size, 0, STBTT_INIT_VALIDATE | STBTT_INIT_LAZY_CFF);
+    if (valid)
+        printf("accepted\n");
+
+    free(fontBuffer);
+    return valid;
+}